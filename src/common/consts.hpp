@@ -18,3 +18,50 @@ constexpr inline GUID guid_output_avfoundation = {
 constexpr inline GUID guid_output_device = {
     0xFCDC89BE, 0x01F0, 0xCDBB, {0x04, 0x53, 0x1A, 0xC5, 0x9D, 0xC6, 0x2E, 0x17}
 };
+
+// Advanced settings: Preferences > Advanced > Playback > AVFoundation Output
+constexpr inline GUID guid_advconfig_branch = {
+    0xE93CCBB5, 0x30F1, 0x5E68, {0xD3, 0xB5, 0x19, 0xFE, 0x3D, 0x24, 0xD0, 0xD6}
+};
+constexpr inline GUID guid_advconfig_target_buffer = {
+    0x65230404, 0xBBCA, 0x2B21, {0x94, 0xD0, 0xBE, 0x1C, 0x05, 0x30, 0x6C, 0xFC}
+};
+constexpr inline GUID guid_advconfig_split_frames = {
+    0x5FD9052B, 0x3B0B, 0x7460, {0x5D, 0x37, 0xEE, 0xD6, 0xD0, 0xAC, 0xA9, 0xAA}
+};
+constexpr inline GUID guid_advconfig_conversion = {
+    0x7CAD8372, 0xD932, 0x41FB, {0xE6, 0xC5, 0x3C, 0xF1, 0x9E, 0xBD, 0x9E, 0xD1}
+};
+constexpr inline GUID guid_advconfig_sanitize = {
+    0x7A07DFA4, 0x1474, 0x2872, {0x69, 0xBC, 0xCA, 0x91, 0x9A, 0xB6, 0xD0, 0xA7}
+};
+constexpr inline GUID guid_advconfig_fade_in = {
+    0xAD5D7970, 0x5BE8, 0xA1A5, {0xB5, 0xC2, 0x24, 0x93, 0x64, 0xD8, 0x67, 0x62}
+};
+constexpr inline GUID guid_advconfig_power_mode = {
+    0xCD356596, 0x751F, 0xB24B, {0x31, 0x8D, 0x98, 0x9C, 0xB8, 0xF3, 0xBB, 0x1A}
+};
+constexpr inline GUID guid_advconfig_idle_reclaim = {
+    0x2C0ECB06, 0xA1E0, 0xD20E, {0x73, 0x14, 0x0C, 0xA4, 0x88, 0x25, 0x05, 0x07}
+};
+constexpr inline GUID guid_advconfig_shm_tap = {
+    0xD959493E, 0xF844, 0x4725, {0xBD, 0xD1, 0x6C, 0xC3, 0x00, 0x6B, 0x93, 0x39}
+};
+constexpr inline GUID guid_advconfig_control_socket = {
+    0x6ADEB12C, 0xB2E6, 0x38E5, {0x43, 0x4D, 0xAD, 0x60, 0x2C, 0x01, 0x73, 0x40}
+};
+constexpr inline GUID guid_advconfig_verify = {
+    0xC3EBE33F, 0x7767, 0x4358, {0x8D, 0x07, 0x10, 0xFB, 0xC1, 0x50, 0x8F, 0x9A}
+};
+constexpr inline GUID guid_advconfig_crossfeed = {
+    0x40B2E574, 0xED3C, 0x4E56, {0x9D, 0x55, 0x41, 0x10, 0xFC, 0xE5, 0xDA, 0x94}
+};
+constexpr inline GUID guid_advconfig_stereo_spatial = {
+    0xAAAC0BCA, 0xB465, 0x4B30, {0x88, 0xE5, 0x92, 0x70, 0x71, 0xA7, 0xE4, 0xC2}
+};
+constexpr inline GUID guid_advconfig_night_mode = {
+    0xC9870B2D, 0x460D, 0x4B5F, {0x94, 0x01, 0x7C, 0x90, 0x62, 0x8B, 0xB0, 0xB6}
+};
+constexpr inline GUID guid_advconfig_governor = {
+    0x13320118, 0x4EE4, 0x4F21, {0x88, 0x99, 0xD6, 0xA4, 0xEC, 0x2F, 0x68, 0xD6}
+};
@@ -0,0 +1,378 @@
+#pragma once
+
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <algorithm>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <sched.h>
+#endif
+
+namespace utils
+{
+    // Just enough JSON to answer monitoring queries: objects, arrays, numbers, booleans and strings
+    class json_writer {
+    public:
+        json_writer &begin_object(const char *key = nullptr) { return open(key, '{'); }
+        json_writer &end_object() { return close('}'); }
+        json_writer &begin_array(const char *key = nullptr) { return open(key, '['); }
+        json_writer &end_array() { return close(']'); }
+
+        json_writer &value(const char *key, const std::string &v) {
+            prefix(key);
+            quote(v);
+            return *this;
+        }
+        json_writer &value(const char *key, const char *v) { return value(key, std::string(v)); }
+        json_writer &value(const char *key, bool v) { return raw(key, v ? "true" : "false"); }
+        template <typename Int, std::enable_if_t<std::is_integral_v<Int> && !std::is_same_v<Int, bool>, int> = 0>
+        json_writer &value(const char *key, Int v) {
+            return raw(key, std::to_string(v));
+        }
+        // JSON has no NaN or infinity
+        json_writer &value(const char *key, double v) {
+            if (!std::isfinite(v)) {
+                return raw(key, "null");
+            }
+            char text[32];
+            snprintf(text, sizeof(text), "%.6g", v);
+            return raw(key, text);
+        }
+
+        // Already formatted JSON
+        json_writer &raw(const char *key, const std::string &json) {
+            prefix(key);
+            out_ += json;
+            return *this;
+        }
+
+        const std::string &str() const { return out_; }
+
+    private:
+        json_writer &open(const char *key, char bracket) {
+            prefix(key);
+            out_ += bracket;
+            first_ = true;
+            return *this;
+        }
+
+        json_writer &close(char bracket) {
+            out_ += bracket;
+            first_ = false;
+            return *this;
+        }
+
+        void prefix(const char *key) {
+            if (!first_) {
+                out_ += ',';
+            }
+            first_ = false;
+            if (key) {
+                quote(key);
+                out_ += ':';
+            }
+        }
+
+        void quote(const std::string &s) {
+            out_ += '"';
+            for (const char c : s) {
+                if (c == '"' || c == '\\') {
+                    out_ += '\\';
+                    out_ += c;
+                } else if (static_cast<unsigned char>(c) < 0x20) {
+                    char escaped[8];
+                    snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                    out_ += escaped;
+                } else {
+                    out_ += c;
+                }
+            }
+            out_ += '"';
+        }
+
+        std::string out_;
+        bool first_ = true;
+    };
+
+    // Local monitoring and control endpoint on a Unix domain socket.
+    //
+    // Line protocol, one request per line: `<command> [arguments]`. Every request gets exactly one line back,
+    // `{"ok":true,"result":...}` or `{"ok":false,"error":"..."}`. `help` lists the commands. Works with anything
+    // that speaks Unix sockets, e.g. `echo stats | socat - UNIX-CONNECT:<path>` or a few lines of Python.
+    //
+    // Requests are served on one background thread at the lowest scheduling class the OS offers. Handlers run
+    // there too, so they must only read lock-free snapshots and publish through the usual config paths; the
+    // audio threads never see a client.
+    class control_server {
+    public:
+        // Returns the result as a JSON value, or throws std::runtime_error / std::invalid_argument to report an error
+        using handler = std::function<std::string(const std::string &arguments)>;
+
+        static constexpr size_t max_clients = 8;
+        static constexpr size_t max_line = 4096;
+
+        // Per-user location for a socket called `name`: the Darwin user temp dir, $XDG_RUNTIME_DIR, or /tmp
+        static std::string default_path(const char *name) {
+            std::string dir;
+#if defined(__APPLE__)
+            char buffer[PATH_MAX];
+            if (confstr(_CS_DARWIN_USER_TEMP_DIR, buffer, sizeof(buffer)) > 0) {
+                dir = buffer;
+            }
+#else
+            if (const char *runtime = getenv("XDG_RUNTIME_DIR")) {
+                dir = runtime;
+            }
+#endif
+            if (dir.empty()) {
+                dir = "/tmp";
+            }
+            if (dir.back() != '/') {
+                dir += '/';
+            }
+            return dir + name;
+        }
+
+        explicit control_server(std::string path) : path_(std::move(path)) {
+            on("help", [this](const std::string &) {
+                json_writer w;
+                w.begin_array();
+                for (const auto &entry : handlers_) {
+                    w.value(nullptr, entry.first);
+                }
+                w.end_array();
+                return w.str();
+            });
+        }
+
+        ~control_server() { stop(); }
+
+        control_server(const control_server &) = delete;
+        control_server &operator=(const control_server &) = delete;
+
+        // Before start() only
+        void on(const std::string &command, handler h) { handlers_[command] = std::move(h); }
+
+        bool start() {
+            if (thread_.joinable()) {
+                return true;
+            }
+            sockaddr_un address = {};
+            address.sun_family = AF_UNIX;
+            if (path_.size() >= sizeof(address.sun_path)) {
+                error_ = "socket path too long: " + path_;
+                return false;
+            }
+            memcpy(address.sun_path, path_.c_str(), path_.size() + 1);
+
+            listen_fd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+            if (listen_fd_ < 0 || pipe(wake_) != 0) {
+                return fail("socket");
+            }
+            fcntl(listen_fd_, F_SETFD, FD_CLOEXEC);
+            fcntl(wake_[0], F_SETFD, FD_CLOEXEC);
+            fcntl(wake_[1], F_SETFD, FD_CLOEXEC);
+
+            // A previous instance that crashed leaves its socket file behind
+            unlink(path_.c_str());
+            if (bind(listen_fd_, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0) {
+                return fail("bind");
+            }
+            chmod(path_.c_str(), 0600);
+            if (listen(listen_fd_, static_cast<int>(max_clients)) != 0) {
+                return fail("listen");
+            }
+            thread_ = std::thread([this] { serve(); });
+            return true;
+        }
+
+        void stop() {
+            if (thread_.joinable()) {
+                const char byte = 0;
+                (void)!write(wake_[1], &byte, 1);
+                thread_.join();
+                unlink(path_.c_str());
+            }
+            for (int *fd : {&listen_fd_, &wake_[0], &wake_[1]}) {
+                if (*fd >= 0) {
+                    close(*fd);
+                    *fd = -1;
+                }
+            }
+        }
+
+        bool running() const { return thread_.joinable(); }
+        const std::string &path() const { return path_; }
+        const std::string &error() const { return error_; }
+
+        // One request line to one reply line (without the newline), also handy for in-process callers and tests
+        std::string dispatch(const std::string &line) const {
+            const size_t space = line.find(' ');
+            const std::string command = line.substr(0, space);
+            const std::string arguments = space == std::string::npos ? std::string() : line.substr(space + 1);
+            json_writer w;
+            w.begin_object();
+            const auto it = handlers_.find(command);
+            if (it == handlers_.end()) {
+                w.value("ok", false).value("error", "unknown command '" + command + "', try help");
+            } else {
+                try {
+                    const std::string result = it->second(arguments);
+                    w.value("ok", true).raw("result", result.empty() ? "null" : result);
+                } catch (const std::exception &e) {
+                    w = json_writer();
+                    w.begin_object().value("ok", false).value("error", e.what());
+                }
+            }
+            w.end_object();
+            return w.str();
+        }
+
+    private:
+        struct client {
+            int fd;
+            std::string pending;
+        };
+
+        bool fail(const char *what) {
+            error_ = std::string(what) + ": " + strerror(errno);
+            for (int *fd : {&listen_fd_, &wake_[0], &wake_[1]}) {
+                if (*fd >= 0) {
+                    close(*fd);
+                    *fd = -1;
+                }
+            }
+            return false;
+        }
+
+        static void lower_priority() {
+#if defined(__APPLE__)
+            pthread_set_qos_class_self_np(QOS_CLASS_UTILITY, 0);
+#elif defined(__linux__)
+            sched_param param = {};
+            pthread_setschedparam(pthread_self(), SCHED_IDLE, &param);
+#endif
+        }
+
+        static void send_line(int fd, std::string reply) {
+            reply += '\n';
+            for (size_t sent = 0; sent < reply.size();) {
+#if defined(MSG_NOSIGNAL)
+                const ssize_t n = send(fd, reply.data() + sent, reply.size() - sent, MSG_NOSIGNAL);
+#else
+                const ssize_t n = send(fd, reply.data() + sent, reply.size() - sent, 0);
+#endif
+                if (n <= 0) {
+                    return;
+                }
+                sent += static_cast<size_t>(n);
+            }
+        }
+
+        void accept_client(std::vector<client> &clients) {
+            const int fd = accept(listen_fd_, nullptr, nullptr);
+            if (fd < 0) {
+                return;
+            }
+            if (clients.size() >= max_clients) {
+                close(fd);
+                return;
+            }
+            fcntl(fd, F_SETFD, FD_CLOEXEC);
+#if defined(SO_NOSIGPIPE)
+            const int on = 1;
+            setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+            // A client that stops reading must not wedge the server
+            timeval timeout = {1, 0};
+            setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+            clients.push_back({fd, {}});
+        }
+
+        // False once the client is gone
+        bool read_client(client &c) const {
+            char buffer[1024];
+            const ssize_t n = recv(c.fd, buffer, sizeof(buffer), 0);
+            if (n <= 0) {
+                return false;
+            }
+            c.pending.append(buffer, static_cast<size_t>(n));
+            for (size_t newline; (newline = c.pending.find('\n')) != std::string::npos;) {
+                std::string line = c.pending.substr(0, newline);
+                c.pending.erase(0, newline + 1);
+                if (!line.empty() && line.back() == '\r') {
+                    line.pop_back();
+                }
+                if (!line.empty()) {
+                    send_line(c.fd, dispatch(line));
+                }
+            }
+            return c.pending.size() <= max_line;
+        }
+
+        void serve() {
+            lower_priority();
+            std::vector<client> clients;
+            std::vector<pollfd> fds;
+            for (;;) {
+                fds.clear();
+                fds.push_back({wake_[0], POLLIN, 0});
+                fds.push_back({listen_fd_, POLLIN, 0});
+                for (const client &c : clients) {
+                    fds.push_back({c.fd, POLLIN, 0});
+                }
+                if (poll(fds.data(), fds.size(), -1) < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    break;
+                }
+                if (fds[0].revents) {
+                    break;
+                }
+                // Clients first, accepting appends to the list the poll set was built from
+                for (size_t i = clients.size(); i-- > 0;) {
+                    if (fds[i + 2].revents && !read_client(clients[i])) {
+                        close(clients[i].fd);
+                        clients.erase(clients.begin() + static_cast<std::ptrdiff_t>(i));
+                    }
+                }
+                if (fds[1].revents & POLLIN) {
+                    accept_client(clients);
+                }
+            }
+            for (const client &c : clients) {
+                close(c.fd);
+            }
+        }
+
+        std::string path_;
+        std::string error_;
+        std::map<std::string, handler> handlers_;
+        int listen_fd_ = -1;
+        int wake_[2] = {-1, -1};
+        std::thread thread_;
+    };
+} // namespace utils
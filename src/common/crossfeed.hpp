@@ -0,0 +1,172 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include "dsp_graph.hpp"
+
+#if defined(__aarch64__) || defined(__arm64ec__)
+#include <arm_neon.h>
+#elif defined(__SSE2__) || defined(__x86_64__)
+#include <emmintrin.h>
+#endif
+
+namespace utils
+{
+    // Bauer-style crossfeed settings, the classic bs2b presets. Index 0 is off.
+    struct crossfeed_preset {
+        const char *name;
+        float cutoff_hz; // cross path low-pass
+        float feed_db;   // how far the cross path sits below the direct path at low frequencies
+        float delay_ms;  // interaural delay of the cross path
+    };
+
+    inline constexpr crossfeed_preset crossfeed_presets[] = {
+        {"off", 0, 0, 0},
+        {"default", 700, 4.5f, 0.3f},
+        {"Chu Moy", 700, 6.0f, 0.3f},
+        {"Jan Meier", 650, 9.5f, 0.3f},
+    };
+    inline constexpr uint32_t crossfeed_preset_count = sizeof(crossfeed_presets) / sizeof(crossfeed_presets[0]);
+
+    // Headphone crossfeed for stereo: each ear also gets the other channel, low-passed and slightly late, the way
+    // it would arrive from a speaker on the far side. The direct path gives up the same low-frequency share, so
+    // centred material keeps its level and hard-panned material stops sitting inside one ear. Nothing looks
+    // ahead, the stage adds no latency.
+    //
+    // The one-pole filters run both channels in one vector, the mix two frames per vector. Anything but stereo
+    // passes through untouched.
+    class crossfeed_stage : public dsp_stage {
+    public:
+        static constexpr size_t max_delay_frames = 256; // 0.3 ms fits up to 768 kHz
+
+        const char *name() const override { return "crossfeed"; }
+
+        // Processing thread
+        void set_preset(uint32_t preset) {
+            preset = std::min(preset, crossfeed_preset_count - 1);
+            if (preset != preset_) {
+                preset_ = preset;
+                configure();
+            }
+        }
+        uint32_t preset() const { return preset_; }
+
+        // Low-passed history for the delayed cross path, then this block
+        size_t scratch_floats(size_t max_frames, unsigned) const override { return (max_delay_frames + max_frames) * 2; }
+
+        void prepare(uint32_t sample_rate, unsigned, size_t, float *scratch) override {
+            sample_rate_ = sample_rate;
+            history_ = scratch;
+            configure();
+            reset();
+        }
+
+        void reset() override {
+            state_[0] = state_[1] = 0;
+            if (history_) {
+                std::fill(history_, history_ + max_delay_frames * 2, 0.0f);
+            }
+        }
+
+        void process(const float *in, float *out, size_t frames, unsigned channels) override {
+            if (channels != 2 || preset_ == 0 || !history_) {
+                if (in != out) {
+                    memcpy(out, in, frames * channels * sizeof(float));
+                }
+                return;
+            }
+            float *lp = history_ + max_delay_frames * 2;
+            low_pass(in, lp, frames);
+            mix(in, out, lp, frames);
+
+            // The newest `delay_` filtered frames go right in front of the next block
+            const ptrdiff_t newest = static_cast<ptrdiff_t>(frames) - static_cast<ptrdiff_t>(delay_);
+            memmove(lp - delay_ * 2, lp + newest * 2, delay_ * 2 * sizeof(float));
+
+            // Decaying into denormals on silence is slow on every CPU this runs on
+            for (float &s : state_) {
+                if (std::fabs(s) < 1e-15f) {
+                    s = 0;
+                }
+            }
+        }
+
+    private:
+        void configure() {
+            const crossfeed_preset &p = crossfeed_presets[preset_];
+            if (sample_rate_ == 0 || preset_ == 0) {
+                return;
+            }
+            const double pi = 3.14159265358979323846;
+            const double cutoff = std::min<double>(p.cutoff_hz, sample_rate_ * 0.45);
+            coefficient_ = static_cast<float>(1 - std::exp(-2 * pi * cutoff / sample_rate_));
+            const double ratio = std::pow(10.0, -p.feed_db / 20.0);
+            feed_ = static_cast<float>(ratio / (1 + ratio));
+            delay_ = std::clamp<size_t>(static_cast<size_t>(std::lround(p.delay_ms * sample_rate_ / 1000.0)), 1, max_delay_frames);
+        }
+
+        // One-pole low-pass of both channels into `lp`, interleaved
+        void low_pass(const float *in, float *lp, size_t frames) {
+#if defined(__aarch64__) || defined(__arm64ec__)
+            const float32x2_t k = vdup_n_f32(coefficient_);
+            float32x2_t s = vld1_f32(state_);
+            for (size_t f = 0; f < frames; f++) {
+                s = vfma_f32(s, k, vsub_f32(vld1_f32(in + f * 2), s));
+                vst1_f32(lp + f * 2, s);
+            }
+            vst1_f32(state_, s);
+#elif defined(__SSE2__) || defined(__x86_64__)
+            const __m128 k = _mm_set1_ps(coefficient_);
+            __m128 s = _mm_castpd_ps(_mm_load_sd(reinterpret_cast<const double *>(state_)));
+            for (size_t f = 0; f < frames; f++) {
+                const __m128 x = _mm_castpd_ps(_mm_load_sd(reinterpret_cast<const double *>(in + f * 2)));
+                s = _mm_add_ps(s, _mm_mul_ps(k, _mm_sub_ps(x, s)));
+                _mm_store_sd(reinterpret_cast<double *>(lp + f * 2), _mm_castps_pd(s));
+            }
+            _mm_store_sd(reinterpret_cast<double *>(state_), _mm_castps_pd(s));
+#else
+            for (size_t f = 0; f < frames; f++) {
+                for (int c = 0; c < 2; c++) {
+                    state_[c] += coefficient_ * (in[f * 2 + c] - state_[c]);
+                    lp[f * 2 + c] = state_[c];
+                }
+            }
+#endif
+        }
+
+        // out = in + feed * (other channel's low-pass, delayed - own low-pass)
+        void mix(const float *in, float *out, const float *lp, size_t frames) const {
+            const float *delayed = lp - delay_ * 2;
+            const size_t count = frames * 2;
+            size_t i = 0;
+#if defined(__aarch64__) || defined(__arm64ec__)
+            const float32x4_t g = vdupq_n_f32(feed_);
+            for (; i + 4 <= count; i += 4) {
+                const float32x4_t cross = vrev64q_f32(vld1q_f32(delayed + i)); // swap L and R of each frame
+                vst1q_f32(out + i, vfmaq_f32(vld1q_f32(in + i), g, vsubq_f32(cross, vld1q_f32(lp + i))));
+            }
+#elif defined(__SSE2__) || defined(__x86_64__)
+            const __m128 g = _mm_set1_ps(feed_);
+            for (; i + 4 <= count; i += 4) {
+                const __m128 d = _mm_loadu_ps(delayed + i);
+                const __m128 cross = _mm_shuffle_ps(d, d, _MM_SHUFFLE(2, 3, 0, 1));
+                _mm_storeu_ps(out + i, _mm_add_ps(_mm_loadu_ps(in + i), _mm_mul_ps(g, _mm_sub_ps(cross, _mm_loadu_ps(lp + i)))));
+            }
+#endif
+            for (; i < count; i++) {
+                out[i] = in[i] + feed_ * (delayed[i ^ 1] - lp[i]);
+            }
+        }
+
+        uint32_t preset_ = 0;
+        uint32_t sample_rate_ = 0;
+        float coefficient_ = 0;
+        float feed_ = 0;
+        size_t delay_ = 1;
+        float state_[2] = {};
+        float *history_ = nullptr;
+    };
+} // namespace utils
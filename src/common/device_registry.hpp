@@ -0,0 +1,192 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace utils
+{
+    // One output device as the OS reports it. Latencies are in frames at the nominal rate.
+    struct output_device {
+        std::string uid;  // stable across reboots and reconnects, what the renderer is pointed at
+        std::string name; // for the device list in Preferences
+        uint32_t nominal_rate = 0;
+        uint32_t buffer_frames = 0;  // IO buffer size
+        uint32_t latency_frames = 0; // device plus stream latency
+        uint32_t safety_frames = 0;  // how far ahead of the hardware the OS writes
+        unsigned channels = 0;
+
+        // From handing a buffer to the OS until it is heard, not counting anything queued before that
+        double output_latency() const {
+            return nominal_rate ? static_cast<double>(buffer_frames + latency_frames + safety_frames) / nominal_rate : 0;
+        }
+
+        bool operator==(const output_device &) const = default;
+    };
+
+    // Where the device list comes from: CoreAudio on macOS, a simulation for tests and tools elsewhere
+    class device_backend {
+    public:
+        // Waits for change callbacks that are already running
+        virtual ~device_backend() = default;
+
+        // Output-capable devices right now; may block on the OS, never called from audio threads
+        virtual std::vector<output_device> enumerate() = 0;
+
+        // UID of the system default output, empty if unknown
+        virtual std::string default_uid() = 0;
+
+        // Install the callback to run whenever devices come, go or change properties (any thread), nullptr to stop
+        virtual void watch(std::function<void()> changed) = 0;
+    };
+
+    // Cached device list, refreshed from the backend's change notifications instead of being re-queried every
+    // time somebody asks. Readers get an immutable snapshot; generation() lets the audio side notice a change
+    // with one atomic load and only then look at the list.
+    class device_registry {
+    public:
+        using device_list = std::vector<output_device>;
+
+        explicit device_registry(std::unique_ptr<device_backend> backend) : backend_(std::move(backend)) {
+            refresh();
+            backend_->watch([this] { refresh(); });
+        }
+
+        // watch(nullptr) only stops new notifications; backend_ is declared last, so it is destroyed first and waits
+        // out a refresh() still running on its queue while the members that refresh() writes are alive
+        ~device_registry() { backend_->watch(nullptr); }
+
+        device_registry(const device_registry &) = delete;
+        device_registry &operator=(const device_registry &) = delete;
+
+        // Re-reads the backend; only bumps the generation if something actually changed
+        void refresh() {
+            auto fresh = std::make_shared<const device_list>(backend_->enumerate());
+            std::string fallback = backend_->default_uid();
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (devices_ && *devices_ == *fresh && default_uid_ == fallback) {
+                return;
+            }
+            devices_ = std::move(fresh);
+            default_uid_ = std::move(fallback);
+            generation_.fetch_add(1, std::memory_order_release);
+        }
+
+        std::shared_ptr<const device_list> snapshot() const {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return devices_;
+        }
+
+        uint64_t generation() const { return generation_.load(std::memory_order_acquire); }
+
+        // The device with `uid`, or the system default for an empty uid
+        std::optional<output_device> find(const std::string &uid) const {
+            std::lock_guard<std::mutex> lock(mutex_);
+            const std::string &wanted = uid.empty() ? default_uid_ : uid;
+            const auto it = std::find_if(devices_->begin(), devices_->end(), [&](const output_device &d) { return d.uid == wanted; });
+            if (it == devices_->end()) {
+                return std::nullopt;
+            }
+            return *it;
+        }
+
+        // Stable 128-bit id for a device UID (two FNV-1a passes), for hosts that key devices by GUID
+        static std::array<uint8_t, 16> id_for(const std::string &uid) {
+            std::array<uint8_t, 16> id;
+            uint64_t seed = 0xcbf29ce484222325ull;
+            for (int half = 0; half < 2; half++) {
+                uint64_t h = seed;
+                for (const char c : uid) {
+                    h = (h ^ static_cast<uint8_t>(c)) * 0x100000001b3ull;
+                }
+                for (int i = 0; i < 8; i++) {
+                    id[half * 8 + i] = static_cast<uint8_t>(h >> (i * 8));
+                }
+                seed = h ^ 0x9e3779b97f4a7c15ull;
+            }
+            return id;
+        }
+
+    private:
+        mutable std::mutex mutex_;
+        std::shared_ptr<const device_list> devices_;
+        std::string default_uid_;
+        std::atomic<uint64_t> generation_{0};
+        std::unique_ptr<device_backend> backend_;
+    };
+
+    // Devices that exist only in memory, for exercising hot-plug handling without hardware (Linux CI, tools).
+    // Changes notify synchronously on the calling thread, like a backend that delivers on its own queue.
+    class simulated_device_backend : public device_backend {
+    public:
+        std::vector<output_device> enumerate() override {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return devices_;
+        }
+
+        // Like the OS, falls back to another device when the default goes away
+        std::string default_uid() override {
+            std::lock_guard<std::mutex> lock(mutex_);
+            const bool present =
+                std::any_of(devices_.begin(), devices_.end(), [&](const output_device &d) { return d.uid == default_uid_; });
+            if (present || devices_.empty()) {
+                return present ? default_uid_ : std::string();
+            }
+            return devices_.front().uid;
+        }
+
+        void watch(std::function<void()> changed) override {
+            std::lock_guard<std::mutex> lock(mutex_);
+            changed_ = std::move(changed);
+        }
+
+        // Plug in, or update the properties of a device with the same uid
+        void plug(const output_device &device) {
+            change([&] {
+                const auto it = std::find_if(devices_.begin(), devices_.end(), [&](const output_device &d) { return d.uid == device.uid; });
+                if (it == devices_.end()) {
+                    devices_.push_back(device);
+                } else {
+                    *it = device;
+                }
+            });
+        }
+
+        void unplug(const std::string &uid) {
+            change([&] {
+                devices_.erase(std::remove_if(devices_.begin(), devices_.end(), [&](const output_device &d) { return d.uid == uid; }),
+                               devices_.end());
+            });
+        }
+
+        void set_default(const std::string &uid) {
+            change([&] { default_uid_ = uid; });
+        }
+
+    private:
+        template <typename Edit>
+        void change(Edit edit) {
+            std::function<void()> notify;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                edit();
+                notify = changed_;
+            }
+            if (notify) {
+                notify();
+            }
+        }
+
+        std::mutex mutex_;
+        std::vector<output_device> devices_;
+        std::string default_uid_;
+        std::function<void()> changed_;
+    };
+} // namespace utils
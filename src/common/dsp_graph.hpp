@@ -0,0 +1,310 @@
+#pragma once
+
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+#include <algorithm>
+
+namespace utils
+{
+    // One processing step on interleaved float audio
+    class dsp_stage {
+    public:
+        virtual ~dsp_stage() = default;
+
+        virtual const char *name() const = 0;
+
+        // Channel count produced from `input_channels`; stages that change it can't run in place
+        virtual unsigned output_channels(unsigned input_channels) const { return input_channels; }
+        virtual size_t latency_frames() const { return 0; }
+        virtual bool in_place() const { return true; }
+
+        // Every output sample depends only on the same frame of input: the graph may run this stage tile by
+        // tile together with its elementwise neighbours instead of sweeping the whole quantum once per stage
+        virtual bool elementwise() const { return false; }
+
+        // Largest block the stage accepts per process() call, 0 for any
+        virtual size_t max_block() const { return 0; }
+
+        // Working memory wanted from the graph's arena, in floats
+        virtual size_t scratch_floats(size_t /*max_frames*/, unsigned /*channels*/) const { return 0; }
+
+        // Called outside playback (format change); `scratch` points into the arena and stays valid until the
+        // next prepare(). Must not be skipped while the stage is disabled, so enabling it later is free.
+        virtual void prepare(uint32_t /*sample_rate*/, unsigned /*channels*/, size_t /*max_frames*/, float * /*scratch*/) {}
+
+        // Forget history (seek, flush, resume)
+        virtual void reset() {}
+
+        // `in == out` when running in place
+        virtual void process(const float *in, float *out, size_t frames, unsigned channels) = 0;
+    };
+
+    // Processing time of one stage per quantum, kept by dsp_graph while timing is on. A fused run of elementwise
+    // stages is a single sweep and is timed as a whole, under its first stage.
+    struct stage_timing {
+        // Bucket i counts quanta that took less than 2^i microseconds, the last one everything longer
+        static constexpr size_t histogram_buckets = 16;
+
+        const char *name = nullptr;
+        uint64_t quanta = 0;
+        uint64_t total_ns = 0;
+        uint64_t worst_ns = 0;
+        uint64_t histogram[histogram_buckets] = {};
+
+        void record(uint64_t elapsed_ns) {
+            quanta++;
+            total_ns += elapsed_ns;
+            worst_ns = std::max(worst_ns, elapsed_ns);
+            histogram[std::min<size_t>(std::bit_width(elapsed_ns / 1000), histogram_buckets - 1)]++;
+        }
+    };
+
+    // Runs a chain of stages over one quantum with no allocation and as few passes as possible.
+    //
+    // prepare() sizes one arena for the worst case of all stages enabled: a ping-pong buffer for out-of-place
+    // stages plus every stage's scratch. Toggling stages only rebuilds the step list (capacity reserved up front),
+    // so a stage being enabled costs its own compute and nothing else. Adjacent elementwise stages are fused
+    // into one tiled sweep; in-place stages write straight into the caller's buffer; out-of-place stages
+    // alternate between that buffer and the arena, and only an odd number of them costs a final copy back.
+    class dsp_graph {
+    public:
+        // Configuration time only, not while process() may run. Returns the stage index.
+        size_t add(std::shared_ptr<dsp_stage> stage, bool enabled = true) {
+            const char *name = stage->name();
+            entries_.push_back({std::move(stage), enabled});
+            entries_.back().timing.name = name;
+            steps_.reserve(entries_.size());
+            prepared_ = false;
+            return entries_.size() - 1;
+        }
+
+        // Processing thread only, takes effect with the next process()
+        void set_enabled(size_t index, bool enabled) {
+            if (index < entries_.size() && entries_[index].enabled != enabled) {
+                entries_[index].enabled = enabled;
+                dirty_ = true;
+                if (enabled) {
+                    entries_[index].stage->reset();
+                }
+            }
+        }
+
+        bool is_enabled(size_t index) const { return index < entries_.size() && entries_[index].enabled; }
+
+        size_t size() const { return entries_.size(); }
+
+        // Per-stage timing costs two clock reads per step, so it is off unless something reads it. Processing
+        // thread only; process() accumulates, finish_quantum() records, timing() is read from the same thread.
+        void set_timing(bool on) { timing_ = on; }
+        const stage_timing &timing(size_t index) const { return entries_[index].timing; }
+
+        // Records what the stages spent since the last call as one quantum, for callers that process a quantum
+        // in several tiles
+        void finish_quantum() {
+            for (auto &e : entries_) {
+                if (e.pending_ns) {
+                    e.timing.record(e.pending_ns);
+                    e.pending_ns = 0;
+                }
+            }
+        }
+
+        // A stage's latency or block size changed, pick it up with the next process()
+        void invalidate() { dirty_ = true; }
+
+        bool prepared_for(uint32_t sample_rate, unsigned channels, size_t frames) const {
+            return prepared_ && sample_rate == sample_rate_ && channels == channels_ && frames <= max_frames_;
+        }
+
+        // Allocates; call on format changes or when a quantum outgrows max_frames
+        void prepare(uint32_t sample_rate, unsigned channels, size_t max_frames) {
+            sample_rate_ = sample_rate;
+            channels_ = channels;
+            max_frames_ = max_frames;
+
+            // Widest point of the chain with everything enabled
+            max_channels_ = channels;
+            unsigned c = channels;
+            for (const auto &e : entries_) {
+                c = e.stage->output_channels(c);
+                max_channels_ = std::max(max_channels_, c);
+            }
+
+            size_t scratch = 0;
+            for (const auto &e : entries_) {
+                scratch += align(e.stage->scratch_floats(max_frames, max_channels_));
+            }
+            const size_t pingpong = align(max_frames * max_channels_);
+            // A fresh vector rather than assign(), so switching to a smaller format gives the memory back
+            arena_ = std::vector<float>(pingpong + scratch, 0.0f);
+
+            float *p = arena_.data() + pingpong;
+            c = channels;
+            for (auto &e : entries_) {
+                e.stage->prepare(sample_rate, c, max_frames, p);
+                p += align(e.stage->scratch_floats(max_frames, max_channels_));
+                c = e.stage->output_channels(c);
+            }
+            prepared_ = true;
+            dirty_ = true;
+        }
+
+        // Widest channel count the caller's buffer has to hold
+        unsigned max_channels() const { return max_channels_; }
+
+        // Channel count after the enabled stages
+        unsigned output_channels() {
+            replan();
+            return output_channels_;
+        }
+
+        size_t latency_frames() {
+            replan();
+            return latency_frames_;
+        }
+
+        double latency_seconds() { return sample_rate_ ? static_cast<double>(latency_frames()) / sample_rate_ : 0; }
+
+        void reset() {
+            for (auto &e : entries_) {
+                e.stage->reset();
+            }
+        }
+
+        // `io` holds frames * channels samples on entry and must have room for frames * max_channels();
+        // the result is left there. Returns the output channel count.
+        unsigned process(float *io, size_t frames) {
+            replan();
+            float *current = io;
+            float *other = arena_.data();
+            unsigned channels = channels_;
+
+            for (const step &s : steps_) {
+                dsp_stage *first = entries_[s.first].stage.get();
+                const auto started = timing_ ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+                if (s.count > 1 || first->elementwise()) {
+                    run_fused(s, current, frames, channels);
+                } else if (first->in_place()) {
+                    run_blocks(*first, current, current, frames, channels, s.block);
+                } else {
+                    run_blocks(*first, current, other, frames, channels, s.block);
+                    std::swap(current, other);
+                }
+                if (timing_) {
+                    entries_[s.first].pending_ns +=
+                        std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - started).count();
+                }
+                channels = s.output_channels;
+            }
+
+            if (current != io) {
+                memcpy(io, current, frames * channels * sizeof(float));
+            }
+            return channels;
+        }
+
+    private:
+        struct entry {
+            std::shared_ptr<dsp_stage> stage;
+            bool enabled;
+            stage_timing timing = {};
+            uint64_t pending_ns = 0;
+        };
+
+        // A single stage, or a run of fused elementwise stages
+        struct step {
+            size_t first;
+            size_t count;
+            size_t block; // negotiated block size, 0 for the whole quantum
+            unsigned output_channels;
+        };
+
+        // Keep every arena slice on its own cache line
+        static size_t align(size_t floats) { return (floats + 15) & ~size_t(15); }
+
+        // Frames per tile for fused sweeps, sized to stay in L1
+        static size_t tile_frames(unsigned channels) { return std::max<size_t>(16, 4096 / std::max(1u, channels)); }
+
+        void replan() {
+            if (!dirty_) {
+                return;
+            }
+            dirty_ = false;
+            steps_.clear();
+            latency_frames_ = 0;
+            unsigned c = channels_;
+            for (size_t i = 0; i < entries_.size(); i++) {
+                if (!entries_[i].enabled) {
+                    continue;
+                }
+                dsp_stage &stage = *entries_[i].stage;
+                latency_frames_ += stage.latency_frames();
+                const unsigned out = stage.output_channels(c);
+                const bool fusable = stage.elementwise() && stage.in_place() && out == c;
+                if (fusable && !steps_.empty()) {
+                    step &last = steps_.back();
+                    const dsp_stage &prev = *entries_[last.first + last.count - 1].stage;
+                    // Disabled stages in between don't break a run, they're skipped in run_fused
+                    if (prev.elementwise() && prev.in_place() && last.output_channels == c) {
+                        last.count = i - last.first + 1;
+                        last.block = negotiate(last.block, stage.max_block());
+                        continue;
+                    }
+                }
+                steps_.push_back({i, 1, stage.max_block(), out});
+                c = out;
+            }
+            output_channels_ = c;
+        }
+
+        static size_t negotiate(size_t a, size_t b) {
+            if (a == 0) {
+                return b;
+            }
+            return b == 0 ? a : std::min(a, b);
+        }
+
+        void run_fused(const step &s, float *data, size_t frames, unsigned channels) {
+            const size_t tile = negotiate(tile_frames(channels), s.block);
+            for (size_t f = 0; f < frames; f += tile) {
+                const size_t n = std::min(tile, frames - f);
+                float *p = data + f * channels;
+                for (size_t i = s.first; i < s.first + s.count; i++) {
+                    if (entries_[i].enabled) {
+                        entries_[i].stage->process(p, p, n, channels);
+                    }
+                }
+            }
+        }
+
+        static void run_blocks(dsp_stage &stage, const float *in, float *out, size_t frames, unsigned channels, size_t block) {
+            if (block == 0 || block >= frames) {
+                stage.process(in, out, frames, channels);
+                return;
+            }
+            const unsigned out_channels = stage.output_channels(channels);
+            for (size_t f = 0; f < frames; f += block) {
+                const size_t n = std::min(block, frames - f);
+                stage.process(in + f * channels, out + f * out_channels, n, channels);
+            }
+        }
+
+        std::vector<entry> entries_;
+        std::vector<step> steps_;
+        std::vector<float> arena_;
+        uint32_t sample_rate_ = 0;
+        unsigned channels_ = 0;
+        unsigned max_channels_ = 0;
+        unsigned output_channels_ = 0;
+        size_t max_frames_ = 0;
+        size_t latency_frames_ = 0;
+        bool prepared_ = false;
+        bool dirty_ = true;
+        bool timing_ = false;
+    };
+} // namespace utils
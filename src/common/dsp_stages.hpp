@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "dsp_graph.hpp"
+#include "sample_ops.hpp"
+
+namespace utils
+{
+    // Scrubs NaN/Inf and clamps runaway samples, see utils::sanitize
+    class sanitize_stage : public dsp_stage {
+    public:
+        const char *name() const override { return "sanitize"; }
+        bool elementwise() const override { return true; }
+
+        void process(const float *, float *out, size_t frames, unsigned channels) override {
+            touched_ += sanitize(out, frames * channels);
+        }
+
+        // Samples that had to be fixed since the stage was created
+        uint64_t touched() const { return touched_; }
+
+    private:
+        uint64_t touched_ = 0;
+    };
+
+    // Linear ramp from silence after start, seek and resume (reset())
+    class fade_in_stage : public dsp_stage {
+    public:
+        const char *name() const override { return "fade-in"; }
+        bool elementwise() const override { return true; }
+
+        // Processing thread only
+        void set_length_ms(uint32_t ms) { length_ms_ = ms; }
+
+        void prepare(uint32_t sample_rate, unsigned channels, size_t, float *) override {
+            sample_rate_ = sample_rate;
+            channels_ = channels;
+            kernel_ = fade_in_for(channels);
+        }
+        void reset() override { position_ = 0; }
+
+        void process(const float *, float *out, size_t frames, unsigned channels) override {
+            const size_t length = static_cast<size_t>(length_ms_) * sample_rate_ / 1000;
+            if (position_ < length) {
+                // The specialized kernel only fits the channel count it was picked for
+                (channels == channels_ ? kernel_ : &fade_in<0>)(out, frames, channels, position_, length);
+                position_ += frames;
+            }
+        }
+
+    private:
+        uint32_t length_ms_ = 0;
+        uint32_t sample_rate_ = 0;
+        size_t position_ = 0;
+        unsigned channels_ = 0;
+        fade_in_kernel kernel_ = &fade_in<0>;
+    };
+} // namespace utils
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cmath>
+#include <complex>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace utils
+{
+    // Windowed magnitude spectrum of a real block. Radix-2, tables built once per size, no allocation per call.
+    // Meant for visualisation: float precision, Hann window, magnitudes normalized so a full-scale sine
+    // peaks near 1.0.
+    class magnitude_fft {
+    public:
+        explicit magnitude_fft(size_t size = 1024) : size_(size), window_(size), twiddles_(size / 2), reversed_(size), work_(size) {
+            const double pi = 3.14159265358979323846;
+            double window_sum = 0;
+            for (size_t i = 0; i < size; i++) {
+                window_[i] = static_cast<float>(0.5 - 0.5 * std::cos(2 * pi * i / size));
+                window_sum += window_[i];
+            }
+            scale_ = static_cast<float>(2.0 / window_sum);
+            for (size_t i = 0; i < size / 2; i++) {
+                twiddles_[i] = std::polar(1.0f, static_cast<float>(-2 * pi * i / size));
+            }
+            unsigned bits = 0;
+            while ((size_t(1) << bits) < size) {
+                bits++;
+            }
+            for (size_t i = 0; i < size; i++) {
+                size_t r = 0;
+                for (unsigned b = 0; b < bits; b++) {
+                    r |= ((i >> b) & 1) << (bits - 1 - b);
+                }
+                reversed_[i] = static_cast<uint32_t>(r);
+            }
+        }
+
+        size_t size() const { return size_; }
+        size_t bins() const { return size_ / 2; }
+
+        // `input` holds size() samples, `magnitudes` receives bins() values
+        void compute(const float *input, float *magnitudes) {
+            for (size_t i = 0; i < size_; i++) {
+                work_[reversed_[i]] = {input[i] * window_[i], 0.0f};
+            }
+            for (size_t half = 1; half < size_; half <<= 1) {
+                const size_t stride = size_ / (half * 2);
+                for (size_t start = 0; start < size_; start += half * 2) {
+                    for (size_t k = 0; k < half; k++) {
+                        const std::complex<float> t = twiddles_[k * stride] * work_[start + k + half];
+                        work_[start + k + half] = work_[start + k] - t;
+                        work_[start + k] += t;
+                    }
+                }
+            }
+            for (size_t k = 0; k < bins(); k++) {
+                magnitudes[k] = std::abs(work_[k]) * scale_;
+            }
+        }
+
+    private:
+        size_t size_;
+        std::vector<float> window_;
+        std::vector<std::complex<float>> twiddles_;
+        std::vector<uint32_t> reversed_;
+        std::vector<std::complex<float>> work_;
+        float scale_ = 1;
+    };
+} // namespace utils
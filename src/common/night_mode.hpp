@@ -0,0 +1,576 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+#include "dsp_graph.hpp"
+#include "sample_ops.hpp"
+#include "simd.hpp"
+#include "worker_pool.hpp"
+
+namespace utils
+{
+    // Night mode strengths. Index 0 is off.
+    struct night_mode_preset {
+        const char *name;
+        float threshold_db; // per band, on the linked peak envelope
+        float ratio;
+        float makeup_db; // brings quiet passages up, applied to all bands
+    };
+
+    inline constexpr night_mode_preset night_mode_presets[] = {
+        {"off", 0, 1, 0},
+        {"light", -30, 2, 6},
+        {"strong", -36, 4, 12},
+    };
+    inline constexpr uint32_t night_mode_preset_count = sizeof(night_mode_presets) / sizeof(night_mode_presets[0]);
+
+    // Three-band compressor for late-night listening, meant to run last so it sees the final multichannel mix.
+    //
+    // Every channel is split at 200 Hz and 3 kHz with 4th-order Linkwitz-Riley crossovers (the low band also
+    // gets the upper crossover's allpass, so the bands sum back flat). One detector per band takes the peak
+    // across all channels, so the image doesn't shift when one side gets loud. The bands are delayed by a fixed
+    // look-ahead, and gain changes land before the transient that caused them; that delay is the stage's
+    // latency and is reported as such.
+    //
+    // Filters run four channels per vector, the envelope followers all three bands in one vector, and the gain
+    // curve is evaluated every `control_frames` frames and ramped in between. Mono and stereo would leave most
+    // of each vector empty, so they pack the crossover sections side by side instead (process_packed). With a
+    // pool (set_pool) the crossovers and the output mix run one channel group per task; the detector links every
+    // channel and stays on the calling thread.
+    //
+    // Under CPU overload the governor can take it down to wideband (set_wideband) and then to bypass
+    // (set_bypass); both keep the look-ahead, so the reported latency holds in every mode.
+    class night_mode_stage : public dsp_stage {
+    public:
+        static constexpr double lookahead_ms = 5;
+        static constexpr double transition_ms = 20;
+        static constexpr size_t control_frames = 16;
+        static constexpr float crossover_low_hz = 200;
+        static constexpr float crossover_high_hz = 3000;
+
+        const char *name() const override { return "night-mode"; }
+
+        // Processing thread
+        void set_preset(uint32_t preset) { preset_ = std::min(preset, night_mode_preset_count - 1); }
+        uint32_t preset() const { return preset_; }
+
+        // Cheaper fallback under CPU overload: no crossovers, one wideband detector and gain with the same
+        // curve. The look-ahead stays, so latency doesn't move when this toggles. Processing thread.
+        void set_wideband(bool on) {
+            if (on == wideband_) {
+                return;
+            }
+            wideband_ = on;
+            // Crossover history from before the switch would ring into the first frames after it
+            std::fill(state_.begin(), state_.end(), 0.0f);
+        }
+        bool wideband() const { return wideband_; }
+
+        // Last resort under CPU overload: no crossovers and no detector, the frames only pass through the look-ahead.
+        // The gains ramp to unity over `transition_ms` instead of jumping there (with makeup gain that is a level
+        // change of up to makeup_db), and ramp back to the curve's over the same time when the detector returns.
+        // Processing thread.
+        void set_bypass(bool on) {
+            if (on == bypass_) {
+                return;
+            }
+            bypass_ = on;
+            std::fill(state_.begin(), state_.end(), 0.0f);
+            if (on) {
+                for (size_t b = 0; b < bands; b++) {
+                    gain_step_[b] = (1 - gain_[b]) / static_cast<float>(std::max<size_t>(transition_frames_, 1));
+                }
+                until_unity_ = transition_frames_;
+            } else {
+                // The envelope is stale; the first update after the bypass ramps over the transition, not a control period
+                until_control_ = 0;
+                next_ramp_ = std::max(transition_frames_, control_frames);
+            }
+        }
+        bool bypass() const { return bypass_; }
+
+        size_t latency_frames() const override { return lookahead_; }
+
+        // Mono and stereo through the runtime-channel-count path as well, the reference tools/channel_bench compares
+        // the packed kernels with. Same output either way; configuration time only, the two keep their filter state
+        // differently.
+        void set_reference(bool on) { reference_ = on; }
+
+        // The look-ahead buffers scale with the sample rate, so they're allocated here rather than in the arena
+        void prepare(uint32_t sample_rate, unsigned channels, size_t, float *) override {
+            sample_rate_ = sample_rate;
+            channels_ = channels;
+            stride_ = (channels + 3) & ~3u;
+            lookahead_ = static_cast<size_t>(std::lround(lookahead_ms * sample_rate / 1000.0));
+            transition_frames_ = static_cast<size_t>(std::lround(transition_ms * sample_rate / 1000.0));
+
+            const float low = std::min<float>(crossover_low_hz, sample_rate * 0.45f);
+            const float high = std::min<float>(crossover_high_hz, sample_rate * 0.45f);
+            coefficients_[low_pass_1] = coefficients_[low_pass_2] = biquad_coefficients::make(sample_rate, low, false);
+            coefficients_[high_pass_1] = coefficients_[high_pass_2] = biquad_coefficients::make(sample_rate, low, true);
+            coefficients_[mid_pass_1] = coefficients_[mid_pass_2] = biquad_coefficients::make(sample_rate, high, false);
+            coefficients_[top_pass_1] = coefficients_[top_pass_2] = biquad_coefficients::make(sample_rate, high, true);
+            coefficients_[low_allpass] = biquad_coefficients::allpass(sample_rate, high);
+            pack(packed_split_1, coefficients_[low_pass_1], coefficients_[high_pass_1]);
+            pack(packed_split_2, coefficients_[low_pass_2], coefficients_[high_pass_2]);
+            pack(packed_allpass_mid_1, coefficients_[low_allpass], coefficients_[mid_pass_1]);
+            pack(packed_mid_2, {}, coefficients_[mid_pass_2]);
+            pack(packed_top_1, {}, coefficients_[top_pass_1]);
+            pack(packed_top_2, {}, coefficients_[top_pass_2]);
+            serial_ = dispatch_channels(channels, [](auto count) -> serial_kernel {
+                if constexpr (decltype(count)::value == 0) {
+                    return &night_mode_stage::process_serial;
+                } else {
+                    return &night_mode_stage::process_packed<decltype(count)::value>;
+                }
+            });
+
+            slots_ = lookahead_ + split_block;
+            // Sized for this format only, not the largest one seen so far
+            state_ = std::vector<float>(filters * 2 * stride_, 0.0f);
+            delay_ = std::vector<float>(slots_ * bands * stride_, 0.0f);
+            frame_ = std::vector<float>(stride_, 0.0f);
+            peaks_ = std::vector<float>((stride_ / 4) * split_block * 4, 0.0f);
+            gains_ = std::vector<float>(split_block * 4, 0.0f);
+
+            const float attack = time_coefficient(2);
+            attack_ = f32x4::splat(attack);
+            const float release[4] = {time_coefficient(200), time_coefficient(150), time_coefficient(100), 0};
+            release_ = f32x4::load(release);
+            reset();
+        }
+
+        void reset() override {
+            std::fill(state_.begin(), state_.end(), 0.0f);
+            std::fill(delay_.begin(), delay_.end(), 0.0f);
+            std::fill(std::begin(envelope_), std::end(envelope_), 0.0f);
+            std::fill(std::begin(gain_), std::end(gain_), 1.0f);
+            std::fill(std::begin(gain_step_), std::end(gain_step_), 0.0f);
+            write_ = 0;
+            until_control_ = 0;
+            next_ramp_ = control_frames;
+            until_unity_ = 0;
+        }
+
+        // Helpers for high channel counts, nullptr to run on the calling thread alone. The render chain hands its
+        // pool over for the quanta it splits. Processing thread, takes effect with the next process().
+        void set_pool(worker_pool *pool) { pool_ = pool; }
+
+        void process(const float *in, float *out, size_t frames, unsigned channels) override {
+            if (channels != channels_ || state_.empty()) {
+                if (in != out) {
+                    memcpy(out, in, frames * channels * sizeof(float));
+                }
+                return;
+            }
+            if (bypass_) {
+                process_bypass(in, out, frames, channels);
+                return;
+            }
+            if (pool_ && stride_ > 4) {
+                process_split(in, out, frames, channels);
+            } else if (wideband_ || reference_) {
+                process_serial(in, out, frames, channels);
+            } else {
+                (this->*serial_)(in, out, frames, channels);
+            }
+
+            // Filter state decaying into denormals on silence is slow on every CPU this runs on
+            for (float &s : state_) {
+                if (std::fabs(s) < 1e-15f) {
+                    s = 0;
+                }
+            }
+        }
+
+    private:
+        static constexpr size_t bands = 3;
+
+        enum filter : size_t {
+            low_pass_1,
+            low_pass_2,
+            low_allpass,
+            high_pass_1,
+            high_pass_2,
+            mid_pass_1,
+            mid_pass_2,
+            top_pass_1,
+            top_pass_2,
+            filters,
+        };
+
+        // Normalized transposed direct form II coefficients
+        struct biquad_coefficients {
+            float b0, b1, b2, a1, a2;
+
+            // Butterworth (Q = 1/sqrt(2)) half of a 4th-order Linkwitz-Riley section
+            static biquad_coefficients make(uint32_t sample_rate, float hz, bool high_pass) {
+                const double w = 2 * 3.14159265358979323846 * hz / sample_rate;
+                const double alpha = std::sin(w) / (2 * 0.70710678118654752);
+                const double c = std::cos(w);
+                const double a0 = 1 + alpha;
+                const double b1 = high_pass ? -(1 + c) : 1 - c;
+                const double b0 = high_pass ? (1 + c) / 2 : (1 - c) / 2;
+                return {static_cast<float>(b0 / a0),
+                        static_cast<float>(b1 / a0),
+                        static_cast<float>(b0 / a0),
+                        static_cast<float>(-2 * c / a0),
+                        static_cast<float>((1 - alpha) / a0)};
+            }
+
+            // What a 4th-order Linkwitz-Riley crossover at `hz` does to the phase of the summed signal
+            static biquad_coefficients allpass(uint32_t sample_rate, float hz) {
+                const double w = 2 * 3.14159265358979323846 * hz / sample_rate;
+                const double alpha = std::sin(w) / (2 * 0.70710678118654752);
+                const double c = std::cos(w);
+                const double a0 = 1 + alpha;
+                return {static_cast<float>((1 - alpha) / a0),
+                        static_cast<float>(-2 * c / a0),
+                        1.0f,
+                        static_cast<float>(-2 * c / a0),
+                        static_cast<float>((1 - alpha) / a0)};
+            }
+        };
+
+        // Sections of the packed mono/stereo path, two filters per vector (see process_packed)
+        enum packed_section : size_t {
+            packed_split_1,       // low_pass_1 | high_pass_1
+            packed_split_2,       // low_pass_2 | high_pass_2
+            packed_allpass_mid_1, // low_allpass | mid_pass_1
+            packed_mid_2,         // - | mid_pass_2
+            packed_top_1,         // - | top_pass_1
+            packed_top_2,         // - | top_pass_2
+            packed_sections,
+        };
+
+        struct packed_coefficients {
+            f32x4 b0, b1, b2, a1, a2;
+        };
+
+        using serial_kernel = void (night_mode_stage::*)(const float *, float *, size_t, unsigned);
+
+        // Frames per block on the split path; the look-ahead ring has this many slots beyond the look-ahead, so a
+        // whole block of bands can be written before any of it is read back
+        static constexpr size_t split_block = 1024;
+
+        void process_serial(const float *in, float *out, size_t frames, unsigned channels) {
+            const size_t groups = stride_ / 4;
+            f32x4 envelope = f32x4::load(envelope_);
+            for (size_t f = 0; f < frames; f++) {
+                // Padded copy so the last group of channels can be loaded whole
+                const float *frame = in + f * channels;
+                std::copy(frame, frame + channels, frame_.begin());
+
+                float *bands_in = slot(write_);
+                f32x4 peak[bands] = {f32x4::splat(0), f32x4::splat(0), f32x4::splat(0)};
+                for (size_t g = 0; g < groups; g++) {
+                    split_group(f32x4::load(&frame_[g * 4]), g, bands_in, peak);
+                }
+                float applied[4];
+                detect(hmax(peak[0]), hmax(peak[1]), hmax(peak[2]), envelope, applied);
+
+                const float *bands_out = slot(write_ + slots_ - lookahead_);
+                for (size_t g = 0; g < groups; g++) {
+                    mix_group(bands_out, g, applied).store(&frame_[g * 4]);
+                }
+                std::copy(frame_.begin(), frame_.begin() + channels, out + f * channels);
+                write_ = (write_ + 1) % slots_;
+            }
+            envelope.store(envelope_);
+        }
+
+        // Crossovers for one or two channels: each vector holds two filter sections side by side, one lane per
+        // channel for each, so the nine sections take six vectors and four dependent steps instead of nine. Lanes
+        // do exactly what process_serial() does to them, the output is the same bit for bit (tools/channel_bench).
+        template <unsigned Channels>
+        void process_packed(const float *in, float *out, size_t frames, unsigned) {
+            static_assert(Channels == 1 || Channels == 2);
+            // Filter state in locals for the whole buffer, written back at the end
+            f32x4 z[packed_sections][2];
+            for (size_t k = 0; k < packed_sections; k++) {
+                z[k][0] = f32x4::load(&state_[k * 8]);
+                z[k][1] = f32x4::load(&state_[k * 8 + 4]);
+            }
+            f32x4 envelope = f32x4::load(envelope_);
+            for (size_t f = 0; f < frames; f++) {
+                // The frame in both halves; lanes past them have zero coefficients and stay silent
+                const float *frame = in + f * Channels;
+                const f32x4 x = Channels == 2 ? f32x4::load_pairs(frame, frame) : f32x4::splat(frame[0]);
+                // low-pass | high-pass, then low band through the allpass | the high side's first mid section
+                const f32x4 split = run_packed(packed_split_2, z, run_packed(packed_split_1, z, x));
+                const f32x4 low = run_packed(packed_allpass_mid_1, z, split);
+                const f32x4 mid = run_packed(packed_mid_2, z, low);
+                const f32x4 top = run_packed(packed_top_2, z, run_packed(packed_top_1, z, split));
+                float band_lanes[bands][4];
+                low.store(band_lanes[0]);
+                mid.store(band_lanes[1]);
+                top.store(band_lanes[2]);
+
+                float *bands_in = slot(write_);
+                float level[bands] = {0, 0, 0};
+                for (unsigned c = 0; c < Channels; c++) {
+                    bands_in[c] = band_lanes[0][c];
+                    bands_in[stride_ + c] = band_lanes[1][Channels + c];
+                    bands_in[2 * stride_ + c] = band_lanes[2][Channels + c];
+                    for (size_t b = 0; b < bands; b++) {
+                        level[b] = std::max(level[b], std::fabs(bands_in[b * stride_ + c]));
+                    }
+                }
+                float applied[4];
+                detect(level[0], level[1], level[2], envelope, applied);
+
+                float mixed[4];
+                mix_group(slot(write_ + slots_ - lookahead_), 0, applied).store(mixed);
+                std::copy(mixed, mixed + Channels, out + f * Channels);
+                write_ = (write_ + 1) % slots_;
+            }
+            envelope.store(envelope_);
+            for (size_t k = 0; k < packed_sections; k++) {
+                z[k][0].store(&state_[k * 8]);
+                z[k][1].store(&state_[k * 8 + 4]);
+            }
+        }
+
+        // Same result as process_serial(), a block at a time: the helpers run the crossovers one channel group
+        // each, this thread runs the linked detector over the block, then the helpers apply its gains per group.
+        // Only the detector is serial; it reads one peak per group and band per frame.
+        void process_split(const float *in, float *out, size_t frames, unsigned channels) {
+            const size_t groups = stride_ / 4;
+            f32x4 envelope = f32x4::load(envelope_);
+            for (size_t done = 0; done < frames;) {
+                const size_t n = std::min(split_block, frames - done);
+                const float *block_in = in + done * channels;
+                float *block_out = out + done * channels;
+
+                pool_->parallel_for(groups, [&](size_t g) {
+                    for (size_t f = 0; f < n; f++) {
+                        f32x4 peak[bands] = {f32x4::splat(0), f32x4::splat(0), f32x4::splat(0)};
+                        split_group(load_group(block_in + f * channels, g, channels), g, slot(write_ + f), peak);
+                        float *p = &peaks_[(g * split_block + f) * 4];
+                        p[0] = hmax(peak[0]);
+                        p[1] = hmax(peak[1]);
+                        p[2] = hmax(peak[2]);
+                    }
+                });
+                for (size_t f = 0; f < n; f++) {
+                    float level[bands] = {0, 0, 0};
+                    for (size_t g = 0; g < groups; g++) {
+                        const float *p = &peaks_[(g * split_block + f) * 4];
+                        level[0] = std::max(level[0], p[0]);
+                        level[1] = std::max(level[1], p[1]);
+                        level[2] = std::max(level[2], p[2]);
+                    }
+                    detect(level[0], level[1], level[2], envelope, &gains_[f * 4]);
+                }
+                pool_->parallel_for(groups, [&](size_t g) {
+                    for (size_t f = 0; f < n; f++) {
+                        store_group(mix_group(slot(write_ + f + slots_ - lookahead_), g, &gains_[f * 4]),
+                                    block_out + f * channels,
+                                    g,
+                                    channels);
+                    }
+                });
+                write_ = (write_ + n) % slots_;
+                done += n;
+            }
+            envelope.store(envelope_);
+        }
+
+        // Frames into the ring as the low band and back out at the ramping gains. Until a look-ahead has passed,
+        // what comes out still has the bands from before the bypass, so all three are mixed.
+        void process_bypass(const float *in, float *out, size_t frames, unsigned channels) {
+            const size_t groups = stride_ / 4;
+            for (size_t f = 0; f < frames; f++) {
+                float *bands_in = slot(write_);
+                std::copy(in + f * channels, in + (f + 1) * channels, bands_in);
+                std::fill(bands_in + stride_, bands_in + bands * stride_, 0.0f);
+
+                float applied[bands];
+                for (size_t b = 0; b < bands; b++) {
+                    applied[b] = gain_[b];
+                }
+                if (until_unity_ > 0 && --until_unity_ == 0) {
+                    std::fill(std::begin(gain_), std::end(gain_), 1.0f);
+                    std::fill(std::begin(gain_step_), std::end(gain_step_), 0.0f);
+                } else if (until_unity_ > 0) {
+                    for (size_t b = 0; b < bands; b++) {
+                        gain_[b] += gain_step_[b];
+                    }
+                }
+
+                const float *bands_out = slot(write_ + slots_ - lookahead_);
+                for (size_t g = 0; g < groups; g++) {
+                    store_group(mix_group(bands_out, g, applied), out + f * channels, g, channels);
+                }
+                write_ = (write_ + 1) % slots_;
+            }
+        }
+
+        // Look-ahead ring slot `index` (mod the ring size): band, then channel
+        float *slot(size_t index) { return &delay_[(index % slots_) * bands * stride_]; }
+
+        // Group `g` of one interleaved frame, zero-padded past the last channel
+        static f32x4 load_group(const float *frame, size_t g, unsigned channels) {
+            if (g * 4 + 4 <= channels) {
+                return f32x4::load(frame + g * 4);
+            }
+            float padded[4] = {};
+            std::copy(frame + g * 4, frame + channels, padded);
+            return f32x4::load(padded);
+        }
+
+        static void store_group(f32x4 y, float *frame, size_t g, unsigned channels) {
+            if (g * 4 + 4 <= channels) {
+                y.store(frame + g * 4);
+                return;
+            }
+            float padded[4];
+            y.store(padded);
+            std::copy(padded, padded + (channels - g * 4), frame + g * 4);
+        }
+
+        // Crossovers for group `g` of one frame into the ring slot `bands_in` (wideband: the frame as the low
+        // band), raising the per-band peaks
+        void split_group(f32x4 x, size_t g, float *bands_in, f32x4 *peak) {
+            if (wideband_) {
+                const f32x4 zero = f32x4::splat(0);
+                x.store(bands_in + g * 4);
+                zero.store(bands_in + stride_ + g * 4);
+                zero.store(bands_in + 2 * stride_ + g * 4);
+                peak[0] = max(peak[0], abs(x));
+                return;
+            }
+            const f32x4 low = run(low_allpass, g, run(low_pass_2, g, run(low_pass_1, g, x)));
+            const f32x4 rest = run(high_pass_2, g, run(high_pass_1, g, x));
+            const f32x4 mid = run(mid_pass_2, g, run(mid_pass_1, g, rest));
+            const f32x4 top = run(top_pass_2, g, run(top_pass_1, g, rest));
+            low.store(bands_in + g * 4);
+            mid.store(bands_in + stride_ + g * 4);
+            top.store(bands_in + 2 * stride_ + g * 4);
+            peak[0] = max(peak[0], abs(low));
+            peak[1] = max(peak[1], abs(mid));
+            peak[2] = max(peak[2], abs(top));
+        }
+
+        // Linked detector for one frame: one level per band, all three followed in one vector. Writes the band
+        // gains for this frame to `applied` and moves the ramp on.
+        void detect(float low, float mid, float top, f32x4 &envelope, float *applied) {
+            const float levels[4] = {low, mid, top, 0};
+            const f32x4 level = f32x4::load(levels);
+            envelope = madd(level, select_greater(level, envelope, attack_, release_), envelope - level);
+
+            if (until_control_ == 0) {
+                envelope.store(envelope_);
+                update_gains(next_ramp_);
+                until_control_ = next_ramp_;
+                next_ramp_ = control_frames;
+            }
+            until_control_--;
+
+            // The look-ahead-delayed bands get the gains that are already on their way down
+            for (size_t b = 0; b < bands; b++) {
+                applied[b] = gain_[b];
+                gain_[b] += gain_step_[b];
+            }
+        }
+
+        f32x4 mix_group(const float *bands_out, size_t g, const float *applied) const {
+            return f32x4::load(bands_out + g * 4) * f32x4::splat(applied[0]) +
+                   f32x4::load(bands_out + stride_ + g * 4) * f32x4::splat(applied[1]) +
+                   f32x4::load(bands_out + 2 * stride_ + g * 4) * f32x4::splat(applied[2]);
+        }
+
+        // One biquad on four channels of group `g`
+        f32x4 run(filter which, size_t g, f32x4 x) {
+            const biquad_coefficients &k = coefficients_[which];
+            float *z = &state_[(which * 2 * stride_) + g * 4];
+            const f32x4 z1 = f32x4::load(z);
+            const f32x4 z2 = f32x4::load(z + stride_);
+            const f32x4 y = madd(z1, f32x4::splat(k.b0), x);
+            (madd(z2, f32x4::splat(k.b1), x) - f32x4::splat(k.a1) * y).store(z);
+            (f32x4::splat(k.b2) * x - f32x4::splat(k.a2) * y).store(z + stride_);
+            return y;
+        }
+
+        // Packed section `section`: lanes below the channel count run `first`, the next as many run `second`, the
+        // rest stay zero. Only mono and stereo use it.
+        void pack(size_t section, const biquad_coefficients &first, const biquad_coefficients &second) {
+            biquad_coefficients lanes[4] = {};
+            for (unsigned c = 0; channels_ <= 2 && c < channels_; c++) {
+                lanes[c] = first;
+                lanes[channels_ + c] = second;
+            }
+            float b0[4], b1[4], b2[4], a1[4], a2[4];
+            for (int i = 0; i < 4; i++) {
+                b0[i] = lanes[i].b0;
+                b1[i] = lanes[i].b1;
+                b2[i] = lanes[i].b2;
+                a1[i] = lanes[i].a1;
+                a2[i] = lanes[i].a2;
+            }
+            packed_[section] = {f32x4::load(b0), f32x4::load(b1), f32x4::load(b2), f32x4::load(a1), f32x4::load(a2)};
+        }
+
+        // Packed section `k` with z1/z2 in `z[k]`, same arithmetic as run(). Between buffers the state is kept at the
+        // start of `state_`, so reset and the denormal flush cover it.
+        f32x4 run_packed(size_t k, f32x4 (&z)[packed_sections][2], f32x4 x) const {
+            const packed_coefficients &p = packed_[k];
+            const f32x4 y = madd(z[k][0], p.b0, x);
+            z[k][0] = madd(z[k][1], p.b1, x) - p.a1 * y;
+            z[k][1] = p.b2 * x - p.a2 * y;
+            return y;
+        }
+
+        // Per-frame smoothing factor for a time constant in ms
+        float time_coefficient(double ms) const { return static_cast<float>(std::exp(-1000.0 / (ms * sample_rate_))); }
+
+        // Gain curve at control rate, ramped linearly over `ramp` frames until the next update
+        void update_gains(size_t ramp) {
+            const night_mode_preset &p = night_mode_presets[preset_];
+            for (size_t b = 0; b < bands; b++) {
+                float target = 1;
+                if (preset_ != 0) {
+                    const float level_db = 20 * std::log10(std::max(envelope_[b], 1e-9f));
+                    const float over = std::max(0.0f, level_db - p.threshold_db);
+                    target = std::pow(10.0f, (p.makeup_db - over * (1 - 1 / p.ratio)) / 20);
+                }
+                gain_step_[b] = (target - gain_[b]) / static_cast<float>(ramp);
+            }
+        }
+
+        uint32_t preset_ = 0;
+        uint32_t sample_rate_ = 0;
+        unsigned channels_ = 0;
+        size_t stride_ = 0; // channels rounded up to whole vectors
+        size_t lookahead_ = 0;
+
+        biquad_coefficients coefficients_[filters] = {};
+        packed_coefficients packed_[packed_sections] = {};
+        serial_kernel serial_ = &night_mode_stage::process_serial;
+        std::vector<float> state_; // z1 then z2 per filter, `stride_` lanes each
+        std::vector<float> delay_; // look-ahead ring: slot, band, channel
+        std::vector<float> frame_;
+        std::vector<float> peaks_; // split path: per group, frame and band of the current block, one run per task
+        std::vector<float> gains_; // split path: per frame and band of the current block
+        size_t slots_ = 0;
+        size_t write_ = 0;
+        worker_pool *pool_ = nullptr;
+
+        f32x4 attack_ = f32x4::splat(0);
+        f32x4 release_ = f32x4::splat(0);
+        float envelope_[4] = {};
+        float gain_[bands] = {1, 1, 1};
+        float gain_step_[bands] = {};
+        size_t until_control_ = 0;
+        size_t next_ramp_ = control_frames; // frames the next gain update ramps over
+        size_t transition_frames_ = 0;
+        size_t until_unity_ = 0; // bypass: frames left of the ramp to unity gain
+        bool wideband_ = false;
+        bool bypass_ = false;
+        bool reference_ = false;
+    };
+} // namespace utils
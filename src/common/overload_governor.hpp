@@ -0,0 +1,144 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include "realtime.hpp"
+
+namespace utils
+{
+    // Steps DSP quality down when processing keeps running over its real-time budget, and back up once there's
+    // headroom again. Fed once per quantum with the measured processing time; what each level means is up to
+    // the caller (see render_chain::quality_steps), level 0 is full quality.
+    //
+    // Levels that change nothing for the current stream (see set_available) are skipped, so every transition is
+    // an audible trade. Stepping down needs `overloaded` hot quanta within the last `window`, so one page fault
+    // doesn't cost quality. Stepping up needs `recover_s` of calm playback; when a step up is followed by overload right
+    // away, the next attempt waits twice as long, so a level that doesn't fit isn't retried every few seconds.
+    class overload_governor {
+    public:
+        struct settings {
+            double high_load = 0.8;  // share of the budget above which a quantum counts as hot
+            double low_load = 0.5;   // below this it counts as calm
+            unsigned window = 8;     // quanta looked at for stepping down
+            unsigned overloaded = 3; // hot quanta within the window that make overload sustained
+            double recover_s = 2;    // calm playback before a step up
+            double max_recover_s = 64;
+        };
+
+        overload_governor() = default;
+        explicit overload_governor(settings s) : settings_(s) {}
+
+        void set_levels(unsigned levels) {
+            max_level_ = levels ? levels - 1 : 0;
+            level_ = std::min(level_, max_level_);
+        }
+
+        // Bit i set: level i gives something up for the current stream. Levels are cumulative, so when the current
+        // one stops mattering (its stage got disabled) the governor settles on the next better level that does;
+        // that's no audible change and not counted as a transition. Level 0 is always available.
+        void set_available(uint32_t levels) {
+            available_ = levels | 1u;
+            while (!(available_ >> level_ & 1u)) {
+                level_--;
+            }
+        }
+
+        // Processing thread, once per quantum: `elapsed_ns` of work that had `c.computation_ns` to run in.
+        // Returns whether the level changed.
+        bool record(uint64_t elapsed_ns, const rt_constraint &c) {
+            if (c.computation_ns == 0) {
+                return false;
+            }
+            load_ = static_cast<double>(elapsed_ns) / static_cast<double>(c.computation_ns);
+            const bool hot = load_ > settings_.high_load;
+            history_ = (history_ << 1 | (hot ? 1u : 0u)) & window_mask();
+            since_change_s_ += c.period_ns / 1e9;
+
+            const unsigned lower = lower_quality();
+            if (hot && lower != level_ && static_cast<unsigned>(std::popcount(history_)) >= settings_.overloaded) {
+                // Straight back down after stepping up: that level doesn't fit yet, wait longer next time
+                if (stepped_up_ && since_change_s_ < recover_s_) {
+                    recover_s_ = std::min(recover_s_ * 2, settings_.max_recover_s);
+                }
+                change(lower, false);
+                return true;
+            }
+
+            calm_s_ = load_ < settings_.low_load ? calm_s_ + c.period_ns / 1e9 : 0;
+            if (level_ > 0 && calm_s_ >= recover_s_) {
+                change(higher_quality(), true);
+                return true;
+            }
+            // A level that has held up for a while has earned quick retries again
+            if (stepped_up_ && since_change_s_ >= settings_.max_recover_s) {
+                recover_s_ = settings_.recover_s;
+            }
+            return false;
+        }
+
+        // Back to full quality, e.g. when the governor is switched off
+        void reset() {
+            level_ = 0;
+            history_ = 0;
+            calm_s_ = 0;
+            since_change_s_ = 0;
+            recover_s_ = settings_.recover_s;
+            stepped_up_ = false;
+        }
+
+        unsigned level() const { return level_; }
+
+        // Last quantum's processing time over its budget
+        double load() const { return load_; }
+
+        uint64_t transitions() const { return transitions_; }
+
+    private:
+        // Next available level below / above the current quality, or the current level when there is none
+        unsigned lower_quality() const {
+            for (unsigned l = level_ + 1; l <= max_level_ && l < 32; l++) {
+                if (available_ >> l & 1u) {
+                    return l;
+                }
+            }
+            return level_;
+        }
+
+        unsigned higher_quality() const {
+            for (unsigned l = level_; l-- > 0;) {
+                if (available_ >> l & 1u) {
+                    return l;
+                }
+            }
+            return level_;
+        }
+
+        uint32_t window_mask() const {
+            const unsigned bits = std::clamp(settings_.window, 1u, 32u);
+            return bits == 32 ? ~0u : (1u << bits) - 1;
+        }
+
+        void change(unsigned level, bool up) {
+            level_ = level;
+            history_ = 0; // judge the new level on its own quanta
+            calm_s_ = 0;
+            since_change_s_ = 0;
+            stepped_up_ = up;
+            transitions_++;
+        }
+
+        settings settings_;
+        unsigned level_ = 0;
+        unsigned max_level_ = 0;
+        uint32_t available_ = ~0u;
+        uint32_t history_ = 0; // one bit per recent quantum, set when it was hot
+        double load_ = 0;
+        double calm_s_ = 0;
+        double since_change_s_ = 0;
+        double recover_s_ = settings_.recover_s;
+        bool stepped_up_ = false;
+        uint64_t transitions_ = 0;
+    };
+} // namespace utils
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cmath>
+#include <algorithm>
+
+namespace utils
+{
+    // Head orientation in degrees, same convention as AVAudio3DAngularOrientation
+    struct head_pose {
+        float yaw = 0;
+        float pitch = 0;
+        float roll = 0;
+    };
+
+    // Alpha-beta tracker per axis: smooths tracker noise, estimates angular velocity and extrapolates the pose to
+    // the moment audio rendered now reaches the ear, so the image doesn't drag behind head turns by the output
+    // latency. Cheap enough to run on every tracker sample; not thread-safe.
+    //
+    // A utility for whatever ends up applying a listener orientation: the engine has no spatial stage of its own
+    // today, AVAudioEnvironmentNode isn't in its graph. tools/pose_bench.cpp measures it.
+    class pose_predictor {
+    public:
+        struct settings {
+            float alpha = 0.6f;       // position correction, higher follows the tracker more closely
+            float beta = 0.2f;        // velocity correction, higher reacts faster to new turns but amplifies noise
+            double max_lead = 0.25;   // never extrapolate further than this (s), see predict()
+            double stale_after = 0.5; // no sample for this long (s): the head is assumed to be still
+        };
+
+        pose_predictor() = default;
+        explicit pose_predictor(const settings &s) : settings_(s) {}
+
+        void configure(const settings &s) { settings_ = s; }
+
+        // `time` in seconds on any monotonic clock, the same one later passed to predict()
+        void update(double time, const head_pose &measured) {
+            const float z[3] = {measured.yaw, measured.pitch, measured.roll};
+            const double dt = time - last_time_;
+            if (!primed_ || dt <= 0 || dt > settings_.stale_after) {
+                for (int i = 0; i < 3; i++) {
+                    angle_[i] = z[i];
+                    // A sample right after a gap says nothing about velocity, start from rest
+                    velocity_[i] = 0;
+                }
+                primed_ = true;
+                last_time_ = time;
+                return;
+            }
+            for (int i = 0; i < 3; i++) {
+                const float predicted = angle_[i] + velocity_[i] * static_cast<float>(dt);
+                const float residual = wrap(z[i] - predicted);
+                angle_[i] = wrap(predicted + settings_.alpha * residual);
+                velocity_[i] += settings_.beta * residual / static_cast<float>(dt);
+            }
+            last_time_ = time;
+        }
+
+        // Pose expected at `time` (usually now plus the output latency), extrapolated by at most `max_lead`.
+        //
+        // The cap is deliberate. Constant-velocity extrapolation only holds within one head movement, and turns
+        // last a few hundred ms: in pose_bench, leads past ~250 ms overshoot the end of a turn, and for a 1 Hz
+        // scan at 0.5 s latency the error is 127 degrees rms uncapped against 87 capped (64 for the raw sample).
+        // Only steady rotation keeps gaining. So with a large output buffer (0.5 s and more is common) the pose
+        // still lags by latency - max_lead, which residual_lag() reports; small buffers keep head tracking tight.
+        head_pose predict(double time) const {
+            if (!primed_) {
+                return {};
+            }
+            const double since = time - last_time_;
+            float lead = static_cast<float>(std::clamp(since, 0.0, settings_.max_lead));
+            if (time - last_time_ > settings_.stale_after + settings_.max_lead) {
+                lead = 0;
+            }
+            return {wrap(angle_[0] + velocity_[0] * lead),
+                    std::clamp(angle_[1] + velocity_[1] * lead, -90.0f, 90.0f),
+                    wrap(angle_[2] + velocity_[2] * lead)};
+        }
+
+        // How much of the lead to `time` predict() leaves uncovered because of the cap, in seconds
+        double residual_lag(double time) const { return primed_ ? std::max(0.0, time - last_time_ - settings_.max_lead) : 0; }
+
+        // Filtered pose at the last sample, without extrapolation
+        head_pose current() const { return {angle_[0], angle_[1], angle_[2]}; }
+
+        void reset() { primed_ = false; }
+
+    private:
+        static float wrap(float degrees) { return degrees - 360.0f * std::floor((degrees + 180.0f) / 360.0f); }
+
+        settings settings_;
+        float angle_[3] = {};
+        float velocity_[3] = {}; // degrees per second
+        double last_time_ = 0;
+        bool primed_ = false;
+    };
+} // namespace utils
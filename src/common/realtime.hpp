@@ -0,0 +1,286 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include <algorithm>
+
+#if defined(__APPLE__)
+#include <mach/mach.h>
+#include <mach/mach_time.h>
+#include <mach/thread_policy.h>
+#include <pthread.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace utils
+{
+    // Time-constraint parameters for a thread that has to turn one quantum around per period
+    struct rt_constraint {
+        uint64_t period_ns = 0;      // one quantum of audio
+        uint64_t computation_ns = 0; // CPU time we ask the scheduler for within each period
+        uint64_t constraint_ns = 0;  // the work has to be done this long after the period starts
+
+        bool valid() const { return period_ns != 0 && computation_ns != 0 && computation_ns <= constraint_ns; }
+
+        // compute_ratio: share of the period the thread is expected to need.
+        // The constraint leaves the rest of the period as slack for the renderer to pick the buffer up.
+        static rt_constraint for_quantum(size_t frames, uint32_t sample_rate, double compute_ratio = 0.25) {
+            rt_constraint c;
+            if (frames == 0 || sample_rate == 0) {
+                return c;
+            }
+            c.period_ns = static_cast<uint64_t>(frames * 1'000'000'000.0 / sample_rate);
+            c.computation_ns = std::max<uint64_t>(50'000, static_cast<uint64_t>(c.period_ns * std::clamp(compute_ratio, 0.05, 0.5)));
+            c.constraint_ns = std::max(c.computation_ns, c.period_ns * 3 / 4);
+            return c;
+        }
+    };
+
+    // Per-thread deadline accounting. Slots live in a fixed table and are only recycled, never freed, so a
+    // snapshot can be taken from any thread without locking while the audio threads keep updating their own.
+    struct rt_thread_stats {
+        // Bucket i counts quanta that took less than 2^i microseconds, the last one everything longer
+        static constexpr size_t histogram_buckets = 16;
+
+        char name[32] = {};
+        std::atomic<bool> claimed{false};
+        std::atomic<bool> in_use{false}; // published to snapshot() once name and counters are reset
+        std::atomic<bool> realtime{false}; // whether the time-constraint policy was granted
+        std::atomic<uint64_t> quanta{0};
+        std::atomic<uint64_t> misses{0};
+        std::atomic<uint64_t> worst_ns{0};
+        std::atomic<uint64_t> last_ns{0};
+        std::atomic<uint64_t> histogram[histogram_buckets] = {};
+
+        static size_t bucket_for(uint64_t elapsed_ns) {
+            return std::min<size_t>(std::bit_width(elapsed_ns / 1000), histogram_buckets - 1);
+        }
+
+        void record(uint64_t elapsed_ns, uint64_t deadline_ns) {
+            quanta.fetch_add(1, std::memory_order_relaxed);
+            histogram[bucket_for(elapsed_ns)].fetch_add(1, std::memory_order_relaxed);
+            last_ns.store(elapsed_ns, std::memory_order_relaxed);
+            if (elapsed_ns > worst_ns.load(std::memory_order_relaxed)) {
+                worst_ns.store(elapsed_ns, std::memory_order_relaxed);
+            }
+            if (deadline_ns != 0 && elapsed_ns > deadline_ns) {
+                misses.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+    };
+
+    struct rt_thread_stats_snapshot {
+        std::string name;
+        bool realtime;
+        uint64_t quanta;
+        uint64_t misses;
+        uint64_t worst_ns;
+        uint64_t last_ns;
+        std::array<uint64_t, rt_thread_stats::histogram_buckets> histogram;
+    };
+
+    class rt_stats_registry {
+    public:
+        static constexpr size_t max_threads = 32;
+
+        static rt_stats_registry &instance() {
+            static rt_stats_registry registry;
+            return registry;
+        }
+
+        // Returns nullptr once all slots are taken, callers then just skip the accounting
+        rt_thread_stats *acquire(const char *name) {
+            for (rt_thread_stats &slot : slots_) {
+                bool expected = false;
+                if (slot.claimed.load(std::memory_order_relaxed) ||
+                    !slot.claimed.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+                    continue;
+                }
+                snprintf(slot.name, sizeof(slot.name), "%s", name);
+                slot.realtime.store(false, std::memory_order_relaxed);
+                slot.quanta.store(0, std::memory_order_relaxed);
+                slot.misses.store(0, std::memory_order_relaxed);
+                slot.worst_ns.store(0, std::memory_order_relaxed);
+                slot.last_ns.store(0, std::memory_order_relaxed);
+                for (auto &bucket : slot.histogram) {
+                    bucket.store(0, std::memory_order_relaxed);
+                }
+                slot.in_use.store(true, std::memory_order_release);
+                return &slot;
+            }
+            return nullptr;
+        }
+
+        void release(rt_thread_stats *slot) {
+            if (slot) {
+                slot->in_use.store(false, std::memory_order_release);
+                slot->claimed.store(false, std::memory_order_release);
+            }
+        }
+
+        std::vector<rt_thread_stats_snapshot> snapshot() const {
+            std::vector<rt_thread_stats_snapshot> result;
+            for (const rt_thread_stats &s : slots_) {
+                if (!s.in_use.load(std::memory_order_acquire)) {
+                    continue;
+                }
+                result.push_back({s.name,
+                                  s.realtime.load(std::memory_order_relaxed),
+                                  s.quanta.load(std::memory_order_relaxed),
+                                  s.misses.load(std::memory_order_relaxed),
+                                  s.worst_ns.load(std::memory_order_relaxed),
+                                  s.last_ns.load(std::memory_order_relaxed),
+                                  {}});
+                for (size_t i = 0; i < rt_thread_stats::histogram_buckets; i++) {
+                    result.back().histogram[i] = s.histogram[i].load(std::memory_order_relaxed);
+                }
+            }
+            return result;
+        }
+
+    private:
+        rt_thread_stats slots_[max_threads];
+    };
+
+    // Latest value of a small struct, published by one thread (once per quantum) and read by any number of
+    // monitoring threads. Seqlock: the writer never waits, readers retry while a write is in progress.
+    template <typename T>
+    class snapshot_cell {
+        static_assert(std::is_trivially_copyable_v<T>, "snapshot_cell copies bytes");
+
+    public:
+        void publish(const T &value) {
+            const uint32_t seq = seq_.load(std::memory_order_relaxed);
+            seq_.store(seq + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            store_bytes(value);
+            seq_.store(seq + 2, std::memory_order_release);
+        }
+
+        // False if nothing was published yet
+        bool read(T &out) const {
+            for (;;) {
+                const uint32_t seq = seq_.load(std::memory_order_acquire);
+                if (seq & 1) {
+                    std::this_thread::yield();
+                    continue;
+                }
+                load_bytes(out);
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (seq_.load(std::memory_order_relaxed) == seq) {
+                    return seq != 0;
+                }
+            }
+        }
+
+    private:
+        static constexpr size_t words = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+        // Copied word by word through relaxed atomics, so a torn read is discarded rather than undefined
+        void store_bytes(const T &value) {
+            uint64_t buffer[words] = {};
+            memcpy(buffer, &value, sizeof(T));
+            for (size_t i = 0; i < words; i++) {
+                data_[i].store(buffer[i], std::memory_order_relaxed);
+            }
+        }
+
+        void load_bytes(T &out) const {
+            uint64_t buffer[words];
+            for (size_t i = 0; i < words; i++) {
+                buffer[i] = data_[i].load(std::memory_order_relaxed);
+            }
+            memcpy(&out, buffer, sizeof(T));
+        }
+
+        std::atomic<uint32_t> seq_{0};
+        std::atomic<uint64_t> data_[words] = {};
+    };
+
+    // Measures one quantum of work on the current thread and charges a miss when it overran the deadline
+    class deadline_scope {
+    public:
+        deadline_scope(rt_thread_stats *stats, uint64_t deadline_ns)
+            : stats_(stats), deadline_ns_(deadline_ns), start_(std::chrono::steady_clock::now()) {}
+        ~deadline_scope() {
+            if (stats_) {
+                const auto elapsed = std::chrono::steady_clock::now() - start_;
+                stats_->record(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count(), deadline_ns_);
+            }
+        }
+
+        deadline_scope(const deadline_scope &) = delete;
+        deadline_scope &operator=(const deadline_scope &) = delete;
+
+    private:
+        rt_thread_stats *stats_;
+        uint64_t deadline_ns_;
+        std::chrono::steady_clock::time_point start_;
+    };
+
+    // Put the calling thread under a time-constraint policy.
+    // macOS: Mach THREAD_TIME_CONSTRAINT_POLICY (what CoreAudio IO threads use).
+    // Linux: SCHED_DEADLINE, falling back to SCHED_FIFO. Both need privileges there, so failing is expected
+    // on unprivileged test machines; the thread then simply keeps its normal policy.
+    inline bool apply_realtime_policy(const rt_constraint &c) {
+        if (!c.valid()) {
+            return false;
+        }
+#if defined(__APPLE__)
+        mach_timebase_info_data_t timebase;
+        mach_timebase_info(&timebase);
+        const auto to_abs = [&](uint64_t ns) { return static_cast<uint32_t>(ns * timebase.denom / timebase.numer); };
+
+        thread_time_constraint_policy_data_t policy;
+        policy.period = to_abs(c.period_ns);
+        policy.computation = to_abs(c.computation_ns);
+        policy.constraint = to_abs(c.constraint_ns);
+        policy.preemptible = TRUE;
+
+        const kern_return_t kr = thread_policy_set(pthread_mach_thread_np(pthread_self()),
+                                                   THREAD_TIME_CONSTRAINT_POLICY,
+                                                   reinterpret_cast<thread_policy_t>(&policy),
+                                                   THREAD_TIME_CONSTRAINT_POLICY_COUNT);
+        return kr == KERN_SUCCESS;
+#elif defined(__linux__)
+#if defined(SYS_sched_setattr)
+        struct {
+            uint32_t size;
+            uint32_t sched_policy;
+            uint64_t sched_flags;
+            int32_t sched_nice;
+            uint32_t sched_priority;
+            uint64_t sched_runtime;
+            uint64_t sched_deadline;
+            uint64_t sched_period;
+        } attr = {};
+        attr.size = sizeof(attr);
+        attr.sched_policy = 6; // SCHED_DEADLINE
+        attr.sched_runtime = c.computation_ns;
+        attr.sched_deadline = c.constraint_ns;
+        attr.sched_period = c.period_ns;
+        if (syscall(SYS_sched_setattr, 0, &attr, 0) == 0) {
+            return true;
+        }
+#endif
+        sched_param param = {};
+        param.sched_priority = std::max(1, sched_get_priority_max(SCHED_FIFO) - 10);
+        return pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0;
+#else
+        return false;
+#endif
+    }
+} // namespace utils
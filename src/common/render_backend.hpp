@@ -0,0 +1,258 @@
+#pragma once
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <algorithm>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace utils
+{
+    // Where the output chain delivers its float frames. AVFEngine plays them on a device; offline backends
+    // take them as fast as the chain can produce and never push back.
+    class render_backend {
+    public:
+        virtual ~render_backend() = default;
+
+        // Safe to call repeatedly, like AVFEngine::setupAudioFormat
+        virtual bool setup_format(uint32_t sample_rate, unsigned channels) = 0;
+
+        // Interleaved float frames, returns how many were taken (0 while the backend is full)
+        virtual size_t feed(const float *data, size_t frames) = 0;
+
+        virtual bool ready_for_more() const = 0;
+        virtual double latency() const = 0;
+        virtual void flush() = 0;
+    };
+
+    // Writes 32-bit float WAV, switching to RF64 once the data outgrows the 4 GiB RIFF limit.
+    //
+    // Samples go straight into a memory-mapped window of the output file that slides forward in large steps,
+    // so a render is one long sequential write with no intermediate buffer. The header is written last,
+    // when the final size is known; until finish() the file ends in a zero-padded window.
+    class wav_file_backend : public render_backend {
+    public:
+        static constexpr size_t default_window_bytes = 64u << 20;
+
+        explicit wav_file_backend(std::string path, size_t window_bytes = default_window_bytes)
+            : path_(std::move(path)), window_bytes_(align_up(std::max<size_t>(window_bytes, 1), page_size())) {}
+
+        ~wav_file_backend() override { finish(); }
+
+        wav_file_backend(const wav_file_backend &) = delete;
+        wav_file_backend &operator=(const wav_file_backend &) = delete;
+
+        bool setup_format(uint32_t sample_rate, unsigned channels) override {
+            if (fd_ >= 0) {
+                // One file holds one format; a change would need a new file
+                if (sample_rate == sample_rate_ && channels == channels_) {
+                    return true;
+                }
+                return fail("format changed while rendering");
+            }
+            if (sample_rate == 0 || channels == 0) {
+                return fail("invalid format");
+            }
+            fd_ = ::open(path_.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+            if (fd_ < 0) {
+                return fail("cannot create " + path_ + ": " + strerror(errno));
+            }
+            sample_rate_ = sample_rate;
+            channels_ = channels;
+            data_bytes_ = 0;
+            return true;
+        }
+
+        size_t feed(const float *data, size_t frames) override {
+            if (fd_ < 0 || failed()) {
+                return 0;
+            }
+            const auto *src = reinterpret_cast<const uint8_t *>(data);
+            size_t remaining = frames * frame_bytes();
+            while (remaining > 0) {
+                const uint64_t position = header_bytes + data_bytes_;
+                if (!map_ || position >= map_offset_ + window_bytes_) {
+                    if (!slide_window(position)) {
+                        return 0;
+                    }
+                }
+                const size_t offset = static_cast<size_t>(position - map_offset_);
+                const size_t n = std::min(remaining, window_bytes_ - offset);
+                memcpy(map_ + offset, src, n);
+                src += n;
+                remaining -= n;
+                data_bytes_ += n;
+            }
+            return frames;
+        }
+
+        bool ready_for_more() const override { return !failed(); }
+        double latency() const override { return 0; }
+        void flush() override {}
+
+        // Unmaps, writes the final header and trims the file. Returns false if anything failed on the way.
+        bool finish() {
+            if (fd_ < 0) {
+                return !failed();
+            }
+            unmap();
+            write_header();
+            if (ftruncate(fd_, static_cast<off_t>(header_bytes + data_bytes_)) != 0) {
+                fail(std::string("cannot trim output: ") + strerror(errno));
+            }
+            ::close(fd_);
+            fd_ = -1;
+            return !failed();
+        }
+
+        uint64_t frames_written() const { return frame_bytes() ? data_bytes_ / frame_bytes() : 0; }
+        bool failed() const { return !error_.empty(); }
+        const std::string &error() const { return error_; }
+
+    private:
+        // RIFF/RF64 (12) + JUNK/ds64 (8 + 28) + fmt WAVE_FORMAT_EXTENSIBLE (8 + 40) + data header (8)
+        static constexpr uint64_t header_bytes = 104;
+
+        static size_t page_size() { return static_cast<size_t>(sysconf(_SC_PAGESIZE)); }
+        static uint64_t align_up(uint64_t v, uint64_t a) { return (v + a - 1) / a * a; }
+
+        size_t frame_bytes() const { return static_cast<size_t>(channels_) * sizeof(float); }
+
+        bool fail(std::string message) {
+            if (error_.empty()) {
+                error_ = std::move(message);
+            }
+            return false;
+        }
+
+        void unmap() {
+            if (map_) {
+                munmap(map_, window_bytes_);
+                map_ = nullptr;
+            }
+        }
+
+        // Map the window holding `position`, growing the file ahead of it
+        bool slide_window(uint64_t position) {
+            unmap();
+            map_offset_ = position / page_size() * page_size();
+#if defined(__linux__)
+            // Reserve real blocks so running out of disk is an error here rather than a SIGBUS in memcpy
+            const int err = posix_fallocate(fd_, static_cast<off_t>(map_offset_), static_cast<off_t>(window_bytes_));
+            if (err != 0) {
+                return fail(std::string("cannot grow output: ") + strerror(err));
+            }
+#else
+            if (ftruncate(fd_, static_cast<off_t>(map_offset_ + window_bytes_)) != 0) {
+                return fail(std::string("cannot grow output: ") + strerror(errno));
+            }
+#endif
+            void *p = mmap(nullptr, window_bytes_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, static_cast<off_t>(map_offset_));
+            if (p == MAP_FAILED) {
+                return fail(std::string("cannot map output: ") + strerror(errno));
+            }
+            map_ = static_cast<uint8_t *>(p);
+            madvise(map_, window_bytes_, MADV_SEQUENTIAL);
+            return true;
+        }
+
+        static void put16(uint8_t *&p, uint16_t v) {
+            p[0] = static_cast<uint8_t>(v);
+            p[1] = static_cast<uint8_t>(v >> 8);
+            p += 2;
+        }
+        static void put32(uint8_t *&p, uint32_t v) {
+            put16(p, static_cast<uint16_t>(v));
+            put16(p, static_cast<uint16_t>(v >> 16));
+        }
+        static void put64(uint8_t *&p, uint64_t v) {
+            put32(p, static_cast<uint32_t>(v));
+            put32(p, static_cast<uint32_t>(v >> 32));
+        }
+        static void put_tag(uint8_t *&p, const char *tag) {
+            memcpy(p, tag, 4);
+            p += 4;
+        }
+
+        uint32_t channel_mask() const {
+            switch (channels_) {
+            case 1:
+                return 0x4; // FC
+            case 2:
+                return 0x3; // FL FR
+            case 4:
+                return 0x33; // FL FR BL BR
+            case 6:
+                return 0x3F; // 5.1
+            case 8:
+                return 0x63F; // 7.1
+            default:
+                return 0; // let the reader decide
+            }
+        }
+
+        void write_header() {
+            const uint64_t riff_bytes = header_bytes - 8 + data_bytes_;
+            const bool rf64 = riff_bytes > 0xFFFFFFFFull;
+
+            uint8_t header[header_bytes] = {};
+            uint8_t *p = header;
+            put_tag(p, rf64 ? "RF64" : "RIFF");
+            put32(p, rf64 ? 0xFFFFFFFFu : static_cast<uint32_t>(riff_bytes));
+            put_tag(p, "WAVE");
+
+            // Placeholder in plain WAV, real 64-bit sizes in RF64
+            put_tag(p, rf64 ? "ds64" : "JUNK");
+            put32(p, 28);
+            if (rf64) {
+                put64(p, riff_bytes);
+                put64(p, data_bytes_);
+                put64(p, frames_written());
+                put32(p, 0); // no table
+            } else {
+                p += 28;
+            }
+
+            put_tag(p, "fmt ");
+            put32(p, 40);
+            put16(p, 0xFFFE); // WAVE_FORMAT_EXTENSIBLE
+            put16(p, static_cast<uint16_t>(channels_));
+            put32(p, sample_rate_);
+            put32(p, static_cast<uint32_t>(sample_rate_ * frame_bytes()));
+            put16(p, static_cast<uint16_t>(frame_bytes()));
+            put16(p, 32);
+            put16(p, 22);
+            put16(p, 32); // valid bits
+            put32(p, channel_mask());
+            // KSDATAFORMAT_SUBTYPE_IEEE_FLOAT
+            static constexpr uint8_t subtype[16] = {
+                0x03, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x80, 0x00, 0x00, 0xAA, 0x00, 0x38, 0x9B, 0x71};
+            memcpy(p, subtype, sizeof(subtype));
+            p += sizeof(subtype);
+
+            put_tag(p, "data");
+            put32(p, rf64 ? 0xFFFFFFFFu : static_cast<uint32_t>(data_bytes_));
+
+            if (pwrite(fd_, header, sizeof(header), 0) != static_cast<ssize_t>(sizeof(header))) {
+                fail(std::string("cannot write header: ") + strerror(errno));
+            }
+        }
+
+        std::string path_;
+        size_t window_bytes_;
+        int fd_ = -1;
+        uint8_t *map_ = nullptr;
+        uint64_t map_offset_ = 0;
+        uint64_t data_bytes_ = 0;
+        uint32_t sample_rate_ = 0;
+        unsigned channels_ = 0;
+        std::string error_;
+    };
+} // namespace utils
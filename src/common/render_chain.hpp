@@ -0,0 +1,240 @@
+#pragma once
+
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <algorithm>
+#include "crossfeed.hpp"
+#include "dsp_graph.hpp"
+#include "dsp_stages.hpp"
+#include "night_mode.hpp"
+#include "sample_ops.hpp"
+#include "tuning.hpp"
+#include "worker_pool.hpp"
+
+namespace utils
+{
+    // Everything that happens to a chunk between the decoder and the backend: conversion to float (split across
+    // helpers for very high channel counts), then the DSP graph (sanitizer, fade-in and whatever else gets
+    // added). Shared by the component and the offline renderer so both produce the same samples.
+    class render_chain {
+    public:
+        render_chain() {
+            sanitize_index_ = graph_.add(sanitizer_);
+            graph_.add(fader_);
+            crossfeed_index_ = graph_.add(crossfeed_, false);
+            night_mode_index_ = graph_.add(night_mode_, false); // last, it should see the final mix
+        }
+
+        // What the overload governor gives up, in order; index = quality level, 0 is full quality
+        static constexpr const char *quality_steps[] = {
+            "full",
+            "wideband night mode", // crossovers off, one detector; dynamics stay, spectral balance may pump
+            "no crossfeed",
+            "night mode bypassed", // look-ahead only, gains ramp to unity: no dynamics, latency unchanged
+        };
+        static constexpr unsigned quality_levels = sizeof(quality_steps) / sizeof(quality_steps[0]);
+
+        // Processing thread, takes effect with the next process()
+        void set_quality(unsigned level) { quality_ = std::min(level, quality_levels - 1); }
+        unsigned quality() const { return quality_; }
+
+        // Quality levels that give something up for the stream of the last process(), bit i for level i: wideband
+        // and bypass only matter with night mode on, dropping crossfeed only where crossfeed would run. For the
+        // governor.
+        uint32_t available_quality() const {
+            return 1u | (night_mode_wanted_ ? 1u << 1 | 1u << 3 : 0) | (crossfeed_wanted_ ? 1u << 2 : 0);
+        }
+
+        // Whatever comes after the chain spatializes stereo (system spatial audio): crossfeed would be applied twice
+        void set_downstream_spatialization(bool stereo) { downstream_spatial_ = stereo; }
+
+        // Further stages, configuration time only
+        dsp_graph &graph() { return graph_; }
+
+        // Per-stage processing time per quantum (see dsp_graph::set_timing); processing thread only
+        void set_stage_timing(bool on) { graph_.set_timing(on); }
+        size_t stage_count() const { return graph_.size(); }
+        const stage_timing &timing(size_t index) const { return graph_.timing(index); }
+
+        // Call before process(); only allocates when the format changes or a quantum outgrows the arena.
+        // Returns the number of floats the output buffer needs.
+        size_t prepare(uint32_t sample_rate, unsigned channels, size_t frames) {
+            if (!graph_.prepared_for(sample_rate, channels, frames)) {
+                graph_.prepare(sample_rate, channels, std::bit_ceil(std::max<size_t>(frames, 4096)));
+            }
+            return frames * graph_.max_channels();
+        }
+
+        // Converts and processes one interleaved quantum into `output`, returns the output channel count
+        template <typename Sample>
+        unsigned process(const Sample *input,
+                         float *output,
+                         unsigned channels,
+                         size_t frames,
+                         uint32_t sample_rate,
+                         const engine_tuning &t) {
+            release_helpers_if_requested();
+            graph_.set_enabled(sanitize_index_, t.sanitize);
+            fader_->set_length_ms(t.fade_in_ms);
+            crossfeed_wanted_ = t.crossfeed != 0 && channels == 2 && !downstream_spatial_;
+            crossfeed_->set_preset(t.crossfeed);
+            graph_.set_enabled(crossfeed_index_, crossfeed_wanted_ && quality_ < 2);
+            night_mode_wanted_ = t.night_mode != 0;
+            night_mode_->set_preset(t.night_mode);
+            night_mode_->set_wideband(quality_ >= 1);
+            night_mode_->set_bypass(quality_ >= 3);
+            graph_.set_enabled(night_mode_index_, night_mode_wanted_);
+            if (splits(channels, frames, t)) {
+                // Night mode's crossovers and mix go to the helpers too, one channel group per task
+                night_mode_->set_pool(&helpers(frames, sample_rate, t));
+                convert(input, output, channels, frames, sample_rate, t);
+                const unsigned out_channels = graph_.process(output, frames);
+                graph_.finish_quantum();
+                return out_channels;
+            }
+
+            // Strip-mine big chunks: convert and run the graph one cache-sized tile at a time, so each stage reads
+            // what the previous one just wrote from L2 instead of streaming the whole chunk through memory again.
+            // Tiles land packed at the output channel count; each one only needs room up to the next tile's start
+            // plus its own max_channels() width, which the caller's buffer has.
+            night_mode_->set_pool(nullptr);
+            const unsigned out_channels = graph_.output_channels();
+            const size_t tile = tile_frames<Sample>(channels);
+            for (size_t f = 0; f < frames; f += tile) {
+                const size_t n = std::min(tile, frames - f);
+                float *io = output + f * out_channels;
+                convert_samples(input + f * channels, io, n * channels, t.conversion);
+                graph_.process(io, n);
+            }
+            graph_.finish_quantum();
+            return out_channels;
+        }
+
+        // Start, seek and resume begin a new fade and clear filter history
+        void restart() { graph_.reset(); }
+
+        double latency_seconds() { return graph_.latency_seconds(); }
+
+        // Look-ahead of the stages that ran on the last quantum: output lags input by this many frames
+        size_t latency_frames() { return graph_.latency_frames(); }
+
+        // Whether the samples coming out are exactly the converted input, i.e. worth a bit-perfect check.
+        // The sanitizer only touches samples that are broken anyway, so it doesn't count.
+        bool bit_transparent(const engine_tuning &t) {
+            return t.fade_in_ms == 0 && !graph_.is_enabled(crossfeed_index_) && graph_.latency_frames() == 0;
+        }
+
+        // Whether crossfeed ran on the last quantum
+        bool crossfeed_active() const { return graph_.is_enabled(crossfeed_index_); }
+
+        // Drop helper threads, they are rebuilt on the next chunk that needs them. Processing thread only.
+        void release_helpers() {
+            release_requested_.store(false, std::memory_order_relaxed);
+            night_mode_->set_pool(nullptr);
+            pool_.reset();
+        }
+
+        // Any thread (the engine's idle reclaim): ask the processing thread to drop the helpers the next time it
+        // calls release_helpers_if_requested() or process(), so the quantum path never takes a lock for it
+        void request_release() { release_requested_.store(true, std::memory_order_release); }
+
+        // Helper threads to start, 0 for worker_pool::default_worker_count(); applies from the next time the
+        // helpers are started (scaling runs in tools/pool_bench). Processing thread only.
+        void set_helper_count(unsigned count) {
+            helper_count_ = count;
+            release_helpers();
+        }
+
+        // Processing thread, also while paused (the output's update()). Returns whether helpers were dropped.
+        bool release_helpers_if_requested() {
+            // Plain load first, the flag is checked every quantum and almost never set
+            if (!release_requested_.load(std::memory_order_relaxed)) {
+                return false;
+            }
+            if (!release_requested_.exchange(false, std::memory_order_acquire)) {
+                return false;
+            }
+            const bool had_pool = pool_ != nullptr;
+            night_mode_->set_pool(nullptr);
+            pool_.reset();
+            return had_pool;
+        }
+
+    private:
+        // Source plus float working set per tile, about half a typical L2 so the arena's ping-pong half fits too
+        static constexpr size_t tile_bytes = 128 * 1024;
+
+        template <typename Sample>
+        size_t tile_frames(unsigned channels) const {
+            return std::max<size_t>(256, tile_bytes / (channels * sizeof(Sample) + graph_.max_channels() * sizeof(float)));
+        }
+
+        // Whether conversion goes to the helpers; then the chunk is converted whole and tiling would only serialize it
+        bool splits(unsigned channels, size_t frames, const engine_tuning &t) const {
+            return t.power != engine_tuning::power_mode::energy && parallel_policy_.should_split(channels, frames);
+        }
+
+        template <typename Sample>
+        static void convert_samples(const Sample *input, float *output, size_t count, engine_tuning::conversion_mode mode) {
+            if (mode == engine_tuning::conversion_mode::scalar) {
+                scalar_convert(input, output, count);
+            } else {
+                simd_convert(input, output, count);
+            }
+        }
+
+        template <typename Sample>
+        void convert(const Sample *input, float *output, unsigned channels, size_t frames, uint32_t sample_rate, const engine_tuning &t) {
+            // Energy saving never wakes helper threads
+            if (!splits(channels, frames, t)) {
+                convert_samples(input, output, frames * channels, t.conversion);
+                return;
+            }
+
+            worker_pool &pool = helpers(frames, sample_rate, t);
+            size_t per_task = parallel_policy_.frames_per_task(channels, frames, pool.concurrency());
+            if (t.split_frames) {
+                per_task = std::min<size_t>(per_task, t.split_frames);
+            }
+            const size_t tasks = (frames + per_task - 1) / per_task;
+            pool.parallel_for(tasks, [&](size_t task) {
+                const size_t first = task * per_task;
+                const size_t count = std::min(per_task, frames - first);
+                convert_samples(input + first * channels, output + first * channels, count * channels, t.conversion);
+            });
+        }
+
+        // The helpers, started on first use. split_frames caps the conversion task size and is the period the
+        // helpers are scheduled for. It only matters here: the chain itself always takes the chunk it is given,
+        // tiled for cache (see process()).
+        worker_pool &helpers(size_t frames, uint32_t sample_rate, const engine_tuning &t) {
+            if (!pool_) {
+                pool_ = std::make_unique<worker_pool>(helper_count_ ? helper_count_ : worker_pool::default_worker_count());
+            }
+            pool_->set_realtime(rt_constraint::for_quantum(t.split_frames ? t.split_frames : frames, sample_rate));
+            return *pool_;
+        }
+
+        // Helpers for very high channel counts (HOA, Atmos-like beds), spawned on first use
+        std::unique_ptr<worker_pool> pool_;
+        unsigned helper_count_ = 0;
+        std::atomic<bool> release_requested_{false}; // set by request_release(), the processing thread acts on it
+        parallel_cost_model parallel_policy_;
+
+        dsp_graph graph_;
+        std::shared_ptr<sanitize_stage> sanitizer_ = std::make_shared<sanitize_stage>();
+        std::shared_ptr<fade_in_stage> fader_ = std::make_shared<fade_in_stage>();
+        std::shared_ptr<crossfeed_stage> crossfeed_ = std::make_shared<crossfeed_stage>();
+        std::shared_ptr<night_mode_stage> night_mode_ = std::make_shared<night_mode_stage>();
+        size_t sanitize_index_ = 0;
+        size_t crossfeed_index_ = 0;
+        size_t night_mode_index_ = 0;
+        bool downstream_spatial_ = false;
+        bool crossfeed_wanted_ = false;
+        bool night_mode_wanted_ = false;
+        unsigned quality_ = 0;
+    };
+} // namespace utils
@@ -0,0 +1,186 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include <sys/resource.h>
+#include <sys/time.h>
+
+#if defined(__APPLE__)
+#include <mach/mach.h>
+#include <malloc/malloc.h>
+#elif defined(__linux__)
+#include <malloc.h>
+#include <unistd.h>
+#endif
+
+namespace utils
+{
+    // One reading of the process resources we care about for long-running playback
+    struct resource_sample {
+        double seconds = 0;           // since the monitor started
+        double cpu_seconds = 0;       // user + system
+        uint64_t rss_bytes = 0;       // resident memory
+        uint64_t alloc_blocks = 0;    // live heap allocations
+        uint64_t wakeups = 0;         // idle/interrupt wakeups (macOS) or context switches (Linux)
+        uint64_t pool_high_water = 0; // largest engine queue seen so far, in buffers
+        double queued_seconds = 0;    // audio waiting for the renderer when sampled
+
+        static resource_sample take() {
+            resource_sample s;
+
+            rusage usage = {};
+            getrusage(RUSAGE_SELF, &usage);
+            s.cpu_seconds = usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+
+#if defined(__APPLE__)
+            mach_task_basic_info_data_t basic = {};
+            mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+            if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, reinterpret_cast<task_info_t>(&basic), &count) == KERN_SUCCESS) {
+                s.rss_bytes = basic.resident_size;
+            }
+
+            task_power_info_data_t power = {};
+            count = TASK_POWER_INFO_COUNT;
+            if (task_info(mach_task_self(), TASK_POWER_INFO, reinterpret_cast<task_info_t>(&power), &count) == KERN_SUCCESS) {
+                s.wakeups = power.task_interrupt_wakeups + power.task_platform_idle_wakeups;
+            }
+
+            malloc_statistics_t heap = {};
+            malloc_zone_statistics(nullptr, &heap);
+            s.alloc_blocks = heap.blocks_in_use;
+#elif defined(__linux__)
+            if (FILE *f = fopen("/proc/self/statm", "r")) {
+                unsigned long pages_total = 0, pages_resident = 0;
+                if (fscanf(f, "%lu %lu", &pages_total, &pages_resident) == 2) {
+                    s.rss_bytes = static_cast<uint64_t>(pages_resident) * sysconf(_SC_PAGESIZE);
+                }
+                fclose(f);
+            }
+            s.wakeups = usage.ru_nvcsw + usage.ru_nivcsw;
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+            // glibc doesn't count blocks, allocated bytes are the closest proxy
+            s.alloc_blocks = mallinfo2().uordblks;
+#endif
+#endif
+            return s;
+        }
+    };
+
+    // Collects samples over a long run and flags anything that keeps growing.
+    //
+    // Growth is judged from the least-squares slope over the second half of the run, so start-up allocations
+    // and caches that fill once don't count, while a leak of a few bytes per track still does.
+    class resource_monitor {
+    public:
+        struct limits {
+            double rss_bytes_per_hour = 4.0 * 1024 * 1024;
+#if defined(__APPLE__)
+            double alloc_blocks_per_hour = 1000;
+#else
+            double alloc_blocks_per_hour = 8192; // bytes with glibc: a few blocks, rounded up to malloc's size classes
+#endif
+            double cpu_seconds_per_hour = 60; // one minute of CPU per hour of playback
+            // Below the engine's hard cap of 64 buffers: a queue that only stops at the cap has run away
+            uint64_t pool_high_water = 48;
+            double queued_seconds_per_hour = 0.05;
+            double max_queued_seconds = 0; // 0: unchecked, otherwise the target buffer plus one chunk
+        };
+
+        // time_scale: how many seconds of content pass per wall-clock second (1 for real playback)
+        explicit resource_monitor(double time_scale = 1.0) : time_scale_(time_scale), start_(std::chrono::steady_clock::now()) {
+            baseline_ = resource_sample::take();
+        }
+
+        void sample(uint64_t pool_high_water, double queued_seconds) {
+            resource_sample s = resource_sample::take();
+            s.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count() * time_scale_;
+            s.cpu_seconds -= baseline_.cpu_seconds;
+            s.wakeups -= std::min(s.wakeups, baseline_.wakeups);
+            s.pool_high_water = pool_high_water;
+            s.queued_seconds = queued_seconds;
+            samples_.push_back(s);
+        }
+
+        const std::vector<resource_sample> &samples() const { return samples_; }
+
+        // Empty when the run looks healthy, otherwise one line per problem
+        std::vector<std::string> verdict(const limits &l) const {
+            std::vector<std::string> problems;
+            if (samples_.size() < 8) {
+                return problems;
+            }
+            const auto tail = std::vector<resource_sample>(samples_.begin() + samples_.size() / 2, samples_.end());
+            const auto check = [&](const char *what, double per_hour, double limit) {
+                if (per_hour > limit) {
+                    char line[160];
+                    snprintf(line, sizeof(line), "%s grows by %.1f/h (limit %.1f/h)", what, per_hour, limit);
+                    problems.emplace_back(line);
+                }
+            };
+            check("RSS bytes", slope_per_hour(tail, [](const resource_sample &s) { return double(s.rss_bytes); }), l.rss_bytes_per_hour);
+            check("heap allocations",
+                  slope_per_hour(tail, [](const resource_sample &s) { return double(s.alloc_blocks); }),
+                  l.alloc_blocks_per_hour);
+            check("queued seconds",
+                  slope_per_hour(tail, [](const resource_sample &s) { return s.queued_seconds; }),
+                  l.queued_seconds_per_hour);
+            check("CPU seconds", cpu_seconds_per_hour(), l.cpu_seconds_per_hour);
+            const auto deepest = std::max_element(samples_.begin(), samples_.end(), [](const resource_sample &a, const resource_sample &b) {
+                return a.queued_seconds < b.queued_seconds;
+            });
+            if (l.max_queued_seconds > 0 && deepest->queued_seconds > l.max_queued_seconds) {
+                char line[160];
+                snprintf(line, sizeof(line), "%.3f s queued at %.2f h exceeds %.3f s", deepest->queued_seconds, deepest->seconds / 3600.0,
+                         l.max_queued_seconds);
+                problems.emplace_back(line);
+            }
+            if (samples_.back().pool_high_water > l.pool_high_water) {
+                char line[160];
+                snprintf(line, sizeof(line), "pool high-water %llu exceeds %llu", (unsigned long long)samples_.back().pool_high_water,
+                         (unsigned long long)l.pool_high_water);
+                problems.emplace_back(line);
+            }
+            return problems;
+        }
+
+        double cpu_seconds_per_hour() const {
+            if (samples_.empty() || samples_.back().seconds <= 0) {
+                return 0;
+            }
+            return samples_.back().cpu_seconds / samples_.back().seconds * 3600.0;
+        }
+
+        double wakeups_per_second() const {
+            if (samples_.empty() || samples_.back().seconds <= 0) {
+                return 0;
+            }
+            return samples_.back().wakeups / (samples_.back().seconds / time_scale_);
+        }
+
+    private:
+        template <typename Get>
+        static double slope_per_hour(const std::vector<resource_sample> &v, Get get) {
+            double sx = 0, sy = 0, sxx = 0, sxy = 0;
+            for (const auto &s : v) {
+                const double x = s.seconds / 3600.0, y = get(s);
+                sx += x;
+                sy += y;
+                sxx += x * x;
+                sxy += x * y;
+            }
+            const double n = static_cast<double>(v.size());
+            const double denom = n * sxx - sx * sx;
+            return denom > 0 ? (n * sxy - sx * sy) / denom : 0;
+        }
+
+        double time_scale_;
+        std::chrono::steady_clock::time_point start_;
+        resource_sample baseline_;
+        std::vector<resource_sample> samples_;
+    };
+} // namespace utils
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <type_traits>
+
+#if defined(__aarch64__) || defined(__arm64ec__)
+#include <arm_neon.h>
+#elif defined(__SSE2__) || defined(__x86_64__)
+#include <emmintrin.h>
+#endif
+
+// Sample-level building blocks of the output chain. Kept free of the foobar2000 SDK so offline tools can
+// run the very same code as the component.
+namespace utils
+{
+#if defined(__aarch64__) || defined(__arm64ec__)
+    inline void neon_convert(const double *input, float *output, size_t count) {
+        const double *src = input;
+        float *dst = output;
+        size_t n = count / 16;
+        while (n--) {
+            float64x2_t d1 = vld1q_f64(src);
+            float64x2_t d2 = vld1q_f64(src + 2);
+            float64x2_t d3 = vld1q_f64(src + 4);
+            float64x2_t d4 = vld1q_f64(src + 6);
+            float64x2_t d5 = vld1q_f64(src + 8);
+            float64x2_t d6 = vld1q_f64(src + 10);
+            float64x2_t d7 = vld1q_f64(src + 12);
+            float64x2_t d8 = vld1q_f64(src + 14);
+            src += 16;
+
+            vst1q_f32(dst, vcombine_f32(vcvt_f32_f64(d1), vcvt_f32_f64(d2)));
+            vst1q_f32(dst + 4, vcombine_f32(vcvt_f32_f64(d3), vcvt_f32_f64(d4)));
+            vst1q_f32(dst + 8, vcombine_f32(vcvt_f32_f64(d5), vcvt_f32_f64(d6)));
+            vst1q_f32(dst + 12, vcombine_f32(vcvt_f32_f64(d7), vcvt_f32_f64(d8)));
+            dst += 16;
+        }
+
+        size_t remaining = count % 16;
+        for (size_t i = 0; i < remaining; i++) {
+            dst[i] = (float)src[i];
+        }
+    }
+    inline void neon_convert(const float *input, float *output, size_t count) {
+        memcpy(output, input, count * sizeof(float));
+    }
+#endif
+
+    inline void scalar_convert(const double *input, float *output, size_t count) {
+        for (size_t i = 0; i < count; i++) {
+            output[i] = static_cast<float>(input[i]);
+        }
+    }
+    inline void scalar_convert(const float *input, float *output, size_t count) {
+        for (size_t i = 0; i < count; i++) {
+            output[i] = input[i];
+        }
+    }
+
+    // Widest conversion available on this target
+    inline void simd_convert(const double *input, float *output, size_t count) {
+#if defined(__aarch64__) || defined(__arm64ec__)
+        neon_convert(input, output, count);
+#elif defined(__SSE2__) || defined(__x86_64__)
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4) {
+            const __m128 lo = _mm_cvtpd_ps(_mm_loadu_pd(input + i));
+            const __m128 hi = _mm_cvtpd_ps(_mm_loadu_pd(input + i + 2));
+            _mm_storeu_ps(output + i, _mm_movelh_ps(lo, hi));
+        }
+        scalar_convert(input + i, output + i, count - i);
+#else
+        scalar_convert(input, output, count);
+#endif
+    }
+    inline void simd_convert(const float *input, float *output, size_t count) {
+        memcpy(output, input, count * sizeof(float));
+    }
+
+    // Replace NaN/Inf with silence and clamp runaway samples (beyond +18 dBFS by default).
+    // Returns how many samples had to be touched, normal material passes through bit-exact.
+    inline size_t sanitize(float *data, size_t count, float limit = 8.0f) {
+        size_t touched = 0;
+        for (size_t i = 0; i < count; i++) {
+            const float v = data[i];
+            if (!(std::fabs(v) <= limit)) { // also true for NaN
+                data[i] = std::isnan(v) ? 0.0f : std::copysign(limit, v);
+                touched++;
+            }
+        }
+        return touched;
+    }
+
+    // Mono and stereo are nearly all of the traffic, so per-frame kernels are templated on the channel count:
+    // 1 and 2 get their own instantiation with the inner loop unrolled away, 0 is the runtime-count fallback.
+    // Pick the kernel once per format change, not per call.
+    template <unsigned Channels>
+    using channel_count = std::integral_constant<unsigned, Channels>;
+
+    // Calls fn(channel_count<N>{}) with N = channels for the specialized counts, 0 otherwise
+    template <typename Fn>
+    decltype(auto) dispatch_channels(unsigned channels, Fn &&fn) {
+        switch (channels) {
+        case 1:
+            return fn(channel_count<1>{});
+        case 2:
+            return fn(channel_count<2>{});
+        default:
+            return fn(channel_count<0>{});
+        }
+    }
+
+    // Linear fade-in over `length` frames, `position` is where this buffer starts within the ramp
+    template <unsigned Channels>
+    void fade_in(float *data, size_t frames, unsigned channels, size_t position, size_t length) {
+        const unsigned n = Channels ? Channels : channels;
+        const size_t ramp = position < length ? std::min(frames, length - position) : 0;
+        const float step = 1.0f / static_cast<float>(length);
+        for (size_t f = 0; f < ramp; f++) {
+            const float gain = static_cast<float>(position + f) * step;
+            for (unsigned c = 0; c < n; c++) {
+                data[f * n + c] *= gain;
+            }
+        }
+    }
+
+    using fade_in_kernel = void (*)(float *, size_t, unsigned, size_t, size_t);
+
+    inline fade_in_kernel fade_in_for(unsigned channels) {
+        return dispatch_channels(channels, [](auto count) -> fade_in_kernel { return &fade_in<decltype(count)::value>; });
+    }
+
+    inline void fade_in(float *data, size_t frames, unsigned channels, size_t position, size_t length) {
+        fade_in_for(channels)(data, frames, channels, position, length);
+    }
+} // namespace utils
@@ -0,0 +1,545 @@
+#pragma once
+
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <thread>
+#include <utility>
+#include <algorithm>
+#include "render_backend.hpp"
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#elif defined(__APPLE__) && __has_include(<os/os_sync_wait_on_address.h>)
+#include <os/os_sync_wait_on_address.h>
+#define SHM_RING_OS_SYNC 1
+#endif
+
+namespace utils
+{
+    // Cross-process wait/wake on a 32-bit word inside the shared segment.
+    // Linux: shared futex. macOS 14.4+: os_sync_wait_on_address. Older macOS falls back to short sleeps.
+    inline void shm_wait(std::atomic<uint32_t> &word, uint32_t expected, uint64_t timeout_ns) {
+#if defined(__linux__)
+        timespec ts = {static_cast<time_t>(timeout_ns / 1'000'000'000), static_cast<long>(timeout_ns % 1'000'000'000)};
+        syscall(SYS_futex, reinterpret_cast<uint32_t *>(&word), FUTEX_WAIT, expected, &ts, nullptr, 0);
+#else
+#if defined(SHM_RING_OS_SYNC)
+        if (__builtin_available(macOS 14.4, *)) {
+            os_sync_wait_on_address_with_timeout(
+                &word, expected, sizeof(uint32_t), OS_SYNC_WAIT_ON_ADDRESS_SHARED, OS_CLOCK_MACH_ABSOLUTE_TIME, timeout_ns);
+            return;
+        }
+#endif
+        if (word.load(std::memory_order_acquire) == expected) {
+            std::this_thread::sleep_for(std::chrono::nanoseconds(std::min<uint64_t>(timeout_ns, 1'000'000)));
+        }
+#endif
+    }
+
+    inline void shm_wake_all(std::atomic<uint32_t> &word) {
+#if defined(__linux__)
+        syscall(SYS_futex, reinterpret_cast<uint32_t *>(&word), FUTEX_WAKE, INT32_MAX, nullptr, nullptr, 0);
+#elif defined(SHM_RING_OS_SYNC)
+        if (__builtin_available(macOS 14.4, *)) {
+            os_sync_wake_by_address_all(&word, sizeof(uint32_t), OS_SYNC_WAKE_BY_ADDRESS_SHARED);
+        }
+#else
+        (void)word;
+#endif
+    }
+
+    inline uint64_t shm_clock_ns() {
+        timespec ts = {};
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return static_cast<uint64_t>(ts.tv_sec) * 1'000'000'000 + static_cast<uint64_t>(ts.tv_nsec);
+    }
+
+    // Layout at the start of the shared segment, followed by the sample area. Positions are running frame
+    // counts, the sample area is indexed by (position - format_start) modulo capacity_frames. Everything a
+    // reader looks at is atomic so the header stays well-defined across processes; bump version on any
+    // layout change.
+    struct shm_ring_header {
+        static constexpr uint32_t magic_value = 0x52465641; // "AVFR"
+        static constexpr uint32_t current_version = 2;
+
+        uint32_t magic;
+        uint32_t version;
+        uint32_t header_bytes; // offset of the sample area
+        uint32_t reserved;
+        uint64_t data_bytes; // size of the sample area
+
+        // Format, rewritten while format_seq is odd. A new format (or a flush) starts a new stream at
+        // format_start; the reader skips there once it notices the new format_seq.
+        std::atomic<uint32_t> format_seq;
+        std::atomic<uint32_t> sample_rate;
+        std::atomic<uint32_t> channels; // interleaved 32-bit float
+        std::atomic<uint32_t> capacity_frames;
+        std::atomic<uint64_t> format_start;
+
+        // Timestamp of the newest frame, rewritten while time_seq is odd
+        std::atomic<uint32_t> time_seq;
+        std::atomic<uint64_t> time_frame; // write position it belongs to
+        std::atomic<uint64_t> time_ns;    // CLOCK_MONOTONIC when it was published
+        std::atomic<uint64_t> latency_ns; // expected delay until it is audible
+
+        // Producer side
+        alignas(64) std::atomic<uint64_t> write_pos;
+        std::atomic<uint32_t> data_seq; // futex word, bumped after every publish
+        std::atomic<uint32_t> readers_waiting;
+        std::atomic<uint64_t> overflow_frames; // dropped because the reader fell behind
+        std::atomic<uint64_t> overflow_events;
+
+        // Consumer side
+        alignas(64) std::atomic<uint64_t> read_pos;
+        std::atomic<uint32_t> space_seq; // futex word, bumped after every release
+        std::atomic<uint32_t> writer_waiting;
+        std::atomic<uint32_t> reader_pid;          // owner of the consumer end, 0 when free
+        std::atomic<uint64_t> reader_heartbeat_ns; // CLOCK_MONOTONIC of the owner's last call
+    };
+
+    // A reader that hasn't acquired or waited for this long counts as gone, even if it never closed
+    inline constexpr uint64_t shm_reader_timeout_ns = 2'000'000'000;
+
+    static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared header needs address-free atomics");
+
+    // Publishes the output stream into a POSIX shared-memory SPSC ring for local consumers.
+    //
+    // drop: never pushes back, frames that don't fit are counted as overflow (taps on live playback).
+    // backpressure: feed() takes only what fits, like the AVFoundation renderer, so a test harness reading
+    //               the ring can stand in for the device.
+    class shm_ring_backend : public render_backend {
+    public:
+        enum class overflow_policy { drop, backpressure };
+
+        static constexpr size_t default_data_bytes = 4u << 20;
+
+        shm_ring_backend(std::string name, overflow_policy policy = overflow_policy::drop, size_t data_bytes = default_data_bytes)
+            : name_(std::move(name)), policy_(policy), data_bytes_(data_bytes) {}
+
+        ~shm_ring_backend() override { close(); }
+
+        shm_ring_backend(const shm_ring_backend &) = delete;
+        shm_ring_backend &operator=(const shm_ring_backend &) = delete;
+
+        bool setup_format(uint32_t sample_rate, unsigned channels) override {
+            if (!header_ && (create_failed_ || !create())) {
+                // Don't retry shm_open on every chunk
+                create_failed_ = true;
+                return false;
+            }
+            if (sample_rate == 0 || channels == 0) {
+                return false;
+            }
+            if (sample_rate == header_->sample_rate.load(std::memory_order_relaxed) &&
+                channels == header_->channels.load(std::memory_order_relaxed)) {
+                return true;
+            }
+            restart(sample_rate, channels);
+            return true;
+        }
+
+        size_t feed(const float *data, size_t frames) override {
+            stage(data, frames);
+            return commit();
+        }
+
+        // Two-phase write for taps: copy into the ring without publishing, then commit() once the real
+        // renderer accepted the same frames. A new stage() simply overwrites an uncommitted one.
+        void stage(const float *data, size_t frames) {
+            staged_ = 0;
+            requested_ = frames;
+            if (!header_) {
+                return;
+            }
+            const unsigned channels = header_->channels.load(std::memory_order_relaxed);
+            const uint64_t capacity = header_->capacity_frames.load(std::memory_order_relaxed);
+            if (channels == 0 || capacity == 0) {
+                requested_ = 0;
+                return;
+            }
+            // Nobody listening: don't bother copying, and don't count it as overflow either
+            listening_ = policy_ == overflow_policy::backpressure || reader_alive();
+            if (!listening_) {
+                return;
+            }
+
+            const uint64_t start = header_->format_start.load(std::memory_order_relaxed);
+            const uint64_t write = header_->write_pos.load(std::memory_order_relaxed);
+            const uint64_t space = capacity - std::min(capacity, write - read_position());
+            const size_t n = static_cast<size_t>(std::min<uint64_t>(frames, space));
+
+            float *ring = samples();
+            const size_t first = static_cast<size_t>((write - start) % capacity);
+            const size_t head = std::min<size_t>(n, capacity - first);
+            memcpy(ring + first * channels, data, head * channels * sizeof(float));
+            memcpy(ring, data + head * channels, (n - head) * channels * sizeof(float));
+            staged_ = n;
+        }
+
+        // Publishes the staged frames, returns how many frames count as taken (all of them when dropping)
+        size_t commit() {
+            if (!header_ || requested_ == 0) {
+                return 0;
+            }
+            const size_t n = staged_;
+            const size_t frames = requested_;
+            staged_ = requested_ = 0;
+            if (!listening_) {
+                return frames;
+            }
+
+            const uint64_t write = header_->write_pos.load(std::memory_order_relaxed) + n;
+            header_->write_pos.store(write, std::memory_order_release);
+            publish_time(write);
+            if (n > 0) {
+                wake_readers();
+            }
+
+            if (n < frames && policy_ == overflow_policy::drop) {
+                header_->overflow_frames.fetch_add(frames - n, std::memory_order_relaxed);
+                header_->overflow_events.fetch_add(1, std::memory_order_relaxed);
+                return frames;
+            }
+            return n;
+        }
+
+        bool ready_for_more() const override {
+            if (!header_ || policy_ == overflow_policy::drop) {
+                return true;
+            }
+            const uint64_t used = header_->write_pos.load(std::memory_order_relaxed) - read_position();
+            return used < header_->capacity_frames.load(std::memory_order_relaxed);
+        }
+
+        // Time until the newest frame leaves the ring, plus whatever the producer said comes after it
+        double latency() const override {
+            if (!header_) {
+                return 0;
+            }
+            const uint32_t rate = header_->sample_rate.load(std::memory_order_relaxed);
+            const uint64_t used = header_->write_pos.load(std::memory_order_relaxed) - read_position();
+            return (rate ? static_cast<double>(used) / rate : 0) + header_->latency_ns.load(std::memory_order_relaxed) / 1e9;
+        }
+
+        // Queued frames are dropped by starting a new stream, the reader skips to it
+        void flush() override {
+            if (header_) {
+                restart(header_->sample_rate.load(std::memory_order_relaxed), header_->channels.load(std::memory_order_relaxed));
+            }
+        }
+
+        // Producer's estimate of the delay after the ring (device and renderer latency for a tap)
+        void set_downstream_latency(double seconds) {
+            if (header_) {
+                header_->latency_ns.store(static_cast<uint64_t>(std::max(0.0, seconds) * 1e9), std::memory_order_relaxed);
+            }
+        }
+
+        // Backpressure mode: block until the reader released something or the timeout passed
+        void wait_for_space(uint64_t timeout_ns) {
+            if (!header_) {
+                return;
+            }
+            const uint32_t seq = header_->space_seq.load(std::memory_order_acquire);
+            if (ready_for_more()) {
+                return;
+            }
+            header_->writer_waiting.fetch_add(1, std::memory_order_seq_cst);
+            shm_wait(header_->space_seq, seq, timeout_ns);
+            header_->writer_waiting.fetch_sub(1, std::memory_order_relaxed);
+        }
+
+        uint64_t overflow_frames() const { return header_ ? header_->overflow_frames.load(std::memory_order_relaxed) : 0; }
+        bool is_open() const { return header_ != nullptr; }
+        const std::string &name() const { return name_; }
+
+        void close() {
+            if (header_) {
+                munmap(header_, segment_bytes());
+                header_ = nullptr;
+                shm_unlink(name_.c_str());
+            }
+        }
+
+    private:
+        // A crashed reader leaves its pid behind, so the heartbeat decides
+        bool reader_alive() const {
+            if (header_->reader_pid.load(std::memory_order_acquire) == 0) {
+                return false;
+            }
+            return shm_clock_ns() - header_->reader_heartbeat_ns.load(std::memory_order_relaxed) < shm_reader_timeout_ns;
+        }
+
+        size_t segment_bytes() const { return sizeof(shm_ring_header) + data_bytes_; }
+        float *samples() const { return reinterpret_cast<float *>(reinterpret_cast<uint8_t *>(header_) + sizeof(shm_ring_header)); }
+
+        bool create() {
+            // Start from a fresh segment so a stale reader can't keep an old layout alive
+            shm_unlink(name_.c_str());
+            const int fd = shm_open(name_.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+            if (fd < 0) {
+                return false;
+            }
+            if (ftruncate(fd, static_cast<off_t>(segment_bytes())) != 0) {
+                ::close(fd);
+                shm_unlink(name_.c_str());
+                return false;
+            }
+            void *p = mmap(nullptr, segment_bytes(), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            ::close(fd);
+            if (p == MAP_FAILED) {
+                shm_unlink(name_.c_str());
+                return false;
+            }
+            // The segment comes zero-filled, which is a valid initial state for every atomic
+            header_ = static_cast<shm_ring_header *>(p);
+            header_->header_bytes = sizeof(shm_ring_header);
+            header_->data_bytes = data_bytes_;
+            header_->version = shm_ring_header::current_version;
+            std::atomic_thread_fence(std::memory_order_release);
+            header_->magic = shm_ring_header::magic_value;
+            return true;
+        }
+
+        // Only the reader moves read_pos; until it caught up with a new stream everything before it counts as read
+        uint64_t read_position() const {
+            return std::max(header_->read_pos.load(std::memory_order_acquire), header_->format_start.load(std::memory_order_relaxed));
+        }
+
+        void restart(uint32_t sample_rate, unsigned channels) {
+            header_->format_seq.fetch_add(1, std::memory_order_acq_rel);
+            header_->sample_rate.store(sample_rate, std::memory_order_relaxed);
+            header_->channels.store(channels, std::memory_order_relaxed);
+            header_->capacity_frames.store(static_cast<uint32_t>(data_bytes_ / (channels * sizeof(float))), std::memory_order_relaxed);
+            header_->format_start.store(header_->write_pos.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            header_->format_seq.fetch_add(1, std::memory_order_release);
+            wake_readers();
+        }
+
+        void publish_time(uint64_t frame) {
+            header_->time_seq.fetch_add(1, std::memory_order_acq_rel);
+            header_->time_frame.store(frame, std::memory_order_relaxed);
+            header_->time_ns.store(shm_clock_ns(), std::memory_order_relaxed);
+            header_->time_seq.fetch_add(1, std::memory_order_release);
+        }
+
+        void wake_readers() {
+            header_->data_seq.fetch_add(1, std::memory_order_seq_cst);
+            if (header_->readers_waiting.load(std::memory_order_seq_cst) != 0) {
+                shm_wake_all(header_->data_seq);
+            }
+        }
+
+        std::string name_;
+        overflow_policy policy_;
+        size_t data_bytes_;
+        shm_ring_header *header_ = nullptr;
+        size_t staged_ = 0;
+        size_t requested_ = 0;
+        bool listening_ = false;
+        bool create_failed_ = false;
+    };
+
+    // Consumer end of shm_ring_backend, for recorders, analyzers and test harnesses in other processes.
+    // Data is read in place: acquire() hands out up to two contiguous regions, release() frees them.
+    // The ring has a single consumer: open() fails while another live reader owns it, and takes over
+    // from one that exited without closing. acquire() and wait_for_data() keep the ownership alive, a
+    // drop-policy producer stops copying once neither was called for shm_reader_timeout_ns.
+    class shm_ring_reader {
+    public:
+        struct format {
+            uint32_t sample_rate = 0;
+            unsigned channels = 0;
+        };
+
+        struct region {
+            const float *first = nullptr;
+            size_t first_frames = 0;
+            const float *second = nullptr;
+            size_t second_frames = 0;
+
+            size_t frames() const { return first_frames + second_frames; }
+        };
+
+        ~shm_ring_reader() { close(); }
+
+        shm_ring_reader() = default;
+        shm_ring_reader(const shm_ring_reader &) = delete;
+        shm_ring_reader &operator=(const shm_ring_reader &) = delete;
+
+        bool open(const std::string &name) {
+            close();
+            const int fd = shm_open(name.c_str(), O_RDWR, 0);
+            if (fd < 0) {
+                return false;
+            }
+            struct stat st = {};
+            if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(shm_ring_header)) {
+                ::close(fd);
+                return false;
+            }
+            map_bytes_ = static_cast<size_t>(st.st_size);
+            void *p = mmap(nullptr, map_bytes_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            ::close(fd);
+            if (p == MAP_FAILED) {
+                return false;
+            }
+            header_ = static_cast<shm_ring_header *>(p);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (header_->magic != shm_ring_header::magic_value || header_->version != shm_ring_header::current_version ||
+                header_->header_bytes + header_->data_bytes > map_bytes_) {
+                close();
+                return false;
+            }
+            if (!claim()) {
+                close();
+                return false;
+            }
+            return true;
+        }
+
+        void close() {
+            if (header_) {
+                if (pid_ != 0) {
+                    uint32_t owner = pid_;
+                    header_->reader_pid.compare_exchange_strong(owner, 0, std::memory_order_release);
+                    pid_ = 0;
+                }
+                munmap(header_, map_bytes_);
+                header_ = nullptr;
+            }
+        }
+
+        // False while the producer is switching formats; try again after wait_for_data()
+        bool current_format(format &f) {
+            const uint32_t seq = header_->format_seq.load(std::memory_order_acquire);
+            if (seq & 1) {
+                return false;
+            }
+            f.sample_rate = header_->sample_rate.load(std::memory_order_relaxed);
+            f.channels = header_->channels.load(std::memory_order_relaxed);
+            const uint64_t capacity = header_->capacity_frames.load(std::memory_order_relaxed);
+            const uint64_t start = header_->format_start.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (header_->format_seq.load(std::memory_order_relaxed) != seq) {
+                return false;
+            }
+            if (seq != format_seq_) {
+                // New stream: whatever was left of the old one is gone
+                format_seq_ = seq;
+                format_ = f;
+                capacity_ = capacity;
+                start_ = start;
+                header_->read_pos.store(start, std::memory_order_release);
+            }
+            return f.channels != 0;
+        }
+
+        // Whether the stream restarted since the last current_format(). Check after copying out of a region:
+        // if it did, the producer may have overwritten what was read.
+        bool format_changed() const { return header_->format_seq.load(std::memory_order_acquire) != format_seq_; }
+
+        region acquire() {
+            heartbeat();
+            region r;
+            if (format_changed() || format_.channels == 0 || capacity_ == 0) {
+                return r;
+            }
+            const uint64_t read = header_->read_pos.load(std::memory_order_relaxed);
+            const uint64_t write = header_->write_pos.load(std::memory_order_acquire);
+            const size_t available = static_cast<size_t>(std::min<uint64_t>(write - read, capacity_));
+            const size_t first = static_cast<size_t>((read - start_) % capacity_);
+            const float *ring = reinterpret_cast<const float *>(reinterpret_cast<const uint8_t *>(header_) + header_->header_bytes);
+            r.first = ring + first * format_.channels;
+            r.first_frames = std::min<size_t>(available, capacity_ - first);
+            r.second = ring;
+            r.second_frames = available - r.first_frames;
+            return r;
+        }
+
+        void release(size_t frames) {
+            // A region from before a restart no longer belongs to the stream
+            if (format_changed()) {
+                return;
+            }
+            header_->read_pos.fetch_add(frames, std::memory_order_release);
+            header_->space_seq.fetch_add(1, std::memory_order_seq_cst);
+            if (header_->writer_waiting.load(std::memory_order_seq_cst) != 0) {
+                shm_wake_all(header_->space_seq);
+            }
+        }
+
+        // Sleeps until the producer published something new or the timeout passed
+        void wait_for_data(uint64_t timeout_ns) {
+            heartbeat();
+            const uint32_t seq = header_->data_seq.load(std::memory_order_acquire);
+            const bool pending = header_->write_pos.load(std::memory_order_acquire) != header_->read_pos.load(std::memory_order_relaxed);
+            if (pending || format_changed()) {
+                return;
+            }
+            header_->readers_waiting.fetch_add(1, std::memory_order_seq_cst);
+            shm_wait(header_->data_seq, seq, timeout_ns);
+            header_->readers_waiting.fetch_sub(1, std::memory_order_relaxed);
+            heartbeat();
+        }
+
+        // Newest frame position with its publish time and the producer's downstream latency
+        bool timestamp(uint64_t &frame, uint64_t &ns, uint64_t &latency_ns) const {
+            const uint32_t seq = header_->time_seq.load(std::memory_order_acquire);
+            if (seq & 1) {
+                return false;
+            }
+            frame = header_->time_frame.load(std::memory_order_relaxed);
+            ns = header_->time_ns.load(std::memory_order_relaxed);
+            latency_ns = header_->latency_ns.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            return header_->time_seq.load(std::memory_order_relaxed) == seq;
+        }
+
+        uint64_t overflow_frames() const { return header_->overflow_frames.load(std::memory_order_relaxed); }
+        uint64_t overflow_events() const { return header_->overflow_events.load(std::memory_order_relaxed); }
+
+    private:
+        // Takes the consumer slot if it is free, or if its owner is gone: the process no longer exists, or
+        // it stopped calling in (pid reused, or stuck) for longer than the timeout
+        bool claim() {
+            const uint32_t self = static_cast<uint32_t>(getpid());
+            uint32_t owner = header_->reader_pid.load(std::memory_order_acquire);
+            if (owner != 0) {
+                const bool exited = kill(static_cast<pid_t>(owner), 0) != 0 && errno == ESRCH;
+                const bool stale = shm_clock_ns() - header_->reader_heartbeat_ns.load(std::memory_order_relaxed) >= shm_reader_timeout_ns;
+                if (!exited && !stale) {
+                    return false;
+                }
+            }
+            if (!header_->reader_pid.compare_exchange_strong(owner, self, std::memory_order_acq_rel)) {
+                return false;
+            }
+            pid_ = self;
+            heartbeat();
+            return true;
+        }
+
+        void heartbeat() { header_->reader_heartbeat_ns.store(shm_clock_ns(), std::memory_order_relaxed); }
+
+        shm_ring_header *header_ = nullptr;
+        size_t map_bytes_ = 0;
+        uint32_t pid_ = 0;
+        uint32_t format_seq_ = UINT32_MAX;
+        format format_;
+        uint64_t capacity_ = 0;
+        uint64_t start_ = 0;
+    };
+} // namespace utils
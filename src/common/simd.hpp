@@ -0,0 +1,154 @@
+#pragma once
+
+#include <cmath>
+#include <utility>
+#include <algorithm>
+
+#if defined(__aarch64__) || defined(__arm64ec__)
+#include <arm_neon.h>
+#elif defined(__SSE2__) || defined(__x86_64__)
+#include <emmintrin.h>
+#endif
+
+namespace utils
+{
+    // Four floats in one register, with just the operations the DSP stages and layout kernels need. Stages
+    // that work across channels (or bands) use this instead of spelling out NEON and SSE each time; targets
+    // without either get plain loops the compiler can still vectorize.
+    struct f32x4 {
+#if defined(__aarch64__) || defined(__arm64ec__)
+        float32x4_t v;
+
+        static f32x4 load(const float *p) { return {vld1q_f32(p)}; }
+        // Four doubles, narrowed
+        static f32x4 load(const double *p) { return {vcombine_f32(vcvt_f32_f64(vld1q_f64(p)), vcvt_f32_f64(vld1q_f64(p + 2)))}; }
+        // Two values from `lo` into lanes 0-1, two from `hi` into lanes 2-3
+        static f32x4 load_pairs(const float *lo, const float *hi) { return {vcombine_f32(vld1_f32(lo), vld1_f32(hi))}; }
+        static f32x4 load_pairs(const double *lo, const double *hi) {
+            return {vcombine_f32(vcvt_f32_f64(vld1q_f64(lo)), vcvt_f32_f64(vld1q_f64(hi)))};
+        }
+        static f32x4 splat(float x) { return {vdupq_n_f32(x)}; }
+        void store(float *p) const { vst1q_f32(p, v); }
+        void store_pairs(float *lo, float *hi) const {
+            vst1_f32(lo, vget_low_f32(v));
+            vst1_f32(hi, vget_high_f32(v));
+        }
+
+        friend f32x4 operator+(f32x4 a, f32x4 b) { return {vaddq_f32(a.v, b.v)}; }
+        friend f32x4 operator-(f32x4 a, f32x4 b) { return {vsubq_f32(a.v, b.v)}; }
+        friend f32x4 operator*(f32x4 a, f32x4 b) { return {vmulq_f32(a.v, b.v)}; }
+        // a + b * c
+        friend f32x4 madd(f32x4 a, f32x4 b, f32x4 c) { return {vfmaq_f32(a.v, b.v, c.v)}; }
+        friend f32x4 abs(f32x4 a) { return {vabsq_f32(a.v)}; }
+        friend f32x4 max(f32x4 a, f32x4 b) { return {vmaxq_f32(a.v, b.v)}; }
+        // a > b ? x : y, per lane
+        friend f32x4 select_greater(f32x4 a, f32x4 b, f32x4 x, f32x4 y) { return {vbslq_f32(vcgtq_f32(a.v, b.v), x.v, y.v)}; }
+        friend float hmax(f32x4 a) { return vmaxvq_f32(a.v); }
+
+        // Lanes 0 and 2 of a, then of b / lanes 1 and 3
+        friend f32x4 unzip_even(f32x4 a, f32x4 b) { return {vuzp1q_f32(a.v, b.v)}; }
+        friend f32x4 unzip_odd(f32x4 a, f32x4 b) { return {vuzp2q_f32(a.v, b.v)}; }
+        // a0 b0 a1 b1 / a2 b2 a3 b3
+        friend f32x4 zip_low(f32x4 a, f32x4 b) { return {vzip1q_f32(a.v, b.v)}; }
+        friend f32x4 zip_high(f32x4 a, f32x4 b) { return {vzip2q_f32(a.v, b.v)}; }
+        // Rows become columns
+        friend void transpose(f32x4 &a, f32x4 &b, f32x4 &c, f32x4 &d) {
+            const float64x2_t ab0 = vreinterpretq_f64_f32(vtrn1q_f32(a.v, b.v));
+            const float64x2_t ab1 = vreinterpretq_f64_f32(vtrn2q_f32(a.v, b.v));
+            const float64x2_t cd0 = vreinterpretq_f64_f32(vtrn1q_f32(c.v, d.v));
+            const float64x2_t cd1 = vreinterpretq_f64_f32(vtrn2q_f32(c.v, d.v));
+            a.v = vreinterpretq_f32_f64(vtrn1q_f64(ab0, cd0));
+            b.v = vreinterpretq_f32_f64(vtrn1q_f64(ab1, cd1));
+            c.v = vreinterpretq_f32_f64(vtrn2q_f64(ab0, cd0));
+            d.v = vreinterpretq_f32_f64(vtrn2q_f64(ab1, cd1));
+        }
+#elif defined(__SSE2__) || defined(__x86_64__)
+        __m128 v;
+
+        static f32x4 load(const float *p) { return {_mm_loadu_ps(p)}; }
+        static f32x4 load(const double *p) { return {_mm_movelh_ps(_mm_cvtpd_ps(_mm_loadu_pd(p)), _mm_cvtpd_ps(_mm_loadu_pd(p + 2)))}; }
+        static f32x4 load_pairs(const float *lo, const float *hi) {
+            return {_mm_loadh_pi(_mm_loadl_pi(_mm_setzero_ps(), reinterpret_cast<const __m64 *>(lo)), reinterpret_cast<const __m64 *>(hi))};
+        }
+        static f32x4 load_pairs(const double *lo, const double *hi) {
+            return {_mm_movelh_ps(_mm_cvtpd_ps(_mm_loadu_pd(lo)), _mm_cvtpd_ps(_mm_loadu_pd(hi)))};
+        }
+        static f32x4 splat(float x) { return {_mm_set1_ps(x)}; }
+        void store(float *p) const { _mm_storeu_ps(p, v); }
+        void store_pairs(float *lo, float *hi) const {
+            _mm_storel_pi(reinterpret_cast<__m64 *>(lo), v);
+            _mm_storeh_pi(reinterpret_cast<__m64 *>(hi), v);
+        }
+
+        friend f32x4 operator+(f32x4 a, f32x4 b) { return {_mm_add_ps(a.v, b.v)}; }
+        friend f32x4 operator-(f32x4 a, f32x4 b) { return {_mm_sub_ps(a.v, b.v)}; }
+        friend f32x4 operator*(f32x4 a, f32x4 b) { return {_mm_mul_ps(a.v, b.v)}; }
+        friend f32x4 madd(f32x4 a, f32x4 b, f32x4 c) { return {_mm_add_ps(a.v, _mm_mul_ps(b.v, c.v))}; }
+        friend f32x4 abs(f32x4 a) { return {_mm_andnot_ps(_mm_set1_ps(-0.0f), a.v)}; }
+        friend f32x4 max(f32x4 a, f32x4 b) { return {_mm_max_ps(a.v, b.v)}; }
+        friend f32x4 select_greater(f32x4 a, f32x4 b, f32x4 x, f32x4 y) {
+            const __m128 mask = _mm_cmpgt_ps(a.v, b.v);
+            return {_mm_or_ps(_mm_and_ps(mask, x.v), _mm_andnot_ps(mask, y.v))};
+        }
+        friend float hmax(f32x4 a) {
+            const __m128 pairs = _mm_max_ps(a.v, _mm_shuffle_ps(a.v, a.v, _MM_SHUFFLE(1, 0, 3, 2)));
+            return _mm_cvtss_f32(_mm_max_ss(pairs, _mm_shuffle_ps(pairs, pairs, _MM_SHUFFLE(2, 3, 0, 1))));
+        }
+
+        friend f32x4 unzip_even(f32x4 a, f32x4 b) { return {_mm_shuffle_ps(a.v, b.v, _MM_SHUFFLE(2, 0, 2, 0))}; }
+        friend f32x4 unzip_odd(f32x4 a, f32x4 b) { return {_mm_shuffle_ps(a.v, b.v, _MM_SHUFFLE(3, 1, 3, 1))}; }
+        friend f32x4 zip_low(f32x4 a, f32x4 b) { return {_mm_unpacklo_ps(a.v, b.v)}; }
+        friend f32x4 zip_high(f32x4 a, f32x4 b) { return {_mm_unpackhi_ps(a.v, b.v)}; }
+        friend void transpose(f32x4 &a, f32x4 &b, f32x4 &c, f32x4 &d) { _MM_TRANSPOSE4_PS(a.v, b.v, c.v, d.v); }
+#else
+        float v[4];
+
+        static f32x4 load(const float *p) { return {{p[0], p[1], p[2], p[3]}}; }
+        static f32x4 load(const double *p) {
+            return {{static_cast<float>(p[0]), static_cast<float>(p[1]), static_cast<float>(p[2]), static_cast<float>(p[3])}};
+        }
+        template <typename T>
+        static f32x4 load_pairs(const T *lo, const T *hi) {
+            return {{static_cast<float>(lo[0]), static_cast<float>(lo[1]), static_cast<float>(hi[0]), static_cast<float>(hi[1])}};
+        }
+        static f32x4 splat(float x) { return {{x, x, x, x}}; }
+        void store(float *p) const { std::copy(v, v + 4, p); }
+        void store_pairs(float *lo, float *hi) const {
+            std::copy(v, v + 2, lo);
+            std::copy(v + 2, v + 4, hi);
+        }
+
+        template <typename Op>
+        static f32x4 map(f32x4 a, f32x4 b, Op op) {
+            return {{op(a.v[0], b.v[0]), op(a.v[1], b.v[1]), op(a.v[2], b.v[2]), op(a.v[3], b.v[3])}};
+        }
+        friend f32x4 operator+(f32x4 a, f32x4 b) { return map(a, b, [](float x, float y) { return x + y; }); }
+        friend f32x4 operator-(f32x4 a, f32x4 b) { return map(a, b, [](float x, float y) { return x - y; }); }
+        friend f32x4 operator*(f32x4 a, f32x4 b) { return map(a, b, [](float x, float y) { return x * y; }); }
+        friend f32x4 madd(f32x4 a, f32x4 b, f32x4 c) { return a + b * c; }
+        friend f32x4 abs(f32x4 a) { return map(a, a, [](float x, float) { return std::fabs(x); }); }
+        friend f32x4 max(f32x4 a, f32x4 b) { return map(a, b, [](float x, float y) { return std::max(x, y); }); }
+        friend f32x4 select_greater(f32x4 a, f32x4 b, f32x4 x, f32x4 y) {
+            f32x4 r;
+            for (int i = 0; i < 4; i++) {
+                r.v[i] = a.v[i] > b.v[i] ? x.v[i] : y.v[i];
+            }
+            return r;
+        }
+        friend float hmax(f32x4 a) { return std::max(std::max(a.v[0], a.v[1]), std::max(a.v[2], a.v[3])); }
+
+        friend f32x4 unzip_even(f32x4 a, f32x4 b) { return {{a.v[0], a.v[2], b.v[0], b.v[2]}}; }
+        friend f32x4 unzip_odd(f32x4 a, f32x4 b) { return {{a.v[1], a.v[3], b.v[1], b.v[3]}}; }
+        friend f32x4 zip_low(f32x4 a, f32x4 b) { return {{a.v[0], b.v[0], a.v[1], b.v[1]}}; }
+        friend f32x4 zip_high(f32x4 a, f32x4 b) { return {{a.v[2], b.v[2], a.v[3], b.v[3]}}; }
+        friend void transpose(f32x4 &a, f32x4 &b, f32x4 &c, f32x4 &d) {
+            f32x4 *rows[4] = {&a, &b, &c, &d};
+            for (int i = 0; i < 4; i++) {
+                for (int j = i + 1; j < 4; j++) {
+                    std::swap(rows[i]->v[j], rows[j]->v[i]);
+                }
+            }
+        }
+#endif
+    };
+} // namespace utils
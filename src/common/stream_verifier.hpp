@@ -0,0 +1,339 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <vector>
+#include <algorithm>
+#include "sample_ops.hpp"
+
+#if defined(__aarch64__) || defined(__arm64ec__)
+#include <arm_neon.h>
+#endif
+
+namespace utils
+{
+    // Order-sensitive 64-bit hash over 32-bit words, eight independent lanes (one 32-byte stripe per round) so
+    // it runs as two NEON / SSE vectors and stays far below the cost of the conversion it checks. Same
+    // multiply-rotate rounds as xxHash32, lanes merged at the end; not for anything adversarial.
+    class lane_hash {
+    public:
+        static constexpr size_t lanes = 8;
+
+        lane_hash() { reset(); }
+
+        void reset() {
+            for (size_t i = 0; i < lanes; i++) {
+                acc_[i] = seed_ + static_cast<uint32_t>(i) * prime2;
+            }
+        }
+
+        void stripe(const uint32_t *words) {
+#if defined(__aarch64__) || defined(__arm64ec__)
+            for (size_t half = 0; half < lanes; half += 4) {
+                uint32x4_t acc = vld1q_u32(acc_ + half);
+                acc = vmlaq_u32(acc, vld1q_u32(words + half), vdupq_n_u32(prime2));
+                acc = vsriq_n_u32(vshlq_n_u32(acc, 13), acc, 19);
+                vst1q_u32(acc_ + half, vmulq_u32(acc, vdupq_n_u32(prime1)));
+            }
+#else
+            for (size_t i = 0; i < lanes; i++) {
+                const uint32_t v = acc_[i] + words[i] * prime2;
+                acc_[i] = ((v << 13) | (v >> 19)) * prime1;
+            }
+#endif
+        }
+
+        uint64_t finish(uint64_t length) const {
+            uint64_t h = length * prime64;
+            for (size_t i = 0; i < lanes; i++) {
+                h ^= (static_cast<uint64_t>(acc_[i]) << (i * 4)) + 0x9E3779B97F4A7C15ull;
+                h = (h ^ (h >> 29)) * prime64;
+            }
+            return h ^ (h >> 32);
+        }
+
+    private:
+        static constexpr uint32_t prime1 = 0x9E3779B1u;
+        static constexpr uint32_t prime2 = 0x85EBCA77u;
+        static constexpr uint64_t prime64 = 0xC2B2AE3D27D4EB4Full;
+        static constexpr uint32_t seed_ = 0x165667B1u;
+        uint32_t acc_[lanes] = {};
+    };
+
+    // Proves the samples reaching the renderer are the ones that entered the output, unaltered and in order.
+    //
+    // Both ends hash the sample stream in windows of `window_frames` frames, numbered by presentation time in
+    // frames, so re-blocking between the two points doesn't matter. The entry side (processing thread) hashes
+    // the float conversion of what foobar2000 handed in and posts one hash per window; the exit side (render
+    // queue) hashes what is enqueued and compares. Windows the chain was allowed to change (fade-in, processing
+    // stages) are posted as not comparable.
+    //
+    // Entry follows the shm ring's stage()/commit(): a chunk only counts once the engine accepted it.
+    class stream_verifier {
+    public:
+        static constexpr size_t window_frames = 4096;
+
+        stream_verifier() {
+            staged_windows_.reserve(32);
+            unmatched_.reserve(max_unmatched + 32);
+        }
+
+        // Processing thread, together with clearing the queue (engine flush): the timeline starts over
+        void restart() {
+            entry_ = {};
+            staged_windows_.clear();
+            epoch_.fetch_add(1, std::memory_order_acq_rel);
+        }
+
+        // Processing thread: hash a chunk as it enters, `first_frame` being the presentation time it will get.
+        // `comparable` is false if the chain may alter it.
+        template <typename Sample>
+        void stage(int64_t first_frame, const Sample *samples, size_t frames, unsigned channels, bool comparable) {
+            staged_ = entry_;
+            staged_windows_.clear();
+            if (first_frame < 0) {
+                return;
+            }
+            if (static_cast<uint64_t>(first_frame) != staged_.frame) {
+                skip_to(staged_, static_cast<uint64_t>(first_frame));
+            }
+            if (!comparable) {
+                staged_.tainted = true;
+            }
+            feed(staged_, samples, frames, channels, [this](uint64_t window, uint64_t hash, bool tainted) {
+                staged_windows_.push_back({window, hash, tainted});
+            });
+        }
+
+        // Processing thread: the staged chunk was taken by the engine
+        void commit() {
+            entry_ = staged_;
+            const uint32_t epoch = epoch_.load(std::memory_order_relaxed);
+            for (const window_hash &w : staged_windows_) {
+                post({epoch, w.window, w.hash, w.tainted});
+            }
+            staged_windows_.clear();
+        }
+
+        // Render queue: samples being enqueued, `first_frame` being their presentation time in frames.
+        // Returns the number of mismatching windows found by this call.
+        size_t verify(int64_t first_frame, const float *samples, size_t frames, unsigned channels) {
+            const uint32_t epoch = epoch_.load(std::memory_order_acquire);
+            if (epoch != exit_epoch_) {
+                exit_epoch_ = epoch;
+                exit_ = {};
+                unmatched_.clear();
+            }
+            if (first_frame < 0 || channels == 0) {
+                return 0;
+            }
+
+            // Replayed after a stall or idle restore: already checked
+            const uint64_t first = static_cast<uint64_t>(first_frame);
+            if (first + frames <= exit_.frame) {
+                return 0;
+            }
+            if (first < exit_.frame) {
+                const size_t skip = static_cast<size_t>(exit_.frame - first);
+                samples += skip * channels;
+                frames -= skip;
+            } else if (first > exit_.frame) {
+                skip_to(exit_, first);
+            }
+
+            feed(exit_, samples, frames, channels, [this](uint64_t window, uint64_t hash, bool tainted) {
+                if (!tainted) {
+                    unmatched_.push_back({window, hash, false});
+                } else {
+                    unverified_.fetch_add(1, std::memory_order_relaxed);
+                }
+            });
+            return match();
+        }
+
+        // Any thread
+        uint64_t verified_windows() const { return verified_.load(std::memory_order_relaxed); }
+        uint64_t mismatched_windows() const { return mismatched_.load(std::memory_order_relaxed); }
+        uint64_t unverified_windows() const { return unverified_.load(std::memory_order_relaxed); }
+        // First frame of the most recent mismatching window, -1 if none
+        int64_t last_mismatch_frame() const { return last_mismatch_.load(std::memory_order_relaxed); }
+
+    private:
+        struct window_hash {
+            uint64_t window;
+            uint64_t hash;
+            bool tainted;
+        };
+
+        struct posted_hash {
+            uint32_t epoch;
+            uint64_t window;
+            uint64_t hash;
+            bool tainted;
+        };
+
+        struct stream_state {
+            uint64_t frame = 0;     // next frame index
+            uint64_t samples = 0;   // hashed into the current window
+            bool tainted = false;   // current window can't be compared
+            unsigned pending = 0;   // words waiting for a full stripe
+            uint32_t words[lane_hash::lanes] = {};
+            lane_hash hash;
+        };
+
+        static constexpr size_t ring_size = 256; // posted windows in flight, ~20 s at 48 kHz
+        static constexpr size_t max_unmatched = 64;
+
+        template <typename Sample, typename OnWindow>
+        static void feed(stream_state &s, const Sample *samples, size_t frames, unsigned channels, OnWindow &&on_window) {
+            while (frames > 0) {
+                const size_t room = window_frames - static_cast<size_t>(s.frame % window_frames);
+                const size_t n = std::min(frames, room);
+                hash_samples(s, samples, n * channels);
+                samples += n * channels;
+                frames -= n;
+                s.frame += n;
+                if (n == room) {
+                    close_window(s, on_window);
+                }
+            }
+        }
+
+        template <typename OnWindow>
+        static void close_window(stream_state &s, OnWindow &&on_window) {
+            if (s.pending) {
+                std::fill(s.words + s.pending, s.words + lane_hash::lanes, 0u);
+                s.hash.stripe(s.words);
+                s.pending = 0;
+            }
+            on_window(s.frame / window_frames - 1, s.hash.finish(s.samples), s.tainted);
+            s.hash.reset();
+            s.samples = 0;
+            s.tainted = false;
+        }
+
+        // Frames missing on one side (verification started mid-stream, dropped buffers): the windows they touch
+        // can't be checked
+        static void skip_to(stream_state &s, uint64_t frame) {
+            if (frame / window_frames != s.frame / window_frames) {
+                s.hash.reset();
+                s.samples = 0;
+                s.pending = 0;
+            }
+            s.frame = frame;
+            s.tainted = true;
+        }
+
+        static void hash_words(stream_state &s, const uint32_t *words, size_t count) {
+            s.samples += count;
+            if (s.pending) {
+                const size_t take = std::min(count, lane_hash::lanes - s.pending);
+                memcpy(s.words + s.pending, words, take * sizeof(uint32_t));
+                s.pending += static_cast<unsigned>(take);
+                words += take;
+                count -= take;
+                if (s.pending < lane_hash::lanes) {
+                    return;
+                }
+                s.hash.stripe(s.words);
+                s.pending = 0;
+            }
+            for (; count >= lane_hash::lanes; count -= lane_hash::lanes, words += lane_hash::lanes) {
+                s.hash.stripe(words);
+            }
+            memcpy(s.words, words, count * sizeof(uint32_t));
+            s.pending = static_cast<unsigned>(count);
+        }
+
+        // Floats are hashed in place; doubles go through the same conversion as the output chain first
+        static void hash_samples(stream_state &s, const float *samples, size_t count) {
+            static_assert(sizeof(float) == sizeof(uint32_t));
+            hash_words(s, reinterpret_cast<const uint32_t *>(samples), count);
+        }
+
+        static void hash_samples(stream_state &s, const double *samples, size_t count) {
+            float block[512];
+            while (count > 0) {
+                const size_t n = std::min(count, std::size(block));
+                simd_convert(samples, block, n);
+                hash_words(s, reinterpret_cast<const uint32_t *>(block), n);
+                samples += n;
+                count -= n;
+            }
+        }
+
+        void post(const posted_hash &h) {
+            const size_t head = head_.load(std::memory_order_relaxed);
+            if (head - tail_.load(std::memory_order_acquire) >= ring_size) {
+                return; // exit side far behind, the window just goes unverified
+            }
+            ring_[head % ring_size] = h;
+            head_.store(head + 1, std::memory_order_release);
+        }
+
+        // Pair closed exit windows with posted ones; windows the entry side hasn't posted yet wait for it
+        size_t match() {
+            size_t mismatches = 0;
+            size_t tail = tail_.load(std::memory_order_relaxed);
+            const size_t head = head_.load(std::memory_order_acquire);
+            while (!unmatched_.empty()) {
+                const window_hash &w = unmatched_.front();
+                // Drop what belongs to an older stream or windows the exit side never saw
+                while (tail != head && (static_cast<int32_t>(ring_[tail % ring_size].epoch - exit_epoch_) < 0 ||
+                                        (ring_[tail % ring_size].epoch == exit_epoch_ && ring_[tail % ring_size].window < w.window))) {
+                    tail++;
+                }
+                if (tail == head || ring_[tail % ring_size].epoch != exit_epoch_) {
+                    break; // not posted yet
+                }
+                const posted_hash &p = ring_[tail % ring_size];
+                if (p.window == w.window) {
+                    if (p.tainted) {
+                        unverified_.fetch_add(1, std::memory_order_relaxed);
+                    } else if (p.hash == w.hash) {
+                        verified_.fetch_add(1, std::memory_order_relaxed);
+                    } else {
+                        mismatched_.fetch_add(1, std::memory_order_relaxed);
+                        last_mismatch_.store(static_cast<int64_t>(w.window * window_frames), std::memory_order_relaxed);
+                        mismatches++;
+                    }
+                    tail++;
+                } else {
+                    unverified_.fetch_add(1, std::memory_order_relaxed);
+                }
+                unmatched_.erase(unmatched_.begin());
+            }
+            tail_.store(tail, std::memory_order_release);
+
+            if (unmatched_.size() > max_unmatched) {
+                unverified_.fetch_add(unmatched_.size() - max_unmatched, std::memory_order_relaxed);
+                unmatched_.erase(unmatched_.begin(), unmatched_.end() - max_unmatched);
+            }
+            return mismatches;
+        }
+
+        // Processing thread
+        stream_state entry_;
+        stream_state staged_;
+        std::vector<window_hash> staged_windows_;
+
+        // Entry to exit, single producer / single consumer
+        posted_hash ring_[ring_size] = {};
+        std::atomic<size_t> head_{0};
+        std::atomic<size_t> tail_{0};
+        std::atomic<uint32_t> epoch_{0};
+
+        // Render queue
+        stream_state exit_;
+        uint32_t exit_epoch_ = 0;
+        std::vector<window_hash> unmatched_;
+
+        std::atomic<uint64_t> verified_{0};
+        std::atomic<uint64_t> mismatched_{0};
+        std::atomic<uint64_t> unverified_{0};
+        std::atomic<int64_t> last_mismatch_{-1};
+    };
+} // namespace utils
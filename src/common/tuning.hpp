@@ -0,0 +1,115 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <algorithm>
+
+namespace utils
+{
+    // Single-reader config slot: any thread may publish a new value, the audio thread picks it up with one
+    // atomic load at the start of the next quantum and never blocks or frees anything itself.
+    //
+    // Old values are retired by the writer and only deleted once the reader has acknowledged a newer
+    // generation, so the reference returned by acquire() stays valid until the reader's next acquire().
+    template <typename T>
+    class config_slot {
+    public:
+        explicit config_slot(const T &initial = T{}) {
+            auto first = std::make_unique<node>(node{initial, 1});
+            current_.store(first.get(), std::memory_order_release);
+            nodes_.push_back(std::move(first));
+        }
+
+        config_slot(const config_slot &) = delete;
+        config_slot &operator=(const config_slot &) = delete;
+
+        // Writer side, never called from the audio thread
+        void publish(const T &value) {
+            std::lock_guard<std::mutex> lock(writer_mutex_);
+            const uint64_t generation = nodes_.back()->generation + 1;
+            nodes_.push_back(std::make_unique<node>(node{value, generation}));
+            current_.store(nodes_.back().get(), std::memory_order_release);
+
+            // Everything older than what the reader acknowledged can go, the newest node always stays
+            const uint64_t seen = reader_generation_.load(std::memory_order_acquire);
+            nodes_.erase(std::remove_if(nodes_.begin(),
+                                        nodes_.end() - 1,
+                                        [seen](const std::unique_ptr<node> &n) { return n->generation < seen; }),
+                         nodes_.end() - 1);
+        }
+
+        // Latest published value as seen by the writer side (for comparisons before publishing)
+        T latest() const {
+            std::lock_guard<std::mutex> lock(writer_mutex_);
+            return nodes_.back()->value;
+        }
+
+        // Reader side, once per quantum. `changed` tells whether this is a value not seen before.
+        const T &acquire(bool *changed = nullptr) {
+            node *n = current_.load(std::memory_order_acquire);
+            if (changed) {
+                *changed = n->generation != reader_generation_.load(std::memory_order_relaxed);
+            }
+            reader_generation_.store(n->generation, std::memory_order_release);
+            return n->value;
+        }
+
+    private:
+        struct node {
+            T value;
+            uint64_t generation;
+        };
+
+        std::atomic<node *> current_{nullptr};
+        std::atomic<uint64_t> reader_generation_{0};
+        mutable std::mutex writer_mutex_;
+        std::vector<std::unique_ptr<node>> nodes_;
+    };
+
+    // Engine parameters that can be changed while audio plays
+    struct engine_tuning {
+        enum class conversion_mode : uint32_t {
+            automatic = 0, // SIMD where available
+            scalar = 1,    // plain loop, for A/B checks
+            simd = 2,
+        };
+
+        enum class power_mode : uint32_t {
+            balanced = 0,
+            low_latency = 1, // half the buffer target
+            energy = 2,      // double the buffer target, no helper threads
+        };
+
+        uint32_t target_buffer_ms = 0; // 0: legacy fixed queue of 3 buffers
+        uint32_t split_frames = 0;     // helper task size with 16+ channels, 0: the device's IO buffer (see render_chain)
+        conversion_mode conversion = conversion_mode::automatic;
+        bool sanitize = true;    // scrub NaN/Inf and clamp runaway samples
+        uint32_t fade_in_ms = 0; // ramp after start, seek and resume
+        power_mode power = power_mode::balanced;
+        uint32_t idle_reclaim_s = 30; // 0 disables
+        bool shm_tap = false;         // mirror the output into a shared-memory ring for local tools
+        bool control_socket = false;  // serve stats and control commands on a Unix domain socket
+        bool verify = false;          // hash what enters and what leaves the output, report differences
+        uint32_t crossfeed = 0;       // headphone crossfeed preset (see crossfeed_presets), 0 = off
+        bool stereo_spatial = true;   // let the system spatialize stereo; crossfeed stays off while it may
+        uint32_t night_mode = 0;      // multiband compression preset (see night_mode_presets), 0 = off
+        bool governor = true;         // step DSP quality down under sustained CPU overload (see overload_governor)
+
+        double effective_buffer_seconds() const {
+            const double base = target_buffer_ms / 1000.0;
+            switch (power) {
+            case power_mode::low_latency:
+                return base / 2;
+            case power_mode::energy:
+                return base * 2;
+            default:
+                return base;
+            }
+        }
+
+        bool operator==(const engine_tuning &) const = default;
+    };
+} // namespace utils
@@ -0,0 +1,210 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+#include <algorithm>
+
+namespace utils
+{
+    // The exact samples handed to the renderer, indexed by presentation time in frames, so visualisers can
+    // look up what is audible right now instead of what was decoded last.
+    //
+    // One writer (the thread feeding the engine), any number of readers, no locks. The writer announces the
+    // range it is about to overwrite before touching it and readers validate their copy afterwards, seqlock
+    // style; a reader that lost the race just gets fewer (or no) frames. Memory is allocated by the writer
+    // on first use after enable(), and never moves afterwards.
+    class vis_tap {
+    public:
+        static constexpr size_t capacity_floats = size_t(1) << 21; // 8 MiB, ~1.4 s of 32 channels at 48 kHz
+
+        // Any thread. Nothing is recorded (or allocated) until somebody asks for it.
+        void enable() { requested_.store(true, std::memory_order_relaxed); }
+        bool enabled() const { return requested_.load(std::memory_order_relaxed); }
+
+        // Writer: `pts_frame` is the presentation time of the first frame. A jump in time or a new format
+        // starts a new stream, older frames become unreadable.
+        void write(int64_t pts_frame, const float *data, size_t frames, unsigned channels, uint32_t sample_rate) {
+            if (!requested_.load(std::memory_order_relaxed) || channels == 0 || frames == 0) {
+                return;
+            }
+            if (!storage_) {
+                storage_ = std::make_unique<float[]>(capacity_floats);
+                buffer_.store(storage_.get(), std::memory_order_release);
+            }
+
+            if (channels != channels_ || sample_rate != sample_rate_ || pts_frame != write_end_.load(std::memory_order_relaxed)) {
+                layout_seq_.fetch_add(1, std::memory_order_acq_rel);
+                channels_ = channels;
+                sample_rate_ = sample_rate;
+                capacity_frames_ = capacity_floats / channels;
+                layout_channels_.store(channels, std::memory_order_relaxed);
+                layout_rate_.store(sample_rate, std::memory_order_relaxed);
+                valid_from_.store(pts_frame, std::memory_order_relaxed);
+                write_end_.store(pts_frame, std::memory_order_relaxed);
+                layout_seq_.fetch_add(1, std::memory_order_release);
+            }
+
+            // Never keep more than the ring holds
+            if (frames > capacity_frames_) {
+                data += (frames - capacity_frames_) * channels;
+                pts_frame += static_cast<int64_t>(frames - capacity_frames_);
+                frames = capacity_frames_;
+            }
+
+            // Announce the overwrite before doing it
+            const int64_t end = pts_frame + static_cast<int64_t>(frames);
+            const int64_t floor = end - static_cast<int64_t>(capacity_frames_);
+            if (floor > valid_from_.load(std::memory_order_relaxed)) {
+                valid_from_.store(floor, std::memory_order_relaxed);
+            }
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+
+            float *ring = storage_.get();
+            const size_t first = static_cast<size_t>(pts_frame % static_cast<int64_t>(capacity_frames_));
+            const size_t head = std::min(frames, capacity_frames_ - first);
+            memcpy(ring + first * channels, data, head * channels * sizeof(float));
+            memcpy(ring, data + head * channels, (frames - head) * channels * sizeof(float));
+            write_end_.store(end, std::memory_order_release);
+        }
+
+        // Writer: forget everything (flush)
+        void reset() { write_end_.store(-1, std::memory_order_relaxed); }
+
+        // Any thread: copies up to `frames` frames ending at `end_frame` (clamped to what was written) into `out`,
+        // which must hold frames * max channels. Returns the frame count, 0 if nothing usable is there.
+        size_t read(int64_t end_frame, size_t frames, float *out, size_t out_floats, unsigned &channels, uint32_t &sample_rate) const {
+            const float *ring = buffer_.load(std::memory_order_acquire);
+            const uint32_t seq = layout_seq_.load(std::memory_order_acquire);
+            if (!ring || (seq & 1)) {
+                return 0;
+            }
+            channels = layout_channels_.load(std::memory_order_relaxed);
+            sample_rate = layout_rate_.load(std::memory_order_relaxed);
+            if (channels == 0) {
+                return 0;
+            }
+            const size_t capacity = capacity_floats / channels;
+
+            end_frame = std::min(end_frame, write_end_.load(std::memory_order_acquire));
+            frames = std::min(frames, out_floats / channels);
+            int64_t start = std::max(end_frame - static_cast<int64_t>(frames), valid_from_.load(std::memory_order_relaxed));
+            if (start >= end_frame || start < 0) {
+                return 0;
+            }
+            const size_t n = static_cast<size_t>(end_frame - start);
+            const size_t first = static_cast<size_t>(start % static_cast<int64_t>(capacity));
+            const size_t head = std::min(n, capacity - first);
+            memcpy(out, ring + first * channels, head * channels * sizeof(float));
+            memcpy(out + head * channels, ring, (n - head) * channels * sizeof(float));
+
+            // Valid only if the writer didn't start overwriting our range or switch layouts meanwhile
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (valid_from_.load(std::memory_order_relaxed) > start || layout_seq_.load(std::memory_order_relaxed) != seq) {
+                return 0;
+            }
+            return n;
+        }
+
+        // Stream position just past the newest frame, -1 before anything was written
+        int64_t write_end() const { return write_end_.load(std::memory_order_acquire); }
+
+        // Channel count of the current stream, for sizing read() buffers
+        unsigned channels() const { return layout_channels_.load(std::memory_order_relaxed); }
+
+    private:
+        std::atomic<bool> requested_{false};
+        std::unique_ptr<float[]> storage_;
+        std::atomic<const float *> buffer_{nullptr};
+
+        // Writer's view of the layout
+        unsigned channels_ = 0;
+        uint32_t sample_rate_ = 0;
+        size_t capacity_frames_ = 0;
+
+        // Published layout, rewritten while layout_seq_ is odd
+        std::atomic<uint32_t> layout_seq_{0};
+        std::atomic<unsigned> layout_channels_{0};
+        std::atomic<uint32_t> layout_rate_{0};
+
+        std::atomic<int64_t> valid_from_{0}; // oldest frame not (being) overwritten
+        std::atomic<int64_t> write_end_{-1};
+    };
+
+    // Latest magnitude spectra, one per quantum, tagged with the presentation time they end at. Written by one
+    // worker, read by any number of visualisers, which then don't each need to run their own FFT.
+    class spectrum_snapshots {
+    public:
+        static constexpr size_t slots = 16;
+        static constexpr size_t max_bins = 512;
+
+        // Writer: start filling the next slot, returns where the magnitudes go
+        float *begin(int64_t pts_end, uint32_t sample_rate, size_t bins) {
+            slot &s = slots_[next_ % slots];
+            s.seq.fetch_add(1, std::memory_order_acq_rel);
+            s.pts_end.store(pts_end, std::memory_order_relaxed);
+            s.sample_rate.store(sample_rate, std::memory_order_relaxed);
+            s.bins.store(static_cast<uint32_t>(std::min(bins, max_bins)), std::memory_order_relaxed);
+            return s.magnitudes;
+        }
+
+        void commit() {
+            slots_[next_ % slots].seq.fetch_add(1, std::memory_order_release);
+            next_++;
+        }
+
+        // Writer: drop everything (flush, format change)
+        void clear() {
+            for (slot &s : slots_) {
+                s.seq.fetch_add(1, std::memory_order_acq_rel);
+                s.pts_end.store(-1, std::memory_order_relaxed);
+                s.seq.fetch_add(1, std::memory_order_release);
+            }
+        }
+
+        // Any thread: the newest spectrum that ends at or before `pts` (what is audible at that time)
+        bool read(int64_t pts, std::vector<float> &magnitudes, uint32_t &sample_rate) const {
+            for (int attempt = 0; attempt < 4; attempt++) {
+                const slot *best = nullptr;
+                int64_t best_pts = -1;
+                for (const slot &s : slots_) {
+                    const int64_t p = s.pts_end.load(std::memory_order_relaxed);
+                    if (p >= 0 && p <= pts && p > best_pts) {
+                        best_pts = p;
+                        best = &s;
+                    }
+                }
+                if (!best) {
+                    return false;
+                }
+                const uint32_t seq = best->seq.load(std::memory_order_acquire);
+                if (seq & 1) {
+                    continue;
+                }
+                const size_t bins = best->bins.load(std::memory_order_relaxed);
+                magnitudes.assign(best->magnitudes, best->magnitudes + bins);
+                sample_rate = best->sample_rate.load(std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (best->seq.load(std::memory_order_relaxed) == seq && best->pts_end.load(std::memory_order_relaxed) == best_pts) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+    private:
+        struct slot {
+            std::atomic<uint32_t> seq{0};
+            std::atomic<int64_t> pts_end{-1};
+            std::atomic<uint32_t> sample_rate{0};
+            std::atomic<uint32_t> bins{0};
+            float magnitudes[max_bins] = {};
+        };
+
+        slot slots_[slots];
+        size_t next_ = 0;
+    };
+} // namespace utils
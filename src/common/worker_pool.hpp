@@ -0,0 +1,211 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+#include "realtime.hpp"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__)
+#include <immintrin.h>
+#define WORKER_POOL_RELAX() _mm_pause()
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define WORKER_POOL_RELAX() __asm__ __volatile__("yield")
+#else
+#define WORKER_POOL_RELAX() std::this_thread::yield()
+#endif
+
+namespace utils
+{
+    // Persistent pool used to split one quantum of work across a few cores.
+    //
+    // Each call to parallel_for() publishes a job, hands every participant (workers + caller) a contiguous
+    // range of task indices and lets idle participants steal from the other ranges. Completion is tracked
+    // with an atomic countdown per job, so nobody ever blocks on a barrier: the caller keeps working until
+    // the countdown hits zero, and workers simply go back to sleep once all ranges are drained.
+    class worker_pool {
+    public:
+        static unsigned default_worker_count() {
+            const unsigned hw = std::thread::hardware_concurrency();
+            // Leave room for the render thread and the UI; more than 4 helpers never paid off for one quantum.
+            return std::clamp(hw > 2 ? hw - 2 : 1u, 1u, 4u);
+        }
+
+        explicit worker_pool(unsigned worker_count = default_worker_count()) : lanes_(worker_count + 1) {
+            workers_.reserve(worker_count);
+            for (unsigned i = 0; i < worker_count; i++) {
+                char name[32];
+                snprintf(name, sizeof(name), "avf-worker-%u", i + 1);
+                rt_thread_stats *stats = rt_stats_registry::instance().acquire(name);
+                stats_.push_back(stats);
+                workers_.emplace_back([this, i, stats] { worker_main(i + 1, stats); });
+            }
+        }
+
+        ~worker_pool() {
+            stopping_.store(true, std::memory_order_release);
+            generation_.fetch_add(2, std::memory_order_acq_rel);
+            generation_.notify_all();
+            for (auto &t : workers_) {
+                t.join();
+            }
+            for (auto *stats : stats_) {
+                rt_stats_registry::instance().release(stats);
+            }
+        }
+
+        worker_pool(const worker_pool &) = delete;
+        worker_pool &operator=(const worker_pool &) = delete;
+
+        // Number of participants in a parallel_for(), the calling thread included
+        unsigned concurrency() const { return static_cast<unsigned>(lanes_.size()); }
+
+        // Workers pick the new time constraint up before their next job
+        void set_realtime(const rt_constraint &c) {
+            if (c.period_ns == constraint_.period_ns && c.computation_ns == constraint_.computation_ns) {
+                return;
+            }
+            constraint_ = c;
+            constraint_generation_.fetch_add(1, std::memory_order_release);
+        }
+
+        // Run fn(task) for task in [0, task_count), returns once every task has finished.
+        // Must only be called from one thread at a time (the output's processing thread).
+        template <typename Fn>
+        void parallel_for(size_t task_count, Fn &&fn) {
+            if (task_count == 0) {
+                return;
+            }
+            if (task_count == 1 || workers_.empty()) {
+                for (size_t i = 0; i < task_count; i++) {
+                    fn(i);
+                }
+                return;
+            }
+
+            job_.invoke = [](void *ctx, size_t task) { (*static_cast<std::remove_reference_t<Fn> *>(ctx))(task); };
+            job_.ctx = &fn;
+
+            const size_t n = lanes_.size();
+            for (size_t i = 0; i < n; i++) {
+                lanes_[i].next.store(task_count * i / n, std::memory_order_relaxed);
+                lanes_[i].end = task_count * (i + 1) / n;
+            }
+            pending_.store(task_count, std::memory_order_relaxed);
+
+            // Open the job (odd generation) and wake the workers
+            generation_.fetch_add(1, std::memory_order_seq_cst);
+            generation_.notify_all();
+
+            run_lanes(0);
+
+            // Spin until the countdown drains; the last completions come from workers finishing their slices
+            while (pending_.load(std::memory_order_acquire) != 0) {
+                WORKER_POOL_RELAX();
+            }
+
+            // Close the job (even generation). A late-waking worker that already got in may still be probing
+            // the drained ranges, so keep the job state alive until it left; later arrivals see it closed.
+            generation_.fetch_add(1, std::memory_order_seq_cst);
+            while (busy_.load(std::memory_order_seq_cst) != 0) {
+                WORKER_POOL_RELAX();
+            }
+        }
+
+    private:
+        struct alignas(64) lane {
+            std::atomic<size_t> next{0};
+            size_t end = 0;
+        };
+
+        struct job {
+            void (*invoke)(void *, size_t) = nullptr;
+            void *ctx = nullptr;
+        };
+
+        // Drain own lane first, then steal from the others in round-robin order
+        void run_lanes(size_t self) {
+            const size_t n = lanes_.size();
+            for (size_t k = 0; k < n; k++) {
+                lane &l = lanes_[(self + k) % n];
+                for (;;) {
+                    const size_t task = l.next.fetch_add(1, std::memory_order_relaxed);
+                    if (task >= l.end) {
+                        break;
+                    }
+                    job_.invoke(job_.ctx, task);
+                    pending_.fetch_sub(1, std::memory_order_acq_rel);
+                }
+            }
+        }
+
+        void worker_main(size_t self, rt_thread_stats *stats) {
+            // Start from the initial generation rather than the current one: a worker that gets scheduled late
+            // must not sleep through a job (or the shutdown) that was published before it ran.
+            uint32_t seen = 0;
+            uint64_t applied_constraint = 0;
+            uint64_t deadline_ns = 0;
+            for (;;) {
+                generation_.wait(seen, std::memory_order_acquire);
+                const uint32_t current = generation_.load(std::memory_order_acquire);
+                if (stopping_.load(std::memory_order_acquire)) {
+                    return;
+                }
+                busy_.fetch_add(1, std::memory_order_seq_cst);
+                // Only touch the job while it is still open; a closed one may already be rewritten by the caller
+                const uint32_t now = generation_.load(std::memory_order_seq_cst);
+                if ((now & 1) && now == current) {
+                    // constraint_ is written by the caller before opening the job, so it is stable here
+                    const uint64_t constraint_generation = constraint_generation_.load(std::memory_order_acquire);
+                    if (constraint_generation != applied_constraint) {
+                        applied_constraint = constraint_generation;
+                        deadline_ns = constraint_.constraint_ns;
+                        const bool granted = apply_realtime_policy(constraint_);
+                        if (stats) {
+                            stats->realtime.store(granted, std::memory_order_relaxed);
+                        }
+                    }
+                    deadline_scope scope(stats, deadline_ns);
+                    run_lanes(self);
+                }
+                busy_.fetch_sub(1, std::memory_order_release);
+                seen = current;
+            }
+        }
+
+        std::vector<lane> lanes_;
+        std::vector<std::thread> workers_;
+        std::vector<rt_thread_stats *> stats_;
+        job job_;
+        rt_constraint constraint_;
+        std::atomic<uint64_t> constraint_generation_{0};
+        alignas(64) std::atomic<size_t> pending_{0};
+        alignas(64) std::atomic<uint32_t> generation_{0}; // odd while a job is open
+        std::atomic<unsigned> busy_{0};
+        std::atomic<bool> stopping_{false};
+    };
+
+    // Decides whether a quantum is worth fanning out. Waking the pool costs a few microseconds, which only
+    // amortizes when there's plenty of samples to chew on, i.e. high channel counts with regular chunk sizes.
+    struct parallel_cost_model {
+        unsigned min_channels = 16;
+        size_t min_samples = 16384;     // channels * frames of the whole quantum
+        size_t samples_per_task = 8192; // keeps each slice well inside L2
+
+        bool should_split(unsigned channels, size_t frames) const {
+            return channels >= min_channels && static_cast<size_t>(channels) * frames >= min_samples;
+        }
+
+        // Split the quantum along frames so every task touches one contiguous interleaved slice
+        size_t frames_per_task(unsigned channels, size_t frames, unsigned concurrency) const {
+            size_t per_task = std::max<size_t>(1, samples_per_task / std::max(1u, channels));
+            // At least one task per participant so stealing has something to balance
+            per_task = std::min(per_task, (frames + concurrency - 1) / std::max(1u, concurrency));
+            return std::max<size_t>(1, per_task);
+        }
+    };
+} // namespace utils
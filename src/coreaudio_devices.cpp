@@ -0,0 +1,238 @@
+//
+//  coreaudio_devices.cpp
+//  foo_out_avfoundation
+//
+//  Output device list from the CoreAudio HAL, with hot-plug and property change notifications
+//
+
+#include "coreaudio_devices.h"
+#include <Block.h>
+#include <CoreAudio/CoreAudio.h>
+#include <dispatch/dispatch.h>
+#include <mutex>
+#include <set>
+#include <vector>
+
+namespace foo_out_avf
+{
+    namespace
+    {
+        AudioObjectPropertyAddress propertyAddress(AudioObjectPropertySelector selector,
+                                                   AudioObjectPropertyScope scope = kAudioObjectPropertyScopeGlobal) {
+            return {selector, scope, kAudioObjectPropertyElementMain};
+        }
+
+        template <typename T>
+        bool getProperty(AudioObjectID object, const AudioObjectPropertyAddress &address, T &value) {
+            UInt32 size = sizeof(T);
+            return AudioObjectGetPropertyData(object, &address, 0, nullptr, &size, &value) == noErr;
+        }
+
+        // Variable-length property, e.g. a list of object ids or an AudioBufferList
+        std::vector<uint8_t> getPropertyBytes(AudioObjectID object, const AudioObjectPropertyAddress &address) {
+            UInt32 size = 0;
+            if (AudioObjectGetPropertyDataSize(object, &address, 0, nullptr, &size) != noErr || size == 0) {
+                return {};
+            }
+            std::vector<uint8_t> bytes(size);
+            if (AudioObjectGetPropertyData(object, &address, 0, nullptr, &size, bytes.data()) != noErr) {
+                return {};
+            }
+            bytes.resize(size);
+            return bytes;
+        }
+
+        std::vector<AudioObjectID> getObjectList(AudioObjectID object, const AudioObjectPropertyAddress &address) {
+            const auto bytes = getPropertyBytes(object, address);
+            std::vector<AudioObjectID> ids(bytes.size() / sizeof(AudioObjectID));
+            memcpy(ids.data(), bytes.data(), ids.size() * sizeof(AudioObjectID));
+            return ids;
+        }
+
+        std::string getString(AudioObjectID object, const AudioObjectPropertyAddress &address) {
+            CFStringRef value = nullptr;
+            if (!getProperty(object, address, value) || value == nullptr) {
+                return {};
+            }
+            std::string result;
+            const CFIndex capacity = CFStringGetMaximumSizeForEncoding(CFStringGetLength(value), kCFStringEncodingUTF8) + 1;
+            std::vector<char> buffer(static_cast<size_t>(capacity));
+            if (CFStringGetCString(value, buffer.data(), capacity, kCFStringEncodingUTF8)) {
+                result = buffer.data();
+            }
+            CFRelease(value);
+            return result;
+        }
+
+        unsigned outputChannels(AudioObjectID device) {
+            const auto bytes =
+                getPropertyBytes(device, propertyAddress(kAudioDevicePropertyStreamConfiguration, kAudioObjectPropertyScopeOutput));
+            if (bytes.size() < sizeof(AudioBufferList)) {
+                return 0;
+            }
+            const auto *list = reinterpret_cast<const AudioBufferList *>(bytes.data());
+            unsigned channels = 0;
+            for (UInt32 i = 0; i < list->mNumberBuffers; i++) {
+                channels += list->mBuffers[i].mNumberChannels;
+            }
+            return channels;
+        }
+
+        // Device-wide properties that change what the output should buffer or report
+        const AudioObjectPropertySelector kWatchedDeviceProperties[] = {
+            kAudioDevicePropertyNominalSampleRate,
+            kAudioDevicePropertyBufferFrameSize,
+            kAudioDevicePropertyLatency,
+            kAudioDevicePropertyStreamConfiguration,
+        };
+
+        // HAL notifications arrive on our own serial queue; each one just asks the registry to re-read the list,
+        // which only counts as a change if something visible actually changed
+        class CoreAudioBackend : public utils::device_backend {
+        public:
+            CoreAudioBackend() {
+                queue = dispatch_queue_create("avf.devices",
+                                              dispatch_queue_attr_make_with_qos_class(DISPATCH_QUEUE_SERIAL, QOS_CLASS_UTILITY, 0));
+                listener = Block_copy(^(UInt32, const AudioObjectPropertyAddress *) {
+                  std::function<void()> notify;
+                  {
+                      std::lock_guard<std::mutex> lock(mutex);
+                      notify = changed;
+                  }
+                  if (notify) {
+                      notify();
+                  }
+                });
+            }
+
+            ~CoreAudioBackend() override {
+                watch(nullptr);
+                // Let notifications already queued finish before the members they use go away
+                dispatch_sync(queue, ^{
+                              });
+                Block_release(listener);
+                dispatch_release(queue);
+            }
+
+            std::vector<utils::output_device> enumerate() override {
+                std::vector<utils::output_device> devices;
+                std::set<AudioObjectID> present;
+                for (const AudioObjectID id : getObjectList(kAudioObjectSystemObject, propertyAddress(kAudioHardwarePropertyDevices))) {
+                    // Input-only devices are watched too, a stream configuration change can turn them into outputs
+                    present.insert(id);
+                    utils::output_device device;
+                    device.channels = outputChannels(id);
+                    if (device.channels == 0) {
+                        continue; // input-only
+                    }
+                    device.uid = getString(id, propertyAddress(kAudioDevicePropertyDeviceUID));
+                    device.name = getString(id, propertyAddress(kAudioObjectPropertyName));
+                    if (device.uid.empty()) {
+                        continue;
+                    }
+
+                    Float64 rate = 0;
+                    getProperty(id, propertyAddress(kAudioDevicePropertyNominalSampleRate), rate);
+                    device.nominal_rate = static_cast<uint32_t>(rate);
+                    UInt32 frames = 0;
+                    getProperty(id, propertyAddress(kAudioDevicePropertyBufferFrameSize), frames);
+                    device.buffer_frames = frames;
+                    frames = 0;
+                    getProperty(id, propertyAddress(kAudioDevicePropertyLatency, kAudioObjectPropertyScopeOutput), frames);
+                    device.latency_frames = frames;
+                    const auto streams = getObjectList(id, propertyAddress(kAudioDevicePropertyStreams, kAudioObjectPropertyScopeOutput));
+                    if (!streams.empty()) {
+                        frames = 0;
+                        getProperty(streams.front(), propertyAddress(kAudioStreamPropertyLatency), frames);
+                        device.latency_frames += frames;
+                    }
+                    frames = 0;
+                    getProperty(id, propertyAddress(kAudioDevicePropertySafetyOffset, kAudioObjectPropertyScopeOutput), frames);
+                    device.safety_frames = frames;
+
+                    devices.push_back(std::move(device));
+                }
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    watchDevices(present);
+                }
+                return devices;
+            }
+
+            std::string default_uid() override {
+                AudioObjectID id = kAudioObjectUnknown;
+                if (!getProperty(kAudioObjectSystemObject, propertyAddress(kAudioHardwarePropertyDefaultOutputDevice), id) ||
+                    id == kAudioObjectUnknown) {
+                    return {};
+                }
+                return getString(id, propertyAddress(kAudioDevicePropertyDeviceUID));
+            }
+
+            void watch(std::function<void()> callback) override {
+                std::lock_guard<std::mutex> lock(mutex);
+                const bool was = static_cast<bool>(changed);
+                changed = std::move(callback);
+                if (changed && !was) {
+                    for (const auto selector : {kAudioHardwarePropertyDevices, kAudioHardwarePropertyDefaultOutputDevice}) {
+                        const auto address = propertyAddress(selector);
+                        AudioObjectAddPropertyListenerBlock(kAudioObjectSystemObject, &address, queue, listener);
+                    }
+                    const auto ids = getObjectList(kAudioObjectSystemObject, propertyAddress(kAudioHardwarePropertyDevices));
+                    watchDevices(std::set<AudioObjectID>(ids.begin(), ids.end()));
+                } else if (!changed && was) {
+                    for (const auto selector : {kAudioHardwarePropertyDevices, kAudioHardwarePropertyDefaultOutputDevice}) {
+                        const auto address = propertyAddress(selector);
+                        AudioObjectRemovePropertyListenerBlock(kAudioObjectSystemObject, &address, queue, listener);
+                    }
+                    for (const AudioObjectID id : watched) {
+                        setDeviceListeners(id, false);
+                    }
+                    watched.clear();
+                }
+            }
+
+        private:
+            // Follow property changes of the devices that exist now, drop devices that went away. Under `mutex`.
+            void watchDevices(const std::set<AudioObjectID> &present) {
+                if (!changed) {
+                    return;
+                }
+                for (auto it = watched.begin(); it != watched.end();) {
+                    if (present.count(*it) == 0) {
+                        setDeviceListeners(*it, false);
+                        it = watched.erase(it);
+                    } else {
+                        ++it;
+                    }
+                }
+                for (const AudioObjectID id : present) {
+                    if (watched.insert(id).second) {
+                        setDeviceListeners(id, true);
+                    }
+                }
+            }
+
+            void setDeviceListeners(AudioObjectID id, bool add) {
+                for (const auto selector : kWatchedDeviceProperties) {
+                    const auto address = propertyAddress(selector, kAudioObjectPropertyScopeWildcard);
+                    if (add) {
+                        AudioObjectAddPropertyListenerBlock(id, &address, queue, listener);
+                    } else {
+                        AudioObjectRemovePropertyListenerBlock(id, &address, queue, listener);
+                    }
+                }
+            }
+
+            dispatch_queue_t queue;
+            AudioObjectPropertyListenerBlock listener;
+            std::mutex mutex;
+            std::function<void()> changed;
+            std::set<AudioObjectID> watched;
+        };
+    } // namespace
+
+    utils::device_registry &deviceRegistry() {
+        static utils::device_registry registry(std::make_unique<CoreAudioBackend>());
+        return registry;
+    }
+} // namespace foo_out_avf
@@ -0,0 +1,18 @@
+//
+//  coreaudio_devices.h
+//  foo_out_avfoundation
+//
+//  Output device list from the CoreAudio HAL, with hot-plug and property change notifications
+//
+
+#pragma once
+
+#include "common/device_registry.hpp"
+
+namespace foo_out_avf
+{
+    // Process-wide registry backed by CoreAudio, created on first use. The list is kept current by HAL
+    // notifications (devices added/removed, default output, rate and buffer size changes), so calling this
+    // from Preferences or output construction never waits on the HAL.
+    utils::device_registry &deviceRegistry();
+} // namespace foo_out_avf
@@ -8,7 +8,30 @@
 #pragma once
 
 #include <span>
+#include <string>
 #include <vector>
+#include <cstdint>
+
+namespace utils
+{
+    class stream_verifier;
+} // namespace utils
+
+namespace foo_out_avf
+{
+    // Counters exported by the engine for diagnostics
+    struct EngineStats {
+        uint64_t stalls = 0;            // renderer stalls detected by the watchdog
+        double lastRecoveryMs = 0;      // time spent rebuilding the renderer for the last stall
+        double maxRecoveryMs = 0;       // worst of the above
+        uint32_t queueHighWater = 0;    // most buffers waiting in the sample queue at once
+        uint32_t retainedHighWater = 0; // most buffers kept for replay at once
+        uint64_t idleReclaims = 0;      // times memory was released after sitting idle
+        uint64_t idleRssBytes = 0;      // resident memory right after the last release
+        double lastResumeMs = 0;        // restoring the idle snapshot until the first buffer reached the renderer
+        uint64_t underruns = 0;         // times the renderer asked for more and the queue was empty
+    };
+} // namespace foo_out_avf
 
 #ifdef __OBJC__
 #import <AVFoundation/AVFoundation.h>
@@ -29,6 +52,10 @@
                channels:(uint32_t)channels
              frameCount:(size_t)frameCount;
 
+// Zero-copy variant: render into feedBufferForFloats, then enqueue that memory as is
+- (float *)feedBufferForFloats:(size_t)floats;
+- (size_t)feedBufferWithSampleRate:(uint32_t)sampleRate channels:(uint32_t)channels frameCount:(size_t)frameCount;
+
 - (void)flush;
 - (void)pause;
 - (void)resume;
@@ -39,6 +66,9 @@
 
 // Sample queue configuration
 - (void)setQueueSize:(uint32_t)size;
+- (void)setTargetBufferDuration:(double)seconds; // 0 falls back to the queue size
+- (void)setOutputDevice:(NSString *)uid;          // CoreAudio device UID, empty for the system default
+- (void)setDeviceBufferFrames:(uint32_t)frames sampleRate:(uint32_t)sampleRate latency:(double)seconds;
 
 // Volume control
 - (void)setVolume:(float)volume;
@@ -48,9 +78,28 @@
 - (void)setListenerPosition:(float)x y:(float)y z:(float)z;
 - (void)setListenerOrientation:(float)yaw pitch:(float)pitch roll:(float)roll;
 - (void)setSourcePosition:(float)x y:(float)y z:(float)z;
+- (void)setStereoSpatialization:(bool)allowed; // system spatial audio for mono/stereo too (macOS 12+), default on
+- (bool)spatializesStereo;                      // whether the renderer may spatialize mono/stereo right now
 
 // Latency calculation
 - (double)getCurrentLatency;
+- (void)setProcessingLatency:(double)seconds; // added by DSP ahead of the engine, reported with the queued audio
+
+// Visualisation - what is audible right now (by synchronizer time); recording starts with the first call
+- (size_t)copyAudibleSamples:(std::vector<float> &)samples
+                      frames:(size_t)frames
+                    channels:(uint32_t *)channels
+                  sampleRate:(uint32_t *)sampleRate;
+- (bool)copyAudibleSpectrum:(std::vector<float> &)magnitudes sampleRate:(uint32_t *)sampleRate;
+
+// Idle memory reclamation - release queued buffers after being paused or starved for `seconds` (0 disables)
+- (void)setIdleReclaimDelay:(double)seconds;
+- (void)setIdleReclaimCallback:(void (*)(void *))callback context:(void *)context;
+
+// Diagnostics
+- (foo_out_avf::EngineStats)stats;
+- (void)setStreamVerifier:(utils::stream_verifier *)verifier; // checks every buffer enqueued, nullptr to stop
+- (int64_t)nextPresentationFrame;                              // timestamp the next fed buffer gets, -1 before setup
 
 // Logging bridge for foobar2000 console
 - (void)setLogCallback:(void (*)(const char *))callback; // Pass nullptr to fallback to NSLog
@@ -80,12 +129,23 @@ namespace foo_out_avf
         bool setupAudioFormat(double sampleRate, int channels);
 
         size_t feedAudioData(std::vector<float>, uint32_t sampleRate, uint32_t channels, size_t sample_count);
+
+        // Memory for at least `floats` samples that feedBuffered enqueues without copying. Valid until the next
+        // feedBuffer call or a successful feedBuffered; after a failed feed it is kept and handed out again.
+        float *feedBuffer(size_t floats);
+        size_t feedBuffered(uint32_t sampleRate, uint32_t channels, size_t sample_count);
         void flush();
         void pause();
         void resume();
 
         // Buffer configuration
         void setQueueSize(uint32_t size);
+        void setTargetBufferDuration(double seconds); // 0 falls back to the queue size
+        // CoreAudio device UID to play on, empty for the system default (see coreaudio_devices.h)
+        void setOutputDevice(const std::string &uid);
+        // Properties of the current device: the queue never runs below two IO buffers, and the output
+        // latency is included in getCurrentLatency() where the synchronizer can't account for it
+        void setDeviceTiming(uint32_t bufferFrames, uint32_t sampleRate, double outputLatency);
         
         // Audio interface status management
         bool enable();
@@ -100,14 +160,36 @@ namespace foo_out_avf
         void setListenerPosition(float x, float y, float z);
         void setListenerOrientation(float yaw, float pitch, float roll);
         void setSourcePosition(float x, float y, float z);
+        // System spatial audio for mono/stereo as well as multichannel (macOS 12+, default on). Headphone DSP
+        // such as crossfeed should stay off while spatializesStereo() is true.
+        void setStereoSpatialization(bool allowed);
+        bool spatializesStereo() const;
 
         // Latency calculation
         double getCurrentLatency() const;
+        void setProcessingLatency(double seconds); // added by DSP ahead of the engine, reported with the queued audio
+
+        // Visualisation: up to `frames` interleaved frames ending at what is audible now, and the newest audible
+        // magnitude spectrum (512 bins up to Nyquist). Recording starts with the first call.
+        size_t copyAudibleSamples(std::vector<float> &samples, size_t frames, uint32_t &channels, uint32_t &sampleRate);
+        bool copyAudibleSpectrum(std::vector<float> &magnitudes, uint32_t &sampleRate);
 
         // Buffer status query
         uint32_t pendingBufferCount() const;
         bool isReadyForMoreMediaData() const;
 
+        // Idle memory reclamation - release queued buffers after being paused or starved for `seconds` (0 disables).
+        // The callback runs on the engine's render queue once the engine released its own memory.
+        void setIdleReclaimDelay(double seconds);
+        void setIdleReclaimCallback(void (*callback)(void *context), void *context);
+
+        // Diagnostics
+        EngineStats getStats() const;
+        // Bit-perfect verification: the engine checks every buffer it enqueues and restarts the verifier on flush.
+        // The verifier must outlive the engine's use of it, i.e. until it is replaced or cleared.
+        void setStreamVerifier(utils::stream_verifier *verifier);
+        int64_t nextPresentationFrame() const; // presentation time the next fed buffer gets, in frames
+
         // Logging bridge for foobar2000 console
         void setLogCallback(void (*callback)(const char *message)); // Pass nullptr to fallback to NSLog
 
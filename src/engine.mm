@@ -13,6 +13,25 @@
 #include <vector>
 #include <queue>
 #include <mutex>
+#include <deque>
+#include <algorithm>
+#include <atomic>
+#include <time.h>
+#include "common/realtime.hpp"
+#include "common/resource_monitor.hpp"
+#include "common/fft.hpp"
+#include "common/vis_tap.hpp"
+#include "common/stream_verifier.hpp"
+
+// Renderer stall watchdog tuning
+static constexpr uint64_t kWatchdogIntervalNs = 250 * NSEC_PER_MSEC;
+static constexpr uint64_t kStallThresholdNs = 1500 * NSEC_PER_MSEC; // no callback and no clock progress for this long
+static constexpr uint64_t kRecoveryBudgetNs = 100 * NSEC_PER_MSEC;  // rebuilding the renderer should stay below this
+
+// Idle memory reclamation
+static constexpr double kDefaultIdleReclaimDelay = 30.0; // seconds paused or starved before memory is released
+
+static inline uint64_t monotonicNs() { return clock_gettime_nsec_np(CLOCK_UPTIME_RAW); }
 
 // Compatibility macros for different macOS versions' 3D audio API
 #ifndef AVAudio3DPointMake
@@ -26,22 +45,89 @@
 
     void (*_logCallback)(const char *);
 
-    AVSampleBufferAudioRenderer *renderer;
+    AVSampleBufferAudioRenderer *renderer; // Replaced by the watchdog on stalls, see activeRenderer
+    std::mutex rendererMutex;
     AVSampleBufferRenderSynchronizer *synchronizer;
     AVAudioFormat *currentFormat;
+    // currentFormat unpacked once per format change (setupAudioFormat), so per-chunk code doesn't message it.
+    // Only the feeding thread touches currentFormat itself; the render queue and latency queries go by the rate.
+    std::atomic<uint32_t> formatSampleRate; // 0 until the first format is set up
+    uint32_t formatChannels;
+    CMAudioFormatDescriptionRef formatDescription; // owned by currentFormat
 
     // Timestamp tracking for continuous audio stream
     CMTime currentPresentationTime; // Current presentation time (base + accumulated offset)
     std::mutex timestampMutex;
+    std::atomic<double> processingLatency; // DSP latency ahead of the engine, see setProcessingLatency
+    std::atomic<double> deviceLatency;     // IO buffer + device + safety offset of the output device
 
     // Sample queue for smooth playback
     std::queue<CMSampleBufferRef> sampleQueue;
     std::mutex sampleQueueMutex;
     uint32_t maxQueueSize;        // Maximum number of buffers in queue
+    double targetBufferSeconds;   // When > 0, the queue is full once it holds this much audio instead
+    double deviceFloorSeconds;    // Never call the queue full below this, from the device's IO buffer size
+    size_t queuedFrames;          // Frames waiting in sampleQueue
+    void *feedBlock;              // Feeding thread: memory handed out by feedBufferForFloats, not enqueued yet
+    size_t feedBlockBytes;
     dispatch_queue_t renderQueue; // Queue for rendering from buffer
 
+    // Buffers handed to the renderer that may not have been played yet, kept to replay after a stall.
+    // Guarded by sampleQueueMutex.
+    std::deque<CMSampleBufferRef> retainedQueue;
+    uint32_t queueHighWater;
+    uint32_t retainedHighWater;
+    uint64_t underruns; // renderer asked for data and the queue was empty
+    bool starving;      // counted once per dry spell, not once per callback
+    utils::stream_verifier *streamVerifier; // bit-perfect check of what gets enqueued, owned by the caller
+    std::atomic<bool> stereoSpatialization;  // allow system spatial audio for mono/stereo, not just multichannel
+
+    // Stall watchdog, runs on renderQueue so it's serialized with renderFromQueue
+    dispatch_source_t watchdogTimer;
+    std::atomic<uint64_t> lastRenderCallbackNs;
+    CMTime lastSynchronizerTime;
+    uint64_t lastSynchronizerChangeNs;
+    foo_out_avf::EngineStats recoveryStats;
+    std::mutex statsMutex;
+    id flushObserver;
+
+    // Idle memory reclamation, checked from the watchdog tick. While reclaimed, the audio that was queued when
+    // pausing lives in one compact block and is turned back into sample buffers on resume.
+    // Chunks keep the format they were queued with, a format change right before pausing leaves both kinds
+    struct IdleChunk {
+        CMTime presentationTime;
+        size_t frames;
+        uint32_t channels;
+        uint32_t sampleRate;
+        id format; // CMAudioFormatDescriptionRef, retained while the snapshot holds it
+    };
+    struct IdleSnapshot {
+        std::vector<float> samples;
+        std::vector<IdleChunk> chunks;
+        CMTime playedTime = kCMTimeInvalid;
+    };
+    IdleSnapshot idleSnapshot;
+    bool idleReclaimed;
+    double idleReclaimDelay;
+    std::atomic<uint64_t> idleSinceNs; // last pause, or last fed buffer while playing
+    uint64_t resumeStartNs;            // set while waiting for the first buffer after restoring a snapshot
+    void (*_idleReclaimCallback)(void *);
+    void *_idleReclaimContext;
+
     bool _isPaused; // Pause state
 
+    utils::rt_thread_stats *renderStats; // Deadline accounting for the render queue callbacks
+
+    // Visualisation: what was enqueued, by PTS, and spectra computed on visQueue so visualisers share one FFT.
+    // Both stay idle until the first copyAudible... call.
+    utils::vis_tap visTap;
+    utils::spectrum_snapshots visSpectra;
+    dispatch_queue_t visQueue;
+    std::atomic<bool> spectrumRequested;
+    std::atomic<bool> spectrumPending;    // one FFT job in flight at most, quanta arriving meanwhile are skipped
+    std::unique_ptr<utils::magnitude_fft> visFft; // visQueue only
+    std::vector<float> visScratch;                // visQueue only
+
     struct VENV {
         AVAudio3DPoint listenerPosition;
         AVAudio3DAngularOrientation listenerOrientation;
@@ -72,9 +158,19 @@
 
         // Initialize timestamps (will be properly set in enable)
         currentPresentationTime = kCMTimeInvalid;
+        processingLatency = 0;
+        feedBlock = NULL;
+        feedBlockBytes = 0;
+        formatSampleRate = 0;
+        formatChannels = 0;
+        formatDescription = NULL;
+        deviceLatency = 0;
+        deviceFloorSeconds = 0;
 
         // Initialize sample queue with larger buffer to reduce glitches
         maxQueueSize = 2;
+        targetBufferSeconds = 0;
+        queuedFrames = 0;
         renderQueue = dispatch_queue_create("avfoundation-render-queue",
                                             dispatch_queue_attr_make_with_qos_class(DISPATCH_QUEUE_SERIAL, QOS_CLASS_USER_INTERACTIVE, 0));
     } else {
@@ -85,12 +181,37 @@
     _isEnabled = false;
     _isPaused = false;
     _logCallback = nullptr;
+    renderStats = utils::rt_stats_registry::instance().acquire("avf-render");
+    watchdogTimer = nil;
+    flushObserver = nil;
+    lastRenderCallbackNs = 0;
+    lastSynchronizerTime = kCMTimeInvalid;
+    lastSynchronizerChangeNs = 0;
+    recoveryStats = {};
+    queueHighWater = 0;
+    retainedHighWater = 0;
+    underruns = 0;
+    starving = false;
+    streamVerifier = nullptr;
+    stereoSpatialization = true;
+    idleReclaimed = false;
+    idleReclaimDelay = kDefaultIdleReclaimDelay;
+    idleSinceNs = monotonicNs();
+    resumeStartNs = 0;
+    _idleReclaimCallback = nullptr;
+    _idleReclaimContext = nullptr;
+
+    visQueue = dispatch_queue_create("avfoundation-vis-queue",
+                                     dispatch_queue_attr_make_with_qos_class(DISPATCH_QUEUE_SERIAL, QOS_CLASS_UTILITY, 0));
+    spectrumRequested = false;
+    spectrumPending = false;
 
     return self;
 }
 
 - (void)dealloc {
     [self disable];
+    [self stopWatchdog];
 
     // Clean up render queue
     if (renderQueue) {
@@ -101,6 +222,14 @@
         delete venv;
         venv = nullptr;
     }
+
+    if (feedBlock) {
+        CFAllocatorDeallocate(kCFAllocatorDefault, feedBlock);
+        feedBlock = NULL;
+    }
+
+    utils::rt_stats_registry::instance().release(renderStats);
+    renderStats = nullptr;
 }
 
 // Sample queue configuration method
@@ -114,6 +243,45 @@
     }
 }
 
+- (void)setTargetBufferDuration:(double)seconds {
+    std::lock_guard<std::mutex> lock(sampleQueueMutex);
+    if (seconds != targetBufferSeconds) {
+        targetBufferSeconds = std::clamp(seconds, 0.0, 2.0);
+        [self logMessage:@"[AVF] Target buffered duration set to %.0f ms", targetBufferSeconds * 1000.0];
+    }
+}
+
+- (void)setOutputDevice:(NSString *)uid {
+    AVSampleBufferAudioRenderer *active = [self activeRenderer];
+    NSString *wanted = uid.length > 0 ? uid : nil;
+    if (active.audioOutputDeviceUniqueID == wanted || [active.audioOutputDeviceUniqueID isEqualToString:wanted]) {
+        return;
+    }
+    active.audioOutputDeviceUniqueID = wanted;
+    [self logMessage:@"[AVF] Output device: %@", wanted ?: @"system default"];
+}
+
+- (void)setDeviceBufferFrames:(uint32_t)frames sampleRate:(uint32_t)sampleRate latency:(double)seconds {
+    deviceLatency.store(std::max(0.0, seconds), std::memory_order_relaxed);
+    std::lock_guard<std::mutex> lock(sampleQueueMutex);
+    // Two IO buffers ahead, so the device never waits for the next enqueue
+    deviceFloorSeconds = sampleRate > 0 ? 2.0 * frames / sampleRate : 0;
+}
+
+// Must hold sampleQueueMutex
+- (bool)isQueueFullLocked {
+    // Buffers are counted too so tiny chunks can't pile up without bound
+    if (sampleQueue.size() >= 64) {
+        return true;
+    }
+    const uint32_t sampleRate = formatSampleRate.load(std::memory_order_relaxed);
+    const double floorFrames = deviceFloorSeconds * sampleRate;
+    if (targetBufferSeconds > 0 && sampleRate > 0) {
+        return queuedFrames >= std::max(targetBufferSeconds * sampleRate, floorFrames);
+    }
+    return sampleQueue.size() >= maxQueueSize && queuedFrames >= floorFrames;
+}
+
 // Helper method for logging to foobar2000 console
 - (void)logMessage:(NSString *)format, ... {
     va_list args;
@@ -137,7 +305,8 @@
 - (bool)setupAudioFormat:(uint32_t)sampleRate channels:(uint32_t)channels {
     if (@available(macOS 11.0, *)) {
 
-        if (sampleRate == currentFormat.sampleRate && channels == currentFormat.channelCount) {
+        // Called for every chunk, the common case must not touch the AVAudioFormat
+        if (sampleRate == formatSampleRate.load(std::memory_order_relaxed) && channels == formatChannels) {
             return true;
         }
 
@@ -171,6 +340,9 @@
         }
 
         currentFormat = audioFormat;
+        formatSampleRate.store(sampleRate, std::memory_order_relaxed);
+        formatChannels = channels;
+        formatDescription = audioFormat.formatDescription;
         return true;
     }
 
@@ -191,7 +363,7 @@
 
     if (@available(macOS 11.0, *)) {
         if (@available(macOS 12.0, *)) {
-            renderer.allowedAudioSpatializationFormats = AVAudioSpatializationFormatMonoStereoAndMultichannel;
+            renderer.allowedAudioSpatializationFormats = [self spatializationFormats];
         }
         [synchronizer setRate:1.0];
         renderer.volume = 1.0;
@@ -206,17 +378,11 @@
         [self flush];
 
         // Start renderer to pull from sample queue
-        __weak typeof(self) weakSelf = self;
-        [renderer requestMediaDataWhenReadyOnQueue:renderQueue
-                                        usingBlock:^{
-                                          __strong typeof(weakSelf) strongSelf = weakSelf;
-                                          if (strongSelf) {
-                                              [strongSelf renderFromQueue];
-                                          }
-                                        }];
+        [self attachRenderer:renderer];
 
         _isPaused = false;
         _isEnabled = true;
+        [self startWatchdog];
         [self logMessage:@"[AVF] Audio engine enabled successfully using sample buffer renderer"];
         return true;
     }
@@ -231,8 +397,10 @@
     }
 
     if (@available(macOS 11.0, *)) {
+        [self stopWatchdog];
+
         // Stop requesting data from renderer
-        [renderer stopRequestingMediaData];
+        [[self activeRenderer] stopRequestingMediaData];
 
         if (synchronizer != nil) {
             [synchronizer setRate:0.0];
@@ -254,6 +422,7 @@
     }
 
     _isPaused = true;
+    idleSinceNs = monotonicNs();
 
     if (@available(macOS 11.0, *)) {
         // Stop the synchronizer to pause playback, but keep all buffers in queue
@@ -269,8 +438,23 @@
     }
 
     if (@available(macOS 11.0, *)) {
-        // Resume the synchronizer to continue playback
-        [synchronizer setRate:1.0];
+        // Bring back what was queued before the pause if it was reclaimed meanwhile.
+        // Runs on the render queue so it can't interleave with a reclaim from the watchdog tick.
+        __block CMTime resumeTime = kCMTimeInvalid;
+        dispatch_sync(renderQueue, ^{
+          idleSinceNs = monotonicNs();
+          if (idleReclaimed) {
+              resumeTime = [self restoreIdleSnapshot];
+          }
+        });
+
+        // Resume the synchronizer to continue playback, the time spent paused doesn't count as a stall
+        lastRenderCallbackNs = monotonicNs();
+        if (CMTIME_IS_VALID(resumeTime)) {
+            [synchronizer setRate:1.0 time:resumeTime];
+        } else {
+            [synchronizer setRate:1.0];
+        }
         [self logMessage:@"[AVF] Resumed audio playback"];
     }
     _isPaused = false;
@@ -282,36 +466,301 @@
         return;
     }
 
+    lastRenderCallbackNs.store(monotonicNs(), std::memory_order_relaxed);
+
+    // Playing again after starving for a while, nothing was kept so just rearm the reclaim
+    if (idleReclaimed) {
+        idleReclaimed = false;
+        idleSnapshot = IdleSnapshot{};
+    }
+
     CMSampleBufferRef sampleBuffer = NULL;
+    const CMTime playedTime = [synchronizer currentTime];
+    int64_t mismatchFrame = -1;
 
     // Get sample buffer from queue
     {
         std::lock_guard<std::mutex> lock(sampleQueueMutex);
+
+        // Forget what has been played already
+        while (!retainedQueue.empty()) {
+            CMSampleBufferRef oldest = retainedQueue.front();
+            const CMTime end = CMTimeAdd(CMSampleBufferGetPresentationTimeStamp(oldest), CMSampleBufferGetDuration(oldest));
+            if (CMTIME_IS_VALID(playedTime) && CMTimeCompare(end, playedTime) > 0) {
+                break;
+            }
+            retainedQueue.pop_front();
+            CFRelease(oldest);
+        }
+
         if (sampleQueue.empty()) {
             // No data available, AVFoundation will call us again when ready
+            if (!starving) {
+                starving = true;
+                underruns++;
+            }
             return;
         }
+        starving = false;
 
         sampleBuffer = sampleQueue.front();
         sampleQueue.pop();
+        queuedFrames -= std::min(queuedFrames, static_cast<size_t>(CMSampleBufferGetNumSamples(sampleBuffer)));
+
+        // Keep a reference until it's audible, the watchdog replays from here after a stall
+        CFRetain(sampleBuffer);
+        retainedQueue.push_back(sampleBuffer);
+        retainedHighWater = std::max(retainedHighWater, static_cast<uint32_t>(retainedQueue.size()));
+
+        // Checked under the lock so a flush can't slip in between taking the buffer and hashing it
+        if (streamVerifier && [self verifyBuffer:sampleBuffer] > 0) {
+            mismatchFrame = streamVerifier->last_mismatch_frame();
+        }
+    }
+
+    if (mismatchFrame >= 0) {
+        [self logMessage:@"[AVF] Bit-perfect check failed: frames %lld-%lld differ from what entered the output",
+                         (long long)mismatchFrame,
+                         (long long)(mismatchFrame + utils::stream_verifier::window_frames - 1)];
     }
 
     if (@available(macOS 11.0, *)) {
-        [renderer enqueueSampleBuffer:sampleBuffer];
+        // The renderer wants the buffer back well before the previous one runs out
+        const auto frames = static_cast<size_t>(CMSampleBufferGetNumSamples(sampleBuffer));
+        const auto budget = utils::rt_constraint::for_quantum(frames, formatSampleRate.load(std::memory_order_relaxed));
+        utils::deadline_scope deadline(renderStats, budget.computation_ns);
+
+        [[self activeRenderer] enqueueSampleBuffer:sampleBuffer];
         CFRelease(sampleBuffer);
+
+        if (resumeStartNs != 0) {
+            const double elapsedMs = (monotonicNs() - resumeStartNs) / 1e6;
+            resumeStartNs = 0;
+            std::lock_guard<std::mutex> lock(statsMutex);
+            recoveryStats.lastResumeMs = elapsedMs;
+        }
     }
 }
 
+// Render queue, under sampleQueueMutex. Returns the number of mismatching windows completed by this buffer.
+- (size_t)verifyBuffer:(CMSampleBufferRef)buffer {
+    const AudioStreamBasicDescription *asbd =
+        CMAudioFormatDescriptionGetStreamBasicDescription(CMSampleBufferGetFormatDescription(buffer));
+    char *data = nullptr;
+    size_t length = 0;
+    if (!asbd || asbd->mChannelsPerFrame == 0 ||
+        CMBlockBufferGetDataPointer(CMSampleBufferGetDataBuffer(buffer), 0, nullptr, &length, &data) != kCMBlockBufferNoErr) {
+        return 0;
+    }
+    const int32_t sampleRate = static_cast<int32_t>(asbd->mSampleRate);
+    const int64_t firstFrame =
+        CMTimeConvertScale(CMSampleBufferGetPresentationTimeStamp(buffer), sampleRate, kCMTimeRoundingMethod_RoundHalfAwayFromZero).value;
+    const size_t frames = length / (sizeof(float) * asbd->mChannelsPerFrame);
+    return streamVerifier->verify(firstFrame, reinterpret_cast<const float *>(data), frames, asbd->mChannelsPerFrame);
+}
+
+- (AVAudioSpatializationFormats)spatializationFormats API_AVAILABLE(macos(12.0)) {
+    return stereoSpatialization ? AVAudioSpatializationFormatMonoStereoAndMultichannel : AVAudioSpatializationFormatMultichannel;
+}
+
+- (void)setStereoSpatialization:(bool)allowed {
+    if (stereoSpatialization.exchange(allowed) == allowed) {
+        return;
+    }
+    if (@available(macOS 12.0, *)) {
+        [self activeRenderer].allowedAudioSpatializationFormats = [self spatializationFormats];
+    }
+    [self logMessage:@"[AVF] Stereo spatialization %s", allowed ? "allowed" : "off"];
+}
+
+// What the renderer is actually set to, a stall recovery copies it over to the fresh renderer
+- (bool)spatializesStereo {
+    if (@available(macOS 12.0, *)) {
+        return ([self activeRenderer].allowedAudioSpatializationFormats & AVAudioSpatializationFormatMonoAndStereo) != 0;
+    }
+    return false;
+}
+
+- (void)setStreamVerifier:(utils::stream_verifier *)verifier {
+    std::lock_guard<std::mutex> lock(sampleQueueMutex);
+    streamVerifier = verifier;
+}
+
+- (int64_t)nextPresentationFrame {
+    std::lock_guard<std::mutex> lock(timestampMutex);
+    const int32_t sampleRate = static_cast<int32_t>(formatSampleRate.load(std::memory_order_relaxed));
+    if (sampleRate == 0 || !CMTIME_IS_NUMERIC(currentPresentationTime)) {
+        return -1;
+    }
+    return CMTimeConvertScale(currentPresentationTime, sampleRate, kCMTimeRoundingMethod_RoundHalfAwayFromZero).value;
+}
+
+// Wraps a copy of interleaved float32 frames into a CMSampleBuffer in the current format
+- (CMSampleBufferRef)createSampleBuffer:(const float *)samples frames:(size_t)frameCount presentationTime:(CMTime)presentationTime {
+    return [self createSampleBuffer:samples
+                             frames:frameCount
+                   presentationTime:presentationTime
+                             format:formatDescription
+                           channels:formatChannels
+                         sampleRate:formatSampleRate.load(std::memory_order_relaxed)];
+}
+
+- (CMSampleBufferRef)createSampleBuffer:(const float *)samples
+                                 frames:(size_t)frameCount
+                       presentationTime:(CMTime)presentationTime
+                                 format:(CMAudioFormatDescriptionRef)format
+                               channels:(uint32_t)channels
+                             sampleRate:(uint32_t)sampleRate {
+    const size_t dataSize = sizeof(float) * channels * frameCount;
+
+    // Allocate memory using CFAllocator
+    void *data = CFAllocatorAllocate(kCFAllocatorDefault, dataSize, 0);
+    if (!data) {
+        [self logMessage:@"[AVF] Failed to allocate memory for audio data"];
+        return NULL;
+    }
+
+    // Copy audio data
+    memcpy(data, samples, dataSize);
+    return [self wrapSampleBlock:data
+                        capacity:dataSize
+                          frames:frameCount
+                presentationTime:presentationTime
+                          format:format
+                        channels:channels
+                      sampleRate:sampleRate];
+}
+
+// Takes ownership of `block` (from kCFAllocatorDefault), also on failure
+- (CMSampleBufferRef)wrapSampleBlock:(void *)data
+                            capacity:(size_t)capacity
+                              frames:(size_t)frameCount
+                    presentationTime:(CMTime)presentationTime {
+    return [self wrapSampleBlock:data
+                        capacity:capacity
+                          frames:frameCount
+                presentationTime:presentationTime
+                          format:formatDescription
+                        channels:formatChannels
+                      sampleRate:formatSampleRate.load(std::memory_order_relaxed)];
+}
+
+- (CMSampleBufferRef)wrapSampleBlock:(void *)data
+                            capacity:(size_t)capacity
+                              frames:(size_t)frameCount
+                    presentationTime:(CMTime)presentationTime
+                              format:(CMAudioFormatDescriptionRef)format
+                            channels:(uint32_t)channels
+                          sampleRate:(uint32_t)sampleRate {
+    CMBlockBufferRef blockBuffer = NULL;
+    CMSampleBufferRef sampleBuffer = NULL;
+    OSStatus status;
+
+    const size_t bytesPerFrame = sizeof(float) * channels;
+    const size_t dataSize = bytesPerFrame * frameCount;
+
+    // Create CMBlockBuffer
+    status = CMBlockBufferCreateWithMemoryBlock(kCFAllocatorDefault,
+                                                data,
+                                                capacity,
+                                                kCFAllocatorDefault, // CFAllocator will manage the memory
+                                                NULL,
+                                                0,
+                                                dataSize,
+                                                0,
+                                                &blockBuffer);
+    if (status != noErr) {
+        CFAllocatorDeallocate(kCFAllocatorDefault, data);
+        [self logMessage:@"[AVF] Failed to create block buffer: %d", (int)status];
+        return NULL;
+    }
+
+    CMSampleTimingInfo sampleTimingInfo[] = {
+        (CMSampleTimingInfo){
+                             .duration = CMTimeMake(1, sampleRate),
+                             .presentationTimeStamp = presentationTime,
+                             .decodeTimeStamp = kCMTimeInvalid}
+    };
+    size_t sampleSizeArray[] = {bytesPerFrame};
+
+    // Create sample buffer
+    status = CMSampleBufferCreateReady(kCFAllocatorDefault,
+                                       blockBuffer,
+                                       format,
+                                       frameCount,
+                                       1,
+                                       sampleTimingInfo,
+                                       1,
+                                       sampleSizeArray,
+                                       &sampleBuffer);
+
+    CFRelease(blockBuffer);
+
+    if (status != noErr || sampleBuffer == NULL) {
+        [self logMessage:@"[AVF] Failed to create sample buffer: %d", (int)status];
+        return NULL;
+    }
+    return sampleBuffer;
+}
+
 // Method that accepts interleaved float32 data and creates CMSampleBuffer
 - (size_t)feedAudioData:(std::vector<float>)audioData
              sampleRate:(uint32_t)sampleRate
                channels:(uint32_t)channels
              frameCount:(size_t)frameCount {
+    if (audioData.size() != frameCount * channels) {
+        [self logMessage:@"[AVF] Data size mismatch: expected %zu, got %zu",
+                         frameCount * channels * sizeof(float),
+                         audioData.size() * sizeof(float)];
+        return 0;
+    }
+    return [self feedFrames:audioData.data() ownedBlock:NULL capacity:0 sampleRate:sampleRate channels:channels frameCount:frameCount];
+}
+
+// Feeding thread: memory the caller renders straight into, enqueued by feedBufferWithSampleRate without a copy.
+// Stays ours (and is reused) until a feed succeeds.
+- (float *)feedBufferForFloats:(size_t)floats {
+    const size_t bytes = floats * sizeof(float);
+    if (bytes > feedBlockBytes) {
+        if (feedBlock) {
+            CFAllocatorDeallocate(kCFAllocatorDefault, feedBlock);
+        }
+        feedBlock = CFAllocatorAllocate(kCFAllocatorDefault, bytes, 0);
+        feedBlockBytes = feedBlock ? bytes : 0;
+    }
+    return static_cast<float *>(feedBlock);
+}
+
+- (size_t)feedBufferWithSampleRate:(uint32_t)sampleRate channels:(uint32_t)channels frameCount:(size_t)frameCount {
+    if (!feedBlock || frameCount * channels * sizeof(float) > feedBlockBytes) {
+        [self logMessage:@"[AVF] Feed buffer missing or too small"];
+        return 0;
+    }
+    const size_t fed = [self feedFrames:static_cast<const float *>(feedBlock)
+                             ownedBlock:&feedBlock
+                               capacity:feedBlockBytes
+                             sampleRate:sampleRate
+                               channels:channels
+                             frameCount:frameCount];
+    if (!feedBlock) {
+        feedBlockBytes = 0;
+    }
+    return fed;
+}
+
+// `block` non-null: `data` lives in *block, which is handed over to the sample buffer instead of copied and
+// cleared once it is no longer the caller's
+- (size_t)feedFrames:(const float *)data
+          ownedBlock:(void **)block
+            capacity:(size_t)capacity
+          sampleRate:(uint32_t)sampleRate
+            channels:(uint32_t)channels
+          frameCount:(size_t)frameCount {
     if (!_isEnabled || _isPaused) {
         return 0;
     }
 
-    if (audioData.size() == 0 || frameCount == 0 || channels == 0) {
+    if (frameCount == 0 || channels == 0) {
         [self logMessage:@"[AVF] Invalid audio data parameters"];
         return 0;
     }
@@ -324,53 +773,12 @@
         // Check if sample queue has space
         {
             std::lock_guard<std::mutex> lock(sampleQueueMutex);
-            if (sampleQueue.size() >= maxQueueSize) {
+            if ([self isQueueFullLocked]) {
                 // Sample queue is full, return 0 to indicate no samples were processed
                 return 0;
             }
         }
 
-        // Create CMSampleBuffer
-        CMBlockBufferRef blockBuffer = NULL;
-        CMSampleBufferRef sampleBuffer = NULL;
-        OSStatus status;
-
-        size_t bytesPerFrame = sizeof(decltype(audioData)::value_type) * channels;
-        size_t dataSize = sizeof(decltype(audioData)::value_type) * audioData.size();
-
-        // Validate data size matches expected frame count
-        size_t expectedDataSize = bytesPerFrame * frameCount;
-        if (dataSize != expectedDataSize) {
-            [self logMessage:@"[AVF] Data size mismatch: expected %zu, got %zu", expectedDataSize, dataSize];
-            return 0;
-        }
-
-        // Allocate memory using CFAllocator
-        void *data = CFAllocatorAllocate(kCFAllocatorDefault, dataSize, 0);
-        if (!data) {
-            [self logMessage:@"[AVF] Failed to allocate memory for audio data"];
-            return 0;
-        }
-
-        // Copy audio data
-        memcpy(data, audioData.data(), dataSize);
-
-        // Create CMBlockBuffer
-        status = CMBlockBufferCreateWithMemoryBlock(kCFAllocatorDefault,
-                                                    data,
-                                                    dataSize,
-                                                    kCFAllocatorDefault, // CFAllocator will manage the memory
-                                                    NULL,
-                                                    0,
-                                                    dataSize,
-                                                    0,
-                                                    &blockBuffer);
-        if (status != noErr) {
-            CFAllocatorDeallocate(kCFAllocatorDefault, data);
-            [self logMessage:@"[AVF] Failed to create block buffer: %d", (int)status];
-            return 0;
-        }
-
         // Calculate frame duration for timing info
         CMTime nextDuration = CMTimeMake(frameCount, sampleRate);
 
@@ -392,40 +800,37 @@
                 sampleRate,
                 CMTimeGetSeconds(nextDuration),
                 CMTimeGetSeconds(presentationTime),
-                bytesPerFrame,
-                dataSize];
+                sizeof(float) * channels,
+                sizeof(float) * channels * frameCount];
 */
-        CMSampleTimingInfo sampleTimingInfo[] = {
-            (CMSampleTimingInfo){
-                                 .duration = CMTimeMake(1, sampleRate), .presentationTimeStamp = presentationTime, .decodeTimeStamp = kCMTimeInvalid}
-        };
-        size_t sampleSizeArray[] = {bytesPerFrame};
-
-        // Create sample buffer
-        status = CMSampleBufferCreateReady(kCFAllocatorDefault,
-                                           blockBuffer,
-                                           currentFormat.formatDescription,
-                                           frameCount,
-                                           1,
-                                           sampleTimingInfo,
-                                           1,
-                                           sampleSizeArray,
-                                           &sampleBuffer);
-
-        CFRelease(blockBuffer);
-
-        if (status == noErr && sampleBuffer != NULL) {
+        CMSampleBufferRef sampleBuffer = NULL;
+        if (block) {
+            // Handed over even if wrapping fails, the sample buffer (or the failure path) frees it
+            void *owned = *block;
+            *block = NULL;
+            sampleBuffer = [self wrapSampleBlock:owned capacity:capacity frames:frameCount presentationTime:presentationTime];
+        } else {
+            sampleBuffer = [self createSampleBuffer:data frames:frameCount presentationTime:presentationTime];
+        }
+
+        idleSinceNs.store(monotonicNs(), std::memory_order_relaxed);
+
+        if (sampleBuffer != NULL) {
+            // Before the push: once queued, handed-over memory can be played and released under us
+            [self tapForVisualisation:data frames:frameCount presentationTime:presentationTime];
+
             // Add to sample queue instead of directly enqueueing
             {
                 std::lock_guard<std::mutex> lock(sampleQueueMutex);
                 sampleQueue.push(sampleBuffer);
+                queuedFrames += frameCount;
+                queueHighWater = std::max(queueHighWater, static_cast<uint32_t>(sampleQueue.size()));
                 // Don't CFRelease here - queue owns the reference
             }
 
             // Buffer successfully added to queue
             return frameCount;
         } else {
-            [self logMessage:@"[AVF] Failed to create sample buffer: %d", (int)status];
             return 0;
         }
     }
@@ -435,11 +840,98 @@
     return 0;
 }
 
+// Feeding thread, for every buffer that made it into the queue
+- (void)tapForVisualisation:(const float *)data frames:(size_t)frameCount presentationTime:(CMTime)presentationTime {
+    if (!visTap.enabled()) {
+        return;
+    }
+    const uint32_t sampleRate = formatSampleRate.load(std::memory_order_relaxed);
+    const uint32_t channels = formatChannels;
+    const int64_t ptsFrame = CMTimeConvertScale(presentationTime, sampleRate, kCMTimeRoundingMethod_RoundHalfAwayFromZero).value;
+    visTap.write(ptsFrame, data, frameCount, channels, sampleRate);
+
+    if (spectrumRequested.load(std::memory_order_relaxed) && !spectrumPending.exchange(true, std::memory_order_acq_rel)) {
+        const int64_t ptsEnd = ptsFrame + static_cast<int64_t>(frameCount);
+        dispatch_async(visQueue, ^{
+          [self computeSpectrumEndingAt:ptsEnd];
+          spectrumPending.store(false, std::memory_order_release);
+        });
+    }
+}
+
+// visQueue: mono downmix of the newest window of the quantum, published as one snapshot
+- (void)computeSpectrumEndingAt:(int64_t)ptsEnd {
+    if (!visFft) {
+        visFft = std::make_unique<utils::magnitude_fft>(2 * utils::spectrum_snapshots::max_bins);
+    }
+    const size_t window = visFft->size();
+    unsigned channels = 0;
+    uint32_t sampleRate = 0;
+    visScratch.resize(window * std::max(1u, visTap.channels()));
+    const size_t frames = visTap.read(ptsEnd, window, visScratch.data(), visScratch.size(), channels, sampleRate);
+    if (frames < window) {
+        return;
+    }
+    for (size_t i = 0; i < window; i++) {
+        float sum = 0;
+        for (unsigned c = 0; c < channels; c++) {
+            sum += visScratch[i * channels + c];
+        }
+        visScratch[i] = sum / channels;
+    }
+    visFft->compute(visScratch.data(), visSpectra.begin(ptsEnd, sampleRate, visFft->bins()));
+    visSpectra.commit();
+}
+
+// Tap position being played right now: the newest frame minus whatever is still buffered. Counted back from the
+// feeding side because the synchronizer keeps running across flushes while our timeline restarts at zero.
+- (int64_t)audibleFrame {
+    const int64_t fedEnd = visTap.write_end();
+    const uint32_t sampleRate = formatSampleRate.load(std::memory_order_relaxed);
+    if (!_isEnabled || sampleRate == 0 || fedEnd < 0) {
+        return -1;
+    }
+    return fedEnd - llround([self bufferedSeconds] * sampleRate);
+}
+
+- (size_t)copyAudibleSamples:(std::vector<float> &)samples
+                      frames:(size_t)frames
+                    channels:(uint32_t *)channels
+                  sampleRate:(uint32_t *)sampleRate {
+    visTap.enable();
+    const int64_t now = [self audibleFrame];
+    const unsigned layoutChannels = visTap.channels();
+    if (now < 0 || layoutChannels == 0) {
+        return 0;
+    }
+    samples.resize(frames * layoutChannels);
+    unsigned tapChannels = 0;
+    uint32_t tapRate = 0;
+    const size_t copied = visTap.read(now, frames, samples.data(), samples.size(), tapChannels, tapRate);
+    samples.resize(copied * tapChannels);
+    *channels = tapChannels;
+    *sampleRate = tapRate;
+    return copied;
+}
+
+- (bool)copyAudibleSpectrum:(std::vector<float> &)magnitudes sampleRate:(uint32_t *)sampleRate {
+    visTap.enable();
+    spectrumRequested.store(true, std::memory_order_relaxed);
+    const int64_t now = [self audibleFrame];
+    return now >= 0 && visSpectra.read(now, magnitudes, *sampleRate);
+}
+
 - (void)flush {
     if (!_isEnabled) {
         return;
     }
 
+    // The timeline restarts, so do the visualisation history and any spectrum still pending
+    visTap.reset();
+    dispatch_async(visQueue, ^{
+      visSpectra.clear();
+    });
+
     if (@available(macOS 11.0, *)) {
 
         // Clear sample queue
@@ -450,8 +942,24 @@
                 sampleQueue.pop();
                 CFRelease(buffer);
             }
+            queuedFrames = 0;
+            for (CMSampleBufferRef buffer : retainedQueue) {
+                CFRelease(buffer);
+            }
+            retainedQueue.clear();
+            if (streamVerifier) {
+                streamVerifier->restart();
+            }
         }
 
+        // Whatever was kept while idle is stale now
+        dispatch_async(renderQueue, ^{
+          if (idleReclaimed) {
+              idleReclaimed = false;
+              idleSnapshot = IdleSnapshot{};
+          }
+        });
+
         // Reset timestamp for next audio data
         {
             std::lock_guard<std::mutex> lock(timestampMutex);
@@ -459,35 +967,402 @@
         }
 
         // Flush AVFoundation renderer
-        if (renderer != nil) {
-            [renderer flush];
+        AVSampleBufferAudioRenderer *active = [self activeRenderer];
+        if (active != nil) {
+            [active flush];
         }
+        lastRenderCallbackNs = monotonicNs();
     }
 }
 
 - (void)setVolume:(float)volume {
 
     // Set volume on spatial renderer if available (macOS 11.0+)
-    if (renderer != nil) {
+    AVSampleBufferAudioRenderer *active = [self activeRenderer];
+    if (active != nil) {
         if (@available(macOS 11.0, *)) {
-            renderer.volume = volume;
+            active.volume = volume;
         }
     }
 }
 
 - (float)getVolume {
-    if (!renderer) {
+    AVSampleBufferAudioRenderer *active = [self activeRenderer];
+    if (!active) {
         return 0.0f;
     }
-    return renderer.volume;
+    return active.volume;
+}
+
+- (foo_out_avf::EngineStats)stats {
+    foo_out_avf::EngineStats result;
+    {
+        std::lock_guard<std::mutex> lock(statsMutex);
+        result = recoveryStats;
+    }
+    {
+        std::lock_guard<std::mutex> lock(sampleQueueMutex);
+        result.queueHighWater = queueHighWater;
+        result.retainedHighWater = retainedHighWater;
+        result.underruns = underruns;
+    }
+    return result;
+}
+
+// Renderer stall watchdog
+
+- (AVSampleBufferAudioRenderer *)activeRenderer {
+    std::lock_guard<std::mutex> lock(rendererMutex);
+    return renderer;
+}
+
+// Let the renderer pull from the sample queue and follow its automatic flushes (route / config changes)
+- (void)attachRenderer:(AVSampleBufferAudioRenderer *)target {
+    __weak typeof(self) weakSelf = self;
+    [target requestMediaDataWhenReadyOnQueue:renderQueue
+                                  usingBlock:^{
+                                    __strong typeof(weakSelf) strongSelf = weakSelf;
+                                    if (strongSelf) {
+                                        [strongSelf renderFromQueue];
+                                    }
+                                  }];
+
+    if (flushObserver) {
+        [[NSNotificationCenter defaultCenter] removeObserver:flushObserver];
+    }
+    flushObserver = [[NSNotificationCenter defaultCenter]
+        addObserverForName:AVSampleBufferAudioRendererWasFlushedAutomaticallyNotification
+                    object:target
+                     queue:nil
+                usingBlock:^(NSNotification *note) {
+                  NSValue *flushTime = note.userInfo[AVSampleBufferAudioRendererFlushTimeKey];
+                  const CMTime from = flushTime ? flushTime.CMTimeValue : kCMTimeInvalid;
+                  __strong typeof(weakSelf) strongSelf = weakSelf;
+                  if (strongSelf) {
+                      dispatch_async(strongSelf->renderQueue, ^{
+                        [strongSelf replayRetainedFrom:from into:[strongSelf activeRenderer]];
+                      });
+                  }
+                }];
+}
+
+// Hand every retained buffer that is still (partially) ahead of `from` to the renderer again
+- (void)replayRetainedFrom:(CMTime)from into:(AVSampleBufferAudioRenderer *)target {
+    std::vector<CMSampleBufferRef> replay;
+    {
+        std::lock_guard<std::mutex> lock(sampleQueueMutex);
+        replay.reserve(retainedQueue.size());
+        for (CMSampleBufferRef buffer : retainedQueue) {
+            const CMTime end = CMTimeAdd(CMSampleBufferGetPresentationTimeStamp(buffer), CMSampleBufferGetDuration(buffer));
+            if (!CMTIME_IS_VALID(from) || CMTimeCompare(end, from) > 0) {
+                CFRetain(buffer);
+                replay.push_back(buffer);
+            }
+        }
+    }
+    for (CMSampleBufferRef buffer : replay) {
+        [target enqueueSampleBuffer:buffer];
+        CFRelease(buffer);
+    }
+    if (!replay.empty()) {
+        [self logMessage:@"[AVF] Replayed %zu buffers from %.3f s", replay.size(), CMTimeGetSeconds(from)];
+    }
+}
+
+- (void)startWatchdog {
+    lastRenderCallbackNs = monotonicNs();
+    lastSynchronizerTime = kCMTimeInvalid;
+    lastSynchronizerChangeNs = monotonicNs();
+
+    watchdogTimer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, renderQueue);
+    dispatch_source_set_timer(watchdogTimer,
+                              dispatch_time(DISPATCH_TIME_NOW, kWatchdogIntervalNs),
+                              kWatchdogIntervalNs,
+                              kWatchdogIntervalNs / 4);
+    __weak typeof(self) weakSelf = self;
+    dispatch_source_set_event_handler(watchdogTimer, ^{
+      __strong typeof(weakSelf) strongSelf = weakSelf;
+      if (strongSelf) {
+          [strongSelf watchdogTick];
+      }
+    });
+    dispatch_resume(watchdogTimer);
+}
+
+- (void)stopWatchdog {
+    if (watchdogTimer) {
+        dispatch_source_cancel(watchdogTimer);
+        watchdogTimer = nil;
+    }
+    if (flushObserver) {
+        [[NSNotificationCenter defaultCenter] removeObserver:flushObserver];
+        flushObserver = nil;
+    }
+}
+
+// A stalled consumer: we have data waiting, yet the renderer neither asked for more nor advanced the clock
+- (void)watchdogTick {
+    if (!_isEnabled) {
+        return;
+    }
+
+    const uint64_t now = monotonicNs();
+    if (!idleReclaimed && idleReclaimDelay > 0 && now - idleSinceNs.load(std::memory_order_relaxed) > idleReclaimDelay * NSEC_PER_SEC) {
+        bool starved;
+        {
+            std::lock_guard<std::mutex> lock(sampleQueueMutex);
+            starved = sampleQueue.empty();
+        }
+        if (_isPaused || starved) {
+            [self reclaimIdleMemory];
+        }
+    }
+
+    if (_isPaused) {
+        return;
+    }
+
+    const CMTime syncTime = [synchronizer currentTime];
+    if (!CMTIME_IS_VALID(lastSynchronizerTime) || CMTimeCompare(syncTime, lastSynchronizerTime) != 0) {
+        lastSynchronizerTime = syncTime;
+        lastSynchronizerChangeNs = now;
+    }
+
+    bool hasPending;
+    {
+        std::lock_guard<std::mutex> lock(sampleQueueMutex);
+        hasPending = !sampleQueue.empty();
+    }
+
+    AVSampleBufferAudioRenderer *active = [self activeRenderer];
+    const bool failed = active.status == AVQueuedSampleBufferRenderingStatusFailed;
+    const bool starved = now - lastRenderCallbackNs.load(std::memory_order_relaxed) > kStallThresholdNs;
+    const bool frozen = now - lastSynchronizerChangeNs > kStallThresholdNs;
+
+    if (failed || (hasPending && starved && frozen)) {
+        if (failed) {
+            [self logMessage:@"[AVF] Renderer failed: %@", active.error.localizedDescription];
+        } else {
+            [self logMessage:@"[AVF] Renderer stalled at %.3f s", CMTimeGetSeconds(syncTime)];
+        }
+        [self recoverRendererAtTime:syncTime];
+    }
+}
+
+// Idle memory reclamation
+
+- (void)setIdleReclaimDelay:(double)seconds {
+    dispatch_async(renderQueue, ^{
+      idleReclaimDelay = std::max(0.0, seconds);
+    });
+}
+
+- (void)setIdleReclaimCallback:(void (*)(void *))callback context:(void *)context {
+    dispatch_sync(renderQueue, ^{
+      _idleReclaimCallback = callback;
+      _idleReclaimContext = context;
+    });
+}
+
+// Move whatever is still unplayed into one compact block, then drop every sample buffer and the
+// renderer's own queue. Called on the render queue.
+- (void)reclaimIdleMemory {
+    const CMTime playedTime = [synchronizer currentTime];
+    size_t released = 0;
+    {
+        std::lock_guard<std::mutex> lock(sampleQueueMutex);
+
+        std::vector<CMSampleBufferRef> pending;
+        for (CMSampleBufferRef buffer : retainedQueue) {
+            const CMTime end = CMTimeAdd(CMSampleBufferGetPresentationTimeStamp(buffer), CMSampleBufferGetDuration(buffer));
+            if (!CMTIME_IS_VALID(playedTime) || CMTimeCompare(end, playedTime) > 0) {
+                pending.push_back(buffer);
+            }
+        }
+        for (std::queue<CMSampleBufferRef> copy = sampleQueue; !copy.empty(); copy.pop()) {
+            pending.push_back(copy.front());
+        }
+
+        size_t total = 0;
+        for (CMSampleBufferRef buffer : pending) {
+            total += CMBlockBufferGetDataLength(CMSampleBufferGetDataBuffer(buffer)) / sizeof(float);
+        }
+
+        idleSnapshot.samples.clear();
+        idleSnapshot.samples.shrink_to_fit();
+        idleSnapshot.samples.resize(total);
+        idleSnapshot.chunks.clear();
+        idleSnapshot.playedTime = playedTime;
+
+        size_t offset = 0;
+        for (CMSampleBufferRef buffer : pending) {
+            CMBlockBufferRef block = CMSampleBufferGetDataBuffer(buffer);
+            const size_t length = CMBlockBufferGetDataLength(block);
+            CMAudioFormatDescriptionRef format = CMSampleBufferGetFormatDescription(buffer);
+            const AudioStreamBasicDescription *asbd = CMAudioFormatDescriptionGetStreamBasicDescription(format);
+            if (asbd && CMBlockBufferCopyDataBytes(block, 0, length, idleSnapshot.samples.data() + offset) == kCMBlockBufferNoErr) {
+                idleSnapshot.chunks.push_back(IdleChunk{
+                    .presentationTime = CMSampleBufferGetPresentationTimeStamp(buffer),
+                    .frames = static_cast<size_t>(CMSampleBufferGetNumSamples(buffer)),
+                    .channels = asbd->mChannelsPerFrame,
+                    .sampleRate = static_cast<uint32_t>(asbd->mSampleRate),
+                    .format = (__bridge id)format,
+                });
+                offset += length / sizeof(float);
+            }
+        }
+        idleSnapshot.samples.resize(offset);
+
+        released = retainedQueue.size() + sampleQueue.size();
+        for (CMSampleBufferRef buffer : retainedQueue) {
+            CFRelease(buffer);
+        }
+        retainedQueue.clear();
+        while (!sampleQueue.empty()) {
+            CFRelease(sampleQueue.front());
+            sampleQueue.pop();
+        }
+        queuedFrames = 0;
+    }
+
+    [[self activeRenderer] flush];
+    idleReclaimed = true;
+
+    // Let the owner drop its pools / DSP state as well
+    if (_idleReclaimCallback) {
+        _idleReclaimCallback(_idleReclaimContext);
+    }
+
+    const uint64_t rss = utils::resource_sample::take().rss_bytes;
+    {
+        std::lock_guard<std::mutex> lock(statsMutex);
+        recoveryStats.idleReclaims++;
+        recoveryStats.idleRssBytes = rss;
+    }
+    [self logMessage:@"[AVF] Idle: released %zu buffers, kept %zu KiB snapshot, RSS %llu KiB",
+                     released,
+                     idleSnapshot.samples.size() * sizeof(float) / 1024,
+                     rss / 1024];
+}
+
+// Turn the idle snapshot back into queued sample buffers, returns the time to continue from.
+// Called on the render queue.
+- (CMTime)restoreIdleSnapshot {
+    resumeStartNs = monotonicNs();
+    idleReclaimed = false;
+
+    std::vector<CMSampleBufferRef> rebuilt;
+    rebuilt.reserve(idleSnapshot.chunks.size());
+    size_t offset = 0;
+    for (const IdleChunk &chunk : idleSnapshot.chunks) {
+        CMSampleBufferRef buffer = [self createSampleBuffer:idleSnapshot.samples.data() + offset
+                                                     frames:chunk.frames
+                                           presentationTime:chunk.presentationTime
+                                                     format:(__bridge CMAudioFormatDescriptionRef)chunk.format
+                                                   channels:chunk.channels
+                                                 sampleRate:chunk.sampleRate];
+        offset += chunk.frames * chunk.channels;
+        if (buffer) {
+            rebuilt.push_back(buffer);
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(sampleQueueMutex);
+        std::queue<CMSampleBufferRef> merged;
+        for (CMSampleBufferRef buffer : rebuilt) {
+            merged.push(buffer);
+            queuedFrames += static_cast<size_t>(CMSampleBufferGetNumSamples(buffer));
+        }
+        for (; !sampleQueue.empty(); sampleQueue.pop()) {
+            merged.push(sampleQueue.front());
+        }
+        sampleQueue.swap(merged);
+    }
+
+    const CMTime resumeTime = idleSnapshot.playedTime;
+    idleSnapshot = IdleSnapshot{};
+    if (rebuilt.empty()) {
+        resumeStartNs = 0;
+    }
+    return resumeTime;
+}
+
+// Swap in a fresh renderer and continue from the played position with the retained buffers
+- (void)recoverRendererAtTime:(CMTime)playedTime {
+    const uint64_t start = monotonicNs();
+
+    AVSampleBufferAudioRenderer *stalled = [self activeRenderer];
+    AVSampleBufferAudioRenderer *fresh = [[AVSampleBufferAudioRenderer alloc] init];
+    if (@available(macOS 12.0, *)) {
+        fresh.allowedAudioSpatializationFormats = stalled.allowedAudioSpatializationFormats;
+    }
+    fresh.audioOutputDeviceUniqueID = stalled.audioOutputDeviceUniqueID;
+    fresh.volume = stalled.volume;
+    fresh.muted = stalled.muted;
+
+    [stalled stopRequestingMediaData];
+    [synchronizer setRate:0.0];
+    [synchronizer removeRenderer:stalled atTime:kCMTimeInvalid completionHandler:nil];
+    [synchronizer addRenderer:fresh];
+    {
+        std::lock_guard<std::mutex> lock(rendererMutex);
+        renderer = fresh;
+    }
+
+    [self replayRetainedFrom:playedTime into:fresh];
+    [self attachRenderer:fresh];
+    [synchronizer setRate:1.0 time:CMTIME_IS_VALID(playedTime) ? playedTime : kCMTimeZero];
+
+    const uint64_t now = monotonicNs();
+    lastRenderCallbackNs = now;
+    lastSynchronizerTime = kCMTimeInvalid;
+    lastSynchronizerChangeNs = now;
+
+    const double elapsedMs = (now - start) / 1e6;
+    {
+        std::lock_guard<std::mutex> lock(statsMutex);
+        recoveryStats.stalls++;
+        recoveryStats.lastRecoveryMs = elapsedMs;
+        recoveryStats.maxRecoveryMs = std::max(recoveryStats.maxRecoveryMs, elapsedMs);
+    }
+    if (now - start > kRecoveryBudgetNs) {
+        [self logMessage:@"[AVF] Renderer recovery took %.1f ms, over the %.0f ms budget", elapsedMs, kRecoveryBudgetNs / 1e6];
+    } else {
+        [self logMessage:@"[AVF] Renderer recovered in %.1f ms", elapsedMs];
+    }
 }
 
 - (double)getCurrentLatency {
-    if (!_isEnabled || !currentFormat) {
+    if (!_isEnabled || formatSampleRate.load(std::memory_order_relaxed) == 0) {
         return 0.01;
     }
-    // TODO: Implement me
-    return 0.02;
+    return [self bufferedSeconds] + processingLatency.load(std::memory_order_relaxed);
+}
+
+- (double)bufferedSeconds {
+    // Everything fed but not played yet: queued here, enqueued in the renderer, or in flight to the device
+    CMTime fedUntil;
+    {
+        std::lock_guard<std::mutex> lock(timestampMutex);
+        fedUntil = currentPresentationTime;
+    }
+    double buffered = -1;
+    if (CMTIME_IS_NUMERIC(fedUntil)) {
+        buffered = CMTimeGetSeconds(CMTimeSubtract(fedUntil, [synchronizer currentTime]));
+    }
+    if (buffered < 0) {
+        // Timeline restarted by a flush while the synchronizer kept running, only our own queue and the device are known
+        const uint32_t sampleRate = formatSampleRate.load(std::memory_order_relaxed);
+        std::lock_guard<std::mutex> lock(sampleQueueMutex);
+        const double queued = sampleRate ? static_cast<double>(queuedFrames) / sampleRate : 0;
+        buffered = queued + deviceLatency.load(std::memory_order_relaxed);
+    }
+    return buffered;
+}
+
+- (void)setProcessingLatency:(double)seconds {
+    processingLatency.store(std::max(0.0, seconds), std::memory_order_relaxed);
 }
 
 - (bool)isReadyForMoreMediaData {
@@ -498,7 +1373,7 @@
     // Check if queue has space
     {
         std::lock_guard<std::mutex> lock(sampleQueueMutex);
-        return sampleQueue.size() < maxQueueSize;
+        return ![self isQueueFullLocked];
     }
 }
 
@@ -578,6 +1453,11 @@ namespace foo_out_avf
         [impl setQueueSize:size];
     }
 
+    void AVFEngine::setTargetBufferDuration(double seconds) {
+        AVFEngineImpl *impl = (__bridge AVFEngineImpl *)impl_;
+        [impl setTargetBufferDuration:seconds];
+    }
+
     bool AVFEngine::isEnabled() const {
         AVFEngineImpl *impl = (__bridge AVFEngineImpl *)impl_;
         return [impl isEnabled];
@@ -618,6 +1498,51 @@ namespace foo_out_avf
         return [impl getCurrentLatency];
     }
 
+    void AVFEngine::setProcessingLatency(double seconds) {
+        AVFEngineImpl *impl = (__bridge AVFEngineImpl *)impl_;
+        [impl setProcessingLatency:seconds];
+    }
+
+    void AVFEngine::setOutputDevice(const std::string &uid) {
+        AVFEngineImpl *impl = (__bridge AVFEngineImpl *)impl_;
+        [impl setOutputDevice:[NSString stringWithUTF8String:uid.c_str()]];
+    }
+
+    void AVFEngine::setDeviceTiming(uint32_t bufferFrames, uint32_t sampleRate, double outputLatency) {
+        AVFEngineImpl *impl = (__bridge AVFEngineImpl *)impl_;
+        [impl setDeviceBufferFrames:bufferFrames sampleRate:sampleRate latency:outputLatency];
+    }
+
+    void AVFEngine::setStereoSpatialization(bool allowed) {
+        AVFEngineImpl *impl = (__bridge AVFEngineImpl *)impl_;
+        [impl setStereoSpatialization:allowed];
+    }
+
+    bool AVFEngine::spatializesStereo() const {
+        AVFEngineImpl *impl = (__bridge AVFEngineImpl *)impl_;
+        return [impl spatializesStereo];
+    }
+
+    void AVFEngine::setStreamVerifier(utils::stream_verifier *verifier) {
+        AVFEngineImpl *impl = (__bridge AVFEngineImpl *)impl_;
+        [impl setStreamVerifier:verifier];
+    }
+
+    int64_t AVFEngine::nextPresentationFrame() const {
+        AVFEngineImpl *impl = (__bridge AVFEngineImpl *)impl_;
+        return [impl nextPresentationFrame];
+    }
+
+    size_t AVFEngine::copyAudibleSamples(std::vector<float> &samples, size_t frames, uint32_t &channels, uint32_t &sampleRate) {
+        AVFEngineImpl *impl = (__bridge AVFEngineImpl *)impl_;
+        return [impl copyAudibleSamples:samples frames:frames channels:&channels sampleRate:&sampleRate];
+    }
+
+    bool AVFEngine::copyAudibleSpectrum(std::vector<float> &magnitudes, uint32_t &sampleRate) {
+        AVFEngineImpl *impl = (__bridge AVFEngineImpl *)impl_;
+        return [impl copyAudibleSpectrum:magnitudes sampleRate:&sampleRate];
+    }
+
     uint32_t AVFEngine::pendingBufferCount() const {
         AVFEngineImpl *impl = (__bridge AVFEngineImpl *)impl_;
         return [impl pendingBufferCount];
@@ -633,6 +1558,31 @@ namespace foo_out_avf
         return [impl feedAudioData:std::move(audioData) sampleRate:sampleRate channels:channels frameCount:sample_count];
     }
 
+    float *AVFEngine::feedBuffer(size_t floats) {
+        AVFEngineImpl *impl = (__bridge AVFEngineImpl *)impl_;
+        return [impl feedBufferForFloats:floats];
+    }
+
+    size_t AVFEngine::feedBuffered(uint32_t sampleRate, uint32_t channels, size_t sample_count) {
+        AVFEngineImpl *impl = (__bridge AVFEngineImpl *)impl_;
+        return [impl feedBufferWithSampleRate:sampleRate channels:channels frameCount:sample_count];
+    }
+
+    EngineStats AVFEngine::getStats() const {
+        AVFEngineImpl *impl = (__bridge AVFEngineImpl *)impl_;
+        return [impl stats];
+    }
+
+    void AVFEngine::setIdleReclaimDelay(double seconds) {
+        AVFEngineImpl *impl = (__bridge AVFEngineImpl *)impl_;
+        [impl setIdleReclaimDelay:seconds];
+    }
+
+    void AVFEngine::setIdleReclaimCallback(void (*callback)(void *context), void *context) {
+        AVFEngineImpl *impl = (__bridge AVFEngineImpl *)impl_;
+        [impl setIdleReclaimCallback:callback context:context];
+    }
+
     void AVFEngine::setLogCallback(void (*callback)(const char *message)) {
         AVFEngineImpl *impl = (__bridge AVFEngineImpl *)impl_;
         [impl setLogCallback:callback];
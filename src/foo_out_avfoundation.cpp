@@ -7,8 +7,21 @@
 
 #include "predef.h"
 #include "common/consts.hpp"
+#include "common/control_server.hpp"
 #include "common/utils.hpp"
+#include "common/overload_governor.hpp"
+#include "common/realtime.hpp"
+#include "common/render_chain.hpp"
+#include "common/shm_ring.hpp"
+#include "common/stream_verifier.hpp"
+#include "common/tuning.hpp"
+#include "coreaudio_devices.h"
 #include "engine.h"
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <mutex>
 #include <thread>
 #include <fstream>
 #include <semaphore>
@@ -18,14 +31,602 @@
 // Debug configuration - uncomment to enable audio dump
 // #define ENABLE_AUDIO_DUMP 1
 
+// Debug configuration - uncomment to sample CPU / memory / wakeups during long playback sessions
+// #define ENABLE_SOAK_MONITOR 1
+
+#ifdef ENABLE_SOAK_MONITOR
+#include "common/resource_monitor.hpp"
+#include <condition_variable>
+#endif
+
+// POSIX shared-memory name of the output tap, see common/shm_ring.hpp for the layout
+#define AVF_SHM_TAP_NAME "/avf-output"
+
+// Control socket file, placed in the per-user temporary directory (see control_server::default_path)
+#define AVF_CONTROL_SOCKET_NAME "avf-output.sock"
+
 namespace foo_out_avf
 {
+    // Engine tuning, persisted by foobar2000 and picked up live while playing (see AVFOutput::pollTuning)
+    static advconfig_branch_factory g_advconfig_branch(
+        "AVFoundation Output", guid_advconfig_branch, advconfig_branch::guid_branch_playback, 0);
+    static advconfig_integer_factory g_advconfig_target_buffer(
+        "Target buffered duration (ms, 0 = 3 buffers)", guid_advconfig_target_buffer, guid_advconfig_branch, 0, 0, 0, 2000);
+    static advconfig_integer_factory g_advconfig_split_frames("Helper task size for 16+ channels (frames, 0 = device IO buffer)",
+                                                              guid_advconfig_split_frames,
+                                                              guid_advconfig_branch,
+                                                              1,
+                                                              0,
+                                                              0,
+                                                              65536);
+    static advconfig_integer_factory g_advconfig_conversion(
+        "Conversion (0 = auto, 1 = scalar, 2 = SIMD)", guid_advconfig_conversion, guid_advconfig_branch, 2, 0, 0, 2);
+    static advconfig_checkbox_factory g_advconfig_sanitize(
+        "Scrub NaN/Inf and runaway samples", guid_advconfig_sanitize, guid_advconfig_branch, 3, true);
+    static advconfig_integer_factory g_advconfig_fade_in(
+        "Fade in after start/seek/resume (ms)", guid_advconfig_fade_in, guid_advconfig_branch, 4, 0, 0, 500);
+    static advconfig_integer_factory g_advconfig_power_mode(
+        "Mode (0 = balanced, 1 = low latency, 2 = energy saving)", guid_advconfig_power_mode, guid_advconfig_branch, 5, 0, 0, 2);
+    static advconfig_integer_factory g_advconfig_idle_reclaim(
+        "Release memory after idle (s, 0 = never)", guid_advconfig_idle_reclaim, guid_advconfig_branch, 6, 30, 0, 3600);
+    static advconfig_checkbox_factory g_advconfig_shm_tap(
+        "Publish output to shared memory (" AVF_SHM_TAP_NAME ")", guid_advconfig_shm_tap, guid_advconfig_branch, 7, false);
+    static advconfig_checkbox_factory g_advconfig_control_socket("Serve stats and control on a local socket (" AVF_CONTROL_SOCKET_NAME ")",
+                                                                 guid_advconfig_control_socket,
+                                                                 guid_advconfig_branch,
+                                                                 8,
+                                                                 false);
+    static advconfig_checkbox_factory g_advconfig_verify(
+        "Verify bit-perfect delivery (reports to console)", guid_advconfig_verify, guid_advconfig_branch, 9, false);
+    static advconfig_integer_factory g_advconfig_crossfeed("Headphone crossfeed (0 = off, 1 = default, 2 = Chu Moy, 3 = Jan Meier)",
+                                                           guid_advconfig_crossfeed,
+                                                           guid_advconfig_branch,
+                                                           10,
+                                                           0,
+                                                           0,
+                                                           utils::crossfeed_preset_count - 1);
+    static advconfig_checkbox_factory g_advconfig_stereo_spatial("Allow system spatial audio for stereo (disables crossfeed)",
+                                                                 guid_advconfig_stereo_spatial,
+                                                                 guid_advconfig_branch,
+                                                                 11,
+                                                                 true);
+    static advconfig_integer_factory g_advconfig_night_mode("Night mode compression (0 = off, 1 = light, 2 = strong)",
+                                                            guid_advconfig_night_mode,
+                                                            guid_advconfig_branch,
+                                                            12,
+                                                            0,
+                                                            0,
+                                                            utils::night_mode_preset_count - 1);
+    static advconfig_checkbox_factory g_advconfig_governor(
+        "Reduce DSP quality under CPU overload", guid_advconfig_governor, guid_advconfig_branch, 13, true);
+
+    // Advanced settings the control socket may change, by their engine_tuning names
+    struct ControlSetting {
+        const char *name;
+        advconfig_integer_factory *integer;   // either this
+        advconfig_checkbox_factory *checkbox; // or this
+        uint64_t max;
+    };
+    static const ControlSetting g_control_settings[] = {
+        {"target_buffer_ms", &g_advconfig_target_buffer, nullptr, 2000},
+        {"split_frames", &g_advconfig_split_frames, nullptr, 65536},
+        {"conversion", &g_advconfig_conversion, nullptr, 2},
+        {"sanitize", nullptr, &g_advconfig_sanitize, 1},
+        {"fade_in_ms", &g_advconfig_fade_in, nullptr, 500},
+        {"power", &g_advconfig_power_mode, nullptr, 2},
+        {"idle_reclaim_s", &g_advconfig_idle_reclaim, nullptr, 3600},
+        {"shm_tap", nullptr, &g_advconfig_shm_tap, 1},
+        {"control_socket", nullptr, &g_advconfig_control_socket, 1},
+        {"verify", nullptr, &g_advconfig_verify, 1},
+        {"crossfeed", &g_advconfig_crossfeed, nullptr, utils::crossfeed_preset_count - 1},
+        {"stereo_spatial", nullptr, &g_advconfig_stereo_spatial, 1},
+        {"night_mode", &g_advconfig_night_mode, nullptr, utils::night_mode_preset_count - 1},
+        {"governor", nullptr, &g_advconfig_governor, 1},
+    };
+
     class AVFOutput : public output_v6 {
     private:
         AVFEngine engine;
         bool is_active;
         bool is_paused;
 
+        // Conversion and the DSP graph (sanitizer, fade-in, ...), shared with the offline renderer (tools/avf_render.cpp)
+        utils::render_chain chain;
+        double reported_dsp_latency = 0; // last value handed to engine.setProcessingLatency
+
+        // Watches chain.process against the quantum's budget and trades DSP quality for headroom when it runs hot
+        utils::overload_governor governor;
+
+        // Latest governor transition for the console. The processing thread is over budget right when one happens,
+        // so it only stores these and posts at most one main-thread print at a time; transitions in between are
+        // folded into the next message.
+        struct GovernorTransition {
+            std::atomic<uint32_t> level{0};
+            std::atomic<uint32_t> loadPercent{0};
+            std::atomic<uint64_t> transitions{0};
+            std::atomic<bool> posted{false};
+        };
+        std::shared_ptr<GovernorTransition> governor_transition = std::make_shared<GovernorTransition>();
+
+        void logGovernorTransition() {
+            governor_transition->level.store(governor.level(), std::memory_order_relaxed);
+            governor_transition->loadPercent.store(static_cast<uint32_t>(std::lround(governor.load() * 100)), std::memory_order_relaxed);
+            governor_transition->transitions.store(governor.transitions(), std::memory_order_release);
+            if (governor_transition->posted.exchange(true, std::memory_order_acq_rel)) {
+                return;
+            }
+            // Holds its own reference, the output may be gone by the time the main thread gets to it
+            fb2k::inMainThread([transition = governor_transition] {
+                transition->posted.store(false, std::memory_order_release);
+                const uint64_t transitions = transition->transitions.load(std::memory_order_acquire);
+                const uint32_t level = transition->level.load(std::memory_order_relaxed);
+                FB2K_console_print("[AVF] Processing load ",
+                                   transition->loadPercent.load(std::memory_order_relaxed),
+                                   "% of budget, quality ",
+                                   level,
+                                   "/",
+                                   utils::render_chain::quality_levels - 1,
+                                   ": ",
+                                   utils::render_chain::quality_steps[level],
+                                   " (",
+                                   transitions,
+                                   " changes so far)");
+            });
+        }
+
+        // Copy of the output stream for local recorders/analyzers, only while enabled in advanced settings
+        std::unique_ptr<utils::shm_ring_backend> shm_tap;
+
+        // Bit-perfect check: chunks are hashed here, the engine hashes the same frames again as they are enqueued
+        std::unique_ptr<utils::stream_verifier> verifier;
+
+        // What the control socket reports, published by process_samples_v2 once per chunk while it is enabled
+        struct OutputStatus {
+            uint32_t sampleRate;
+            uint32_t channels;
+            uint32_t outputChannels;
+            uint32_t pendingBuffers;
+            uint64_t chunks;
+            uint64_t framesFed;
+            uint64_t shmOverflowFrames;
+            uint64_t verifiedWindows;
+            uint64_t mismatchedWindows;
+            uint64_t unverifiedWindows;
+            double latency;
+            double dspLatency;
+            double deviceLatency;
+            uint32_t deviceBufferFrames;
+            uint32_t qualityLevel;
+            double processingLoad;
+            EngineStats engine;
+            uint32_t stageCount;
+            utils::stage_timing stages[8]; // the chain's stages in order, more than the chain has today
+        };
+        utils::snapshot_cell<OutputStatus> status;
+        uint64_t chunks_fed = 0;
+        uint64_t frames_fed = 0;
+        std::unique_ptr<utils::control_server> control;
+
+        // Deadline accounting for foobar2000's thread calling process_samples_v2
+        utils::rt_thread_stats *process_stats = nullptr;
+
+        // Live tuning: published from update() when the advanced settings change, taken by
+        // process_samples_v2 once per chunk so a change lands on the next quantum boundary
+        utils::config_slot<utils::engine_tuning> tuning_slot;
+        utils::engine_tuning published_tuning;
+        std::chrono::steady_clock::time_point last_tuning_poll;
+        const utils::engine_tuning *tuning = nullptr; // active_tuning once the first chunk arrived
+        utils::engine_tuning active_tuning;            // published tuning with device defaults filled in
+
+        // Output device: empty uid follows the system default. Hot-plug changes reach the processing thread
+        // through the registry generation, see followDevice().
+        std::string device_uid;
+        utils::output_device device;
+        uint64_t device_generation = 0;
+
+        static GUID deviceGuid(const std::string &uid) {
+            const auto id = utils::device_registry::id_for(uid);
+            static_assert(sizeof(GUID) == sizeof(id));
+            GUID guid;
+            memcpy(&guid, id.data(), sizeof(guid));
+            return guid;
+        }
+
+        // Empty for the system default, and for a device that isn't connected right now
+        static std::string deviceUid(const GUID &guid) {
+            if (guid == guid_output_device) {
+                return {};
+            }
+            for (const auto &d : *deviceRegistry().snapshot()) {
+                if (deviceGuid(d.uid) == guid) {
+                    return d.uid;
+                }
+            }
+            FB2K_console_print("[AVF] Selected output device is not connected, using the system default");
+            return {};
+        }
+
+        // Constructor or processing thread. Plays on the system default while the chosen device is unplugged
+        // and moves back once it returns; the device's IO buffer and latency go to the engine either way.
+        // Returns whether the device timing changed.
+        bool followDevice() {
+            auto &registry = deviceRegistry();
+            device_generation = registry.generation();
+            auto found = registry.find(device_uid);
+            engine.setOutputDevice(found ? device_uid : std::string());
+            if (!found) {
+                found = registry.find({});
+            }
+            const utils::output_device current = found.value_or(utils::output_device{});
+            const bool timing_changed =
+                current.buffer_frames != device.buffer_frames || current.output_latency() != device.output_latency();
+            device = current;
+            engine.setDeviceTiming(device.buffer_frames, device.nominal_rate, device.output_latency());
+            return timing_changed;
+        }
+
+        static utils::engine_tuning readTuning() {
+            utils::engine_tuning t;
+            t.target_buffer_ms = static_cast<uint32_t>(g_advconfig_target_buffer.get());
+            t.split_frames = static_cast<uint32_t>(g_advconfig_split_frames.get());
+            t.conversion = static_cast<utils::engine_tuning::conversion_mode>(g_advconfig_conversion.get());
+            t.sanitize = g_advconfig_sanitize.get();
+            t.fade_in_ms = static_cast<uint32_t>(g_advconfig_fade_in.get());
+            t.power = static_cast<utils::engine_tuning::power_mode>(g_advconfig_power_mode.get());
+            t.idle_reclaim_s = static_cast<uint32_t>(g_advconfig_idle_reclaim.get());
+            t.shm_tap = g_advconfig_shm_tap.get();
+            t.control_socket = g_advconfig_control_socket.get();
+            t.verify = g_advconfig_verify.get();
+            t.crossfeed = static_cast<uint32_t>(g_advconfig_crossfeed.get());
+            t.stereo_spatial = g_advconfig_stereo_spatial.get();
+            t.night_mode = static_cast<uint32_t>(g_advconfig_night_mode.get());
+            t.governor = g_advconfig_governor.get();
+            return t;
+        }
+
+        // Cheap enough for update(), but no need to look more than twice a second
+        void pollTuning() {
+            const auto now = std::chrono::steady_clock::now();
+            if (now - last_tuning_poll < std::chrono::milliseconds(500)) {
+                return;
+            }
+            last_tuning_poll = now;
+
+            const auto t = readTuning();
+            if (!(t == published_tuning)) {
+                published_tuning = t;
+                tuning_slot.publish(t);
+            }
+        }
+
+        // Processing thread only, at the start of a quantum
+        void applyTuning(const utils::engine_tuning &t) {
+            engine.setTargetBufferDuration(t.effective_buffer_seconds());
+            engine.setIdleReclaimDelay(t.idle_reclaim_s);
+            engine.setStereoSpatialization(t.stereo_spatial);
+            chain.set_downstream_spatialization(engine.spatializesStereo());
+            if (t.shm_tap && !shm_tap) {
+                shm_tap = std::make_unique<utils::shm_ring_backend>(AVF_SHM_TAP_NAME);
+            } else if (!t.shm_tap) {
+                shm_tap.reset();
+            }
+            if (t.control_socket && !control) {
+                startControl();
+            } else if (!t.control_socket) {
+                control.reset();
+            }
+            chain.set_stage_timing(control != nullptr);
+            if (t.verify && !verifier) {
+                verifier = std::make_unique<utils::stream_verifier>();
+                engine.setStreamVerifier(verifier.get());
+            } else if (!t.verify && verifier) {
+                stopVerifier();
+            }
+            FB2K_console_print("[AVF] Tuning: buffer ",
+                               t.target_buffer_ms,
+                               " ms, helper split ",
+                               t.split_frames,
+                               ", conversion ",
+                               static_cast<uint32_t>(t.conversion),
+                               ", sanitize ",
+                               t.sanitize ? "on" : "off",
+                               ", fade-in ",
+                               t.fade_in_ms,
+                               " ms, mode ",
+                               static_cast<uint32_t>(t.power),
+                               ", idle reclaim ",
+                               t.idle_reclaim_s,
+                               " s, shm tap ",
+                               t.shm_tap ? "on" : "off",
+                               ", control socket ",
+                               t.control_socket ? "on" : "off",
+                               ", verify ",
+                               t.verify ? "on" : "off",
+                               ", crossfeed ",
+                               utils::crossfeed_presets[std::min(t.crossfeed, utils::crossfeed_preset_count - 1)].name,
+                               ", stereo spatialization ",
+                               t.stereo_spatial ? "on" : "off",
+                               ", night mode ",
+                               utils::night_mode_presets[std::min(t.night_mode, utils::night_mode_preset_count - 1)].name,
+                               ", overload governor ",
+                               t.governor ? "on" : "off");
+            if (!t.governor && governor.level() != 0) {
+                governor.reset();
+                chain.set_quality(0);
+                FB2K_console_print("[AVF] Overload governor off, back to full quality");
+            }
+            if (t.crossfeed != 0 && engine.spatializesStereo()) {
+                FB2K_console_print("[AVF] Crossfeed stays off while system spatial audio may process stereo");
+            }
+        }
+
+        static std::string tuningJson(const utils::engine_tuning &t) {
+            utils::json_writer w;
+            w.begin_object()
+                .value("target_buffer_ms", t.target_buffer_ms)
+                .value("split_frames", t.split_frames)
+                .value("conversion", static_cast<uint32_t>(t.conversion))
+                .value("sanitize", t.sanitize)
+                .value("fade_in_ms", t.fade_in_ms)
+                .value("power", static_cast<uint32_t>(t.power))
+                .value("idle_reclaim_s", t.idle_reclaim_s)
+                .value("shm_tap", t.shm_tap)
+                .value("control_socket", t.control_socket)
+                .value("verify", t.verify)
+                .value("crossfeed", t.crossfeed)
+                .value("stereo_spatial", t.stereo_spatial)
+                .value("night_mode", t.night_mode)
+                .value("governor", t.governor)
+                .end_object();
+            return w.str();
+        }
+
+        std::string statsJson() const {
+            utils::json_writer w;
+            w.begin_object();
+            OutputStatus s;
+            if (status.read(s)) {
+                w.value("sample_rate", s.sampleRate)
+                    .value("channels", s.channels)
+                    .value("output_channels", s.outputChannels)
+                    .value("chunks", s.chunks)
+                    .value("frames_fed", s.framesFed)
+                    .value("pending_buffers", s.pendingBuffers)
+                    .value("latency_ms", s.latency * 1000)
+                    .value("dsp_latency_ms", s.dspLatency * 1000)
+                    .value("device_latency_ms", s.deviceLatency * 1000)
+                    .value("device_buffer_frames", s.deviceBufferFrames)
+                    .value("quality_level", s.qualityLevel)
+                    .value("quality", utils::render_chain::quality_steps[s.qualityLevel])
+                    .value("processing_load", s.processingLoad)
+                    .value("underruns", s.engine.underruns)
+                    .value("stalls", s.engine.stalls)
+                    .value("queue_high_water", s.engine.queueHighWater)
+                    .value("retained_high_water", s.engine.retainedHighWater)
+                    .value("idle_reclaims", s.engine.idleReclaims)
+                    .value("shm_overflow_frames", s.shmOverflowFrames)
+                    .value("verified_windows", s.verifiedWindows)
+                    .value("mismatched_windows", s.mismatchedWindows)
+                    .value("unverified_windows", s.unverifiedWindows);
+
+                // Each DSP stage's processing time per quantum (bucket i: under 2^i us); fused elementwise stages
+                // are timed together under the first, stages that haven't run report no quanta
+                w.begin_array("stages");
+                for (uint32_t i = 0; i < s.stageCount; i++) {
+                    const utils::stage_timing &st = s.stages[i];
+                    w.begin_object()
+                        .value("name", st.name)
+                        .value("quanta", st.quanta)
+                        .value("mean_ms", st.quanta ? st.total_ns / 1e6 / st.quanta : 0.0)
+                        .value("worst_ms", st.worst_ns / 1e6)
+                        .begin_array("histogram");
+                    for (const uint64_t count : st.histogram) {
+                        w.value(nullptr, count);
+                    }
+                    w.end_array().end_object();
+                }
+                w.end_array();
+            }
+
+            // Every audio thread with its processing-time histogram (bucket i: under 2^i us), helpers included
+            unsigned workers = 0;
+            w.begin_array("threads");
+            for (const auto &t : utils::rt_stats_registry::instance().snapshot()) {
+                workers += t.name.rfind("avf-worker", 0) == 0;
+                w.begin_object()
+                    .value("name", t.name)
+                    .value("realtime", t.realtime)
+                    .value("quanta", t.quanta)
+                    .value("misses", t.misses)
+                    .value("worst_ms", t.worst_ns / 1e6)
+                    .value("last_ms", t.last_ns / 1e6)
+                    .begin_array("histogram");
+                for (const uint64_t count : t.histogram) {
+                    w.value(nullptr, count);
+                }
+                w.end_array().end_object();
+            }
+            w.end_array();
+            w.value("pool_workers", workers);
+            w.end_object();
+            return w.str();
+        }
+
+        // What is audible right now from the engine's visualisation tap, for external scopes and analyzers. The tap
+        // only starts recording with the first request, so that one comes back empty. The tap itself is lock-free;
+        // finding the audible position costs what get_latency() does, a couple of short-held engine locks.
+        std::string scopeJson(const std::string &arguments) {
+            size_t frames = 1024;
+            if (!arguments.empty()) {
+                char *end = nullptr;
+                frames = strtoull(arguments.c_str(), &end, 10);
+                if (*end != 0 || frames == 0 || frames > 8192) {
+                    throw std::invalid_argument("usage: scope [frames], 1 to 8192");
+                }
+            }
+            std::vector<float> samples;
+            uint32_t channels = 0;
+            uint32_t sample_rate = 0;
+            const size_t copied = engine.copyAudibleSamples(samples, frames, channels, sample_rate);
+            utils::json_writer w;
+            w.begin_object().value("sample_rate", sample_rate).value("channels", channels).value("frames", copied).begin_array("samples");
+            for (const float sample : samples) {
+                w.value(nullptr, static_cast<double>(sample));
+            }
+            w.end_array().end_object();
+            return w.str();
+        }
+
+        // Newest audible magnitude spectrum, computed once per quantum however many clients ask
+        std::string spectrumJson() {
+            std::vector<float> magnitudes;
+            uint32_t sample_rate = 0;
+            const bool available = engine.copyAudibleSpectrum(magnitudes, sample_rate);
+            if (!available) {
+                magnitudes.clear();
+            }
+            utils::json_writer w;
+            w.begin_object().value("available", available).value("sample_rate", sample_rate).begin_array("magnitudes");
+            for (const float magnitude : magnitudes) {
+                w.value(nullptr, static_cast<double>(magnitude));
+            }
+            w.end_array().end_object();
+            return w.str();
+        }
+
+        // Changes go through the advanced settings like edits in Preferences, and reach playback via pollTuning
+        static std::string setTuning(const std::string &arguments) {
+            const size_t space = arguments.find(' ');
+            const std::string key = arguments.substr(0, space);
+            const std::string text = space == std::string::npos ? std::string() : arguments.substr(space + 1);
+            for (const ControlSetting &setting : g_control_settings) {
+                if (key != setting.name) {
+                    continue;
+                }
+                uint64_t value;
+                if (text == "on" || text == "true") {
+                    value = 1;
+                } else if (text == "off" || text == "false") {
+                    value = 0;
+                } else {
+                    char *end = nullptr;
+                    value = strtoull(text.c_str(), &end, 10);
+                    if (text.empty() || *end != 0) {
+                        throw std::invalid_argument("not a number: '" + text + "'");
+                    }
+                }
+                if (value > setting.max) {
+                    throw std::invalid_argument(key + " must be at most " + std::to_string(setting.max));
+                }
+                fb2k::inMainThread([setting, value] {
+                    if (setting.integer) {
+                        setting.integer->set(value);
+                    } else {
+                        setting.checkbox->set(value != 0);
+                    }
+                });
+                utils::json_writer w;
+                w.begin_object().value(setting.name, value).end_object();
+                return w.str();
+            }
+            throw std::invalid_argument("unknown setting '" + key + "', see tuning");
+        }
+
+        // Processing thread (applyTuning). Handlers run on the server's own low-priority thread.
+        void startControl() {
+            control = std::make_unique<utils::control_server>(utils::control_server::default_path(AVF_CONTROL_SOCKET_NAME));
+            control->on("stats", [this](const std::string &) { return statsJson(); });
+            control->on("tuning", [](const std::string &) { return tuningJson(readTuning()); });
+            control->on("set", [](const std::string &arguments) { return setTuning(arguments); });
+            control->on("tap", [](const std::string &arguments) {
+                if (arguments != "start" && arguments != "stop") {
+                    throw std::invalid_argument("usage: tap start|stop");
+                }
+                return setTuning(std::string("shm_tap ") + (arguments == "start" ? "1" : "0"));
+            });
+            control->on("scope", [this](const std::string &arguments) { return scopeJson(arguments); });
+            control->on("spectrum", [this](const std::string &) { return spectrumJson(); });
+            control->on("trace", [](const std::string &) {
+                dumpDeadlineStats();
+                return std::string();
+            });
+            if (control->start()) {
+                FB2K_console_print("[AVF] Control socket at ", control->path().c_str());
+            } else {
+                FB2K_console_print("[AVF] Control socket failed: ", control->error().c_str());
+                control.reset();
+            }
+        }
+
+        // Detaches from the engine first, it may be checking a buffer right now
+        void stopVerifier() {
+            engine.setStreamVerifier(nullptr);
+            FB2K_console_print("[AVF] Bit-perfect check: ",
+                               verifier->verified_windows(),
+                               " windows identical, ",
+                               verifier->mismatched_windows(),
+                               " differed, ",
+                               verifier->unverified_windows(),
+                               " not comparable");
+            verifier.reset();
+        }
+
+        // Paused or starved for a while: drop helper threads and anything else rebuilt lazily on the next chunk.
+        // Runs on the engine's render queue, so the chain only gets the request; update() carries it out.
+        static void onIdleReclaim(void *context) {
+            static_cast<AVFOutput *>(context)->chain.request_release();
+        }
+
+#ifdef ENABLE_SOAK_MONITOR
+        // Samples resources once a minute and reports growth trends when the output goes away
+        std::thread soak_thread;
+        std::mutex soak_mutex;
+        std::condition_variable soak_cv;
+        bool soak_stop = false;
+
+        void startSoakMonitor() {
+            soak_thread = std::thread([this] {
+                utils::resource_monitor monitor;
+                std::unique_lock<std::mutex> lock(soak_mutex);
+                while (!soak_cv.wait_for(lock, std::chrono::minutes(1), [this] { return soak_stop; })) {
+                    const auto stats = engine.getStats();
+                    monitor.sample(std::max(stats.queueHighWater, stats.retainedHighWater), engine.getCurrentLatency());
+                    const auto &s = monitor.samples().back();
+                    FB2K_console_print("[AVF] soak: ",
+                                       pfc::format_float(s.seconds / 3600.0, 0, 2),
+                                       " h, cpu ",
+                                       pfc::format_float(s.cpu_seconds, 0, 1),
+                                       " s, rss ",
+                                       s.rss_bytes / 1024,
+                                       " KiB, heap ",
+                                       s.alloc_blocks,
+                                       ", wakeups ",
+                                       s.wakeups,
+                                       ", pool hwm ",
+                                       s.pool_high_water,
+                                       ", queued ",
+                                       pfc::format_float(s.queued_seconds, 0, 3),
+                                       " s");
+                }
+                FB2K_console_print("[AVF] soak: ", pfc::format_float(monitor.cpu_seconds_per_hour(), 0, 2), " CPU s/h");
+                for (const auto &problem : monitor.verdict({})) {
+                    FB2K_console_print("[AVF] soak FAILED: ", problem.c_str());
+                }
+            });
+        }
+
+        void stopSoakMonitor() {
+            {
+                std::lock_guard<std::mutex> lock(soak_mutex);
+                soak_stop = true;
+            }
+            soak_cv.notify_all();
+            if (soak_thread.joinable()) {
+                soak_thread.join();
+            }
+        }
+#endif
+
 #ifdef ENABLE_AUDIO_DUMP
         // Debug function to dump audio data to file
         void debugDumpAudioData(const audio_chunk &p_chunk) {
@@ -88,26 +689,100 @@ namespace foo_out_avf
         static bool g_needs_device_list_prefixes() { return false; }
 
     public:
-        AVFOutput(const GUID &p_device, double p_buffer_length, bool p_dither, t_uint32 p_bitdepth) : is_active(false), is_paused(false) {
+        AVFOutput(const GUID &p_device, double p_buffer_length, bool p_dither, t_uint32 p_bitdepth)
+            : is_active(false), is_paused(false), tuning_slot(readTuning()) {
 
             engine.setLogCallback([](const char *message) { FB2K_console_print(message); });
             engine.setQueueSize(3);
+            published_tuning = tuning_slot.latest();
+            last_tuning_poll = std::chrono::steady_clock::now();
+            process_stats = utils::rt_stats_registry::instance().acquire("avf-process");
+            governor.set_levels(utils::render_chain::quality_levels);
+            engine.setIdleReclaimCallback(&AVFOutput::onIdleReclaim, this);
+            device_uid = deviceUid(p_device);
+            followDevice();
 
             if (engine.enable()) {
                 is_active = true;
             }
+#ifdef ENABLE_SOAK_MONITOR
+            startSoakMonitor();
+#endif
         }
 
         ~AVFOutput() {
+#ifdef ENABLE_SOAK_MONITOR
+            stopSoakMonitor();
+#endif
+            control.reset();
+            if (verifier) {
+                stopVerifier();
+            }
+            engine.setIdleReclaimCallback(nullptr, nullptr);
             if (is_active) {
                 // engine.setLogCallback(nullptr);
                 engine.disable();
             }
+            dumpDeadlineStats();
+            chain.release_helpers();
+            if (shm_tap && shm_tap->overflow_frames() > 0) {
+                FB2K_console_print("[AVF] Shared-memory tap dropped ", shm_tap->overflow_frames(), " frames");
+            }
+
+            const auto stats = engine.getStats();
+            if (stats.stalls > 0) {
+                FB2K_console_print("[AVF] Renderer stalls: ",
+                                   stats.stalls,
+                                   ", last recovery ",
+                                   pfc::format_float(stats.lastRecoveryMs, 0, 1),
+                                   " ms, worst ",
+                                   pfc::format_float(stats.maxRecoveryMs, 0, 1),
+                                   " ms");
+            }
+            if (stats.idleReclaims > 0) {
+                FB2K_console_print("[AVF] Idle reclaims: ",
+                                   stats.idleReclaims,
+                                   ", idle RSS ",
+                                   stats.idleRssBytes / 1024,
+                                   " KiB, last resume ",
+                                   pfc::format_float(stats.lastResumeMs, 0, 1),
+                                   " ms");
+            }
+            if (governor.transitions() > 0) {
+                FB2K_console_print("[AVF] Overload governor: ",
+                                   governor.transitions(),
+                                   " quality changes, ended at ",
+                                   utils::render_chain::quality_steps[governor.level()]);
+            }
+            utils::rt_stats_registry::instance().release(process_stats);
         }
 
-        static void g_enum_devices(output_device_enum_callback &p_callback) {
+        // Per-thread deadline misses, printed when the output goes away
+        static void dumpDeadlineStats() {
+            for (const auto &s : utils::rt_stats_registry::instance().snapshot()) {
+                if (s.quanta == 0) {
+                    continue;
+                }
+                FB2K_console_print("[AVF] ",
+                                   s.name.c_str(),
+                                   ": ",
+                                   s.quanta,
+                                   " quanta, ",
+                                   s.misses,
+                                   " deadline misses, worst ",
+                                   pfc::format_float(s.worst_ns / 1e6, 0, 3),
+                                   " ms",
+                                   s.realtime ? " (time-constraint)" : "");
+            }
+        }
 
+        // From the cached registry, so opening Preferences never waits on the HAL
+        static void g_enum_devices(output_device_enum_callback &p_callback) {
             p_callback.on_device(guid_output_device, "AVFoundation Output", 19);
+            for (const auto &d : *deviceRegistry().snapshot()) {
+                const std::string name = d.name + " (AVFoundation)";
+                p_callback.on_device(deviceGuid(d.uid), name.c_str(), name.size());
+            }
         }
 
     public:
@@ -126,24 +801,65 @@ namespace foo_out_avf
                 return 0;
             }
 
+            // Stages keep state, so a chunk must only go through them once: don't process what the engine would refuse
+            if (!engine.isReadyForMoreMediaData()) {
+                return 0;
+            }
+
+            // The whole chunk has to be turned around within its own playback duration
+            utils::deadline_scope deadline(process_stats, utils::rt_constraint::for_quantum(sample_count, sample_rate).period_ns);
+
+            // Quantum boundary: pick up tuning and device changes
+            bool tuning_changed = false;
+            const utils::engine_tuning &published = tuning_slot.acquire(&tuning_changed);
+            if (tuning_changed) {
+                applyTuning(published);
+            }
+            const bool device_changed = deviceRegistry().generation() != device_generation && followDevice();
+            if (tuning_changed || device_changed || !tuning) {
+                // Without an explicit split size, helpers split work along the device's IO buffer
+                active_tuning = published;
+                if (active_tuning.split_frames == 0) {
+                    active_tuning.split_frames = device.buffer_frames;
+                }
+                tuning = &active_tuning;
+            }
+
+            // Convert from double (audio_sample) to float and run the DSP graph, interleaved throughout. The result
+            // is written straight into the memory the engine enqueues, so there's no copy of the chunk afterwards.
+            float *out = engine.feedBuffer(chain.prepare(sample_rate, channels, sample_count));
+            if (!out) {
+                return 0;
+            }
+            const auto processing_started = std::chrono::steady_clock::now();
+            const unsigned out_channels = chain.process(p_chunk.get_data(), out, channels, sample_count, sample_rate, *tuning);
+            if (tuning->governor) {
+                const auto elapsed = std::chrono::steady_clock::now() - processing_started;
+                const auto budget = utils::rt_constraint::for_quantum(sample_count, sample_rate);
+                // Settling on a better level when a stage got switched off is no audible change, so no log
+                governor.set_available(chain.available_quality());
+                chain.set_quality(governor.level());
+                if (governor.record(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count(), budget)) {
+                    chain.set_quality(governor.level());
+                    logGovernorTransition();
+                }
+            }
+
+            const double dsp_latency = chain.latency_seconds();
+            if (dsp_latency != reported_dsp_latency) {
+                reported_dsp_latency = dsp_latency;
+                engine.setProcessingLatency(dsp_latency);
+            }
+
             // Setup audio format if needed (this is safe to call multiple times)
-            engine.setupAudioFormat(sample_rate, channels);
-
-            // Convert from double (audio_sample) to float and keep interleaved format
-            const audio_sample *input_data = p_chunk.get_data();
-            std::vector<float> float_data(p_chunk.get_used_size());
-#if defined(AUDIO_MATH_NEON)
-            utils::neon_convert(input_data, float_data.data(), p_chunk.get_used_size());
-#else
-            fb2k_audio_math::convert(input_data, float_data.data(), p_chunk.get_used_size());
-#endif
+            engine.setupAudioFormat(sample_rate, out_channels);
 #ifdef ENABLE_AUDIO_DUMP
             audio_chunk_impl ac;
             ac.set_channels(1);
             // Extract first channel for debugging
             std::vector<float> first_channel(sample_count);
             for (size_t i = 0; i < sample_count; i++) {
-                first_channel[i] = float_data[i * channels]; // First channel only
+                first_channel[i] = out[i * out_channels]; // First channel only
             }
             ac.set_data_32(first_channel.data(), sample_count, 1, sample_rate);
 
@@ -151,7 +867,55 @@ namespace foo_out_avf
             debugDumpAudioData(ac);
 #endif
 
-            size_t processed_samples = engine.feedAudioData(std::move(float_data), sample_rate, channels, sample_count);
+            if (shm_tap && shm_tap->setup_format(sample_rate, out_channels)) {
+                // Copied into the ring now, published below only if the renderer takes the chunk
+                shm_tap->stage(out, sample_count);
+            }
+            if (verifier) {
+                // Hashes the reference conversion of the decoder's samples, so conversion bugs show up too
+                verifier->stage(engine.nextPresentationFrame(),
+                                p_chunk.get_data(),
+                                sample_count,
+                                channels,
+                                out_channels == channels && chain.bit_transparent(*tuning));
+            }
+
+            // `out` belongs to the engine from here on
+            size_t processed_samples = engine.feedBuffered(sample_rate, out_channels, sample_count);
+            if (shm_tap && processed_samples > 0) {
+                shm_tap->set_downstream_latency(engine.getCurrentLatency());
+                shm_tap->commit();
+            }
+            if (verifier && processed_samples > 0) {
+                verifier->commit();
+            }
+
+            if (control) {
+                chunks_fed++;
+                frames_fed += processed_samples;
+                OutputStatus s = {static_cast<uint32_t>(sample_rate),
+                                  channels,
+                                  out_channels,
+                                  engine.pendingBufferCount(),
+                                  chunks_fed,
+                                  frames_fed,
+                                  shm_tap ? shm_tap->overflow_frames() : 0,
+                                  verifier ? verifier->verified_windows() : 0,
+                                  verifier ? verifier->mismatched_windows() : 0,
+                                  verifier ? verifier->unverified_windows() : 0,
+                                  engine.getCurrentLatency(),
+                                  dsp_latency,
+                                  device.output_latency(),
+                                  device.buffer_frames,
+                                  governor.level(),
+                                  governor.load(),
+                                  engine.getStats()};
+                s.stageCount = static_cast<uint32_t>(std::min(chain.stage_count(), std::size(s.stages)));
+                for (uint32_t i = 0; i < s.stageCount; i++) {
+                    s.stages[i] = chain.timing(i);
+                }
+                status.publish(s);
+            }
             return processed_samples;
         }
 
@@ -159,7 +923,9 @@ namespace foo_out_avf
 
         double get_latency() override {
             if (is_active && !is_paused) {
-                // Return actual calculated latency based on pending buffers
+                // Fed but not audible yet (queue, renderer, device) plus DSP look-ahead, measured against the
+                // synchronizer clock: the same position the visualisation tap serves, so foobar2000's own
+                // visualisations and the control socket's scope/spectrum line up with what is heard
                 return engine.getCurrentLatency();
             } else {
                 // Return minimal latency when not active
@@ -169,7 +935,13 @@ namespace foo_out_avf
 
         void process_samples(const audio_chunk &p_chunk) override { process_samples_v2(p_chunk); }
 
-        void update(bool &p_ready) override { p_ready = engine.isEnabled() && engine.isReadyForMoreMediaData(); }
+        void update(bool &p_ready) override {
+            pollTuning();
+            if (chain.release_helpers_if_requested()) {
+                FB2K_console_print("[AVF] Idle: released DSP helper threads");
+            }
+            p_ready = engine.isEnabled() && engine.isReadyForMoreMediaData();
+        }
 
         void pause(bool p_state) override {
             is_paused = p_state;
@@ -179,15 +951,23 @@ namespace foo_out_avf
             } else {
                 // Resume the engine
                 engine.resume();
+                chain.restart();
             }
         }
 
-        void flush() override { engine.flush(); }
+        void flush() override {
+            engine.flush();
+            if (shm_tap) {
+                shm_tap->flush();
+            }
+            chain.restart();
+        }
 
         void force_play() override {
             is_paused = false;
             engine.disable();
             engine.enable();
+            chain.restart();
         }
 
         void volume_set(double p_val) override { engine.setVolume(static_cast<float>(p_val)); }
@@ -0,0 +1,386 @@
+//
+//  avf_render.cpp
+//  foo_out_avfoundation
+//
+//  Offline renderer: pushes WAV files through the component's output chain and writes the result as
+//  32-bit float WAV/RF64, as fast as the chain goes. Used to pre-render files and to measure throughput
+//  without a device.
+//
+//  Build (Linux or macOS):
+//      c++ -std=gnu++20 -O2 -pthread -Isrc/common tools/avf_render.cpp -o avf_render
+//
+//  Usage:
+//      avf_render [options] input.wav output.wav
+//      avf_render [options] input.wav shm:/name    publish into a shared-memory ring instead (see shm_ring.hpp),
+//                                                  paced by whoever reads it, as a stand-in for the device
+//          --quantum N     frames per chunk (default 4096)
+//          --split N       frames per helper task with 16+ channels (default: as many as the cost model picks)
+//          --scalar        scalar conversion instead of SIMD
+//          --no-sanitize   pass NaN/Inf and runaway samples through
+//          --fade MS       fade-in at the start
+//          --energy        never split a chunk across helper threads
+//          --crossfeed N   headphone crossfeed preset (1 = default, 2 = Chu Moy, 3 = Jan Meier), stereo only
+//          --night N       night mode compression (1 = light, 2 = strong); its 5 ms look-ahead is compensated
+//          --control PATH  serve `stats` on a Unix socket while rendering (same protocol as the component,
+//                          see control_server.hpp), for test harnesses polling a long render
+//
+
+#include "control_server.hpp"
+#include "render_backend.hpp"
+#include "render_chain.hpp"
+#include "shm_ring.hpp"
+#include "realtime.hpp"
+#include "tuning.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+    // Read-only view of a PCM/float WAV or RF64 file, mapped as a whole
+    struct wav_source {
+        uint32_t sample_rate = 0;
+        unsigned channels = 0;
+        unsigned bits = 0;
+        bool is_float = false;
+        const uint8_t *data = nullptr;
+        uint64_t frames = 0;
+
+        void *map = nullptr;
+        size_t map_size = 0;
+
+        ~wav_source() {
+            if (map) {
+                munmap(map, map_size);
+            }
+        }
+
+        static uint16_t le16(const uint8_t *p) { return static_cast<uint16_t>(p[0] | p[1] << 8); }
+        static uint32_t le32(const uint8_t *p) { return le16(p) | static_cast<uint32_t>(le16(p + 2)) << 16; }
+        static uint64_t le64(const uint8_t *p) { return le32(p) | static_cast<uint64_t>(le32(p + 4)) << 32; }
+
+        bool open(const char *path, std::string &error) {
+            const int fd = ::open(path, O_RDONLY);
+            if (fd < 0) {
+                error = std::string("cannot open ") + path + ": " + strerror(errno);
+                return false;
+            }
+            struct stat st = {};
+            fstat(fd, &st);
+            map_size = static_cast<size_t>(st.st_size);
+            map = map_size ? mmap(nullptr, map_size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+            ::close(fd);
+            if (map == MAP_FAILED) {
+                map = nullptr;
+                error = std::string("cannot map ") + path;
+                return false;
+            }
+            madvise(map, map_size, MADV_SEQUENTIAL);
+
+            const auto *p = static_cast<const uint8_t *>(map);
+            const uint8_t *end = p + map_size;
+            if (map_size < 12 || (memcmp(p, "RIFF", 4) != 0 && memcmp(p, "RF64", 4) != 0) || memcmp(p + 8, "WAVE", 4) != 0) {
+                error = "not a WAV file";
+                return false;
+            }
+
+            uint64_t ds64_data_size = 0;
+            uint16_t format = 0;
+            unsigned block_align = 0;
+            for (const uint8_t *chunk = p + 12; chunk + 8 <= end;) {
+                const uint32_t size = le32(chunk + 4);
+                const uint8_t *body = chunk + 8;
+                if (memcmp(chunk, "ds64", 4) == 0 && size >= 16) {
+                    ds64_data_size = le64(body + 8);
+                } else if (memcmp(chunk, "fmt ", 4) == 0 && size >= 16) {
+                    format = le16(body);
+                    channels = le16(body + 2);
+                    sample_rate = le32(body + 4);
+                    block_align = le16(body + 12);
+                    bits = le16(body + 14);
+                    if (format == 0xFFFE && size >= 40) {
+                        format = le16(body + 24); // sub-format GUID starts with the plain format tag
+                    }
+                } else if (memcmp(chunk, "data", 4) == 0) {
+                    const uint64_t bytes = size == 0xFFFFFFFFu && ds64_data_size ? ds64_data_size : size;
+                    data = body;
+                    const uint64_t available = static_cast<uint64_t>(end - body);
+                    frames = block_align ? std::min(bytes, available) / block_align : 0;
+                    break;
+                }
+                chunk = body + size + (size & 1);
+            }
+
+            is_float = format == 3;
+            if (!data || channels == 0 || sample_rate == 0 || (format != 1 && format != 3)) {
+                error = "unsupported WAV layout";
+                return false;
+            }
+            if ((is_float && bits != 32 && bits != 64) || (!is_float && bits != 16 && bits != 24 && bits != 32)) {
+                error = "unsupported sample format";
+                return false;
+            }
+            return true;
+        }
+
+        // Decode into foobar2000's audio_sample layout (interleaved doubles)
+        void read(uint64_t first, size_t count, double *out) const {
+            const size_t bytes = bits / 8;
+            const uint8_t *p = data + first * channels * bytes;
+            const size_t samples = count * channels;
+            for (size_t i = 0; i < samples; i++, p += bytes) {
+                if (is_float) {
+                    if (bits == 32) {
+                        float v;
+                        memcpy(&v, p, sizeof(v));
+                        out[i] = v;
+                    } else {
+                        memcpy(&out[i], p, sizeof(double));
+                    }
+                } else if (bits == 16) {
+                    out[i] = static_cast<int16_t>(le16(p)) / 32768.0;
+                } else if (bits == 24) {
+                    const int32_t v = static_cast<int32_t>(static_cast<uint32_t>(p[0]) << 8 | static_cast<uint32_t>(p[1]) << 16 |
+                                                           static_cast<uint32_t>(p[2]) << 24);
+                    out[i] = (v >> 8) / 8388608.0;
+                } else {
+                    out[i] = static_cast<int32_t>(le32(p)) / 2147483648.0;
+                }
+            }
+        }
+    };
+
+    // Published once per chunk for the control socket
+    struct render_progress {
+        uint64_t frames_delivered;
+        uint64_t frames_total;
+        uint32_t output_channels;
+        double elapsed;
+        uint32_t stage_count;
+        utils::stage_timing stages[8];
+    };
+
+    std::string progress_json(const utils::snapshot_cell<render_progress> &progress, const wav_source &source) {
+        render_progress p = {};
+        progress.read(p);
+        utils::json_writer w;
+        w.begin_object()
+            .value("sample_rate", source.sample_rate)
+            .value("channels", source.channels)
+            .value("output_channels", p.output_channels)
+            .value("frames_delivered", p.frames_delivered)
+            .value("frames_total", p.frames_total)
+            .value("elapsed_s", p.elapsed)
+            .begin_array("stages");
+        for (uint32_t i = 0; i < p.stage_count; i++) {
+            const utils::stage_timing &s = p.stages[i];
+            w.begin_object()
+                .value("name", s.name)
+                .value("quanta", s.quanta)
+                .value("mean_ms", s.quanta ? s.total_ns / 1e6 / s.quanta : 0.0)
+                .value("worst_ms", s.worst_ns / 1e6)
+                .begin_array("histogram");
+            for (const uint64_t count : s.histogram) {
+                w.value(nullptr, count);
+            }
+            w.end_array().end_object();
+        }
+        w.end_array().begin_array("threads");
+        for (const auto &t : utils::rt_stats_registry::instance().snapshot()) {
+            w.begin_object()
+                .value("name", t.name)
+                .value("realtime", t.realtime)
+                .value("quanta", t.quanta)
+                .value("misses", t.misses)
+                .value("worst_ms", t.worst_ns / 1e6)
+                .value("last_ms", t.last_ns / 1e6)
+                .begin_array("histogram");
+            for (const uint64_t count : t.histogram) {
+                w.value(nullptr, count);
+            }
+            w.end_array().end_object();
+        }
+        w.end_array().end_object();
+        return w.str();
+    }
+
+    int usage() {
+        fprintf(stderr,
+                "usage: avf_render [--quantum N] [--split N] [--scalar] [--no-sanitize] [--fade MS] [--energy] [--crossfeed N]"
+                " [--night N] [--control PATH] input.wav output.wav\n");
+        return 2;
+    }
+} // namespace
+
+int main(int argc, char **argv) {
+    utils::engine_tuning tuning;
+    size_t quantum = 4096;
+    const char *control_path = nullptr;
+    std::vector<const char *> paths;
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        if (arg == "--quantum" && i + 1 < argc) {
+            quantum = std::max(1, atoi(argv[++i]));
+        } else if (arg == "--split" && i + 1 < argc) {
+            tuning.split_frames = static_cast<uint32_t>(std::max(0, atoi(argv[++i])));
+        } else if (arg == "--scalar") {
+            tuning.conversion = utils::engine_tuning::conversion_mode::scalar;
+        } else if (arg == "--no-sanitize") {
+            tuning.sanitize = false;
+        } else if (arg == "--fade" && i + 1 < argc) {
+            tuning.fade_in_ms = static_cast<uint32_t>(std::max(0, atoi(argv[++i])));
+        } else if (arg == "--energy") {
+            tuning.power = utils::engine_tuning::power_mode::energy;
+        } else if (arg == "--crossfeed" && i + 1 < argc) {
+            tuning.crossfeed = std::min(static_cast<uint32_t>(std::max(0, atoi(argv[++i]))), utils::crossfeed_preset_count - 1);
+        } else if (arg == "--night" && i + 1 < argc) {
+            tuning.night_mode = std::min(static_cast<uint32_t>(std::max(0, atoi(argv[++i]))), utils::night_mode_preset_count - 1);
+        } else if (arg == "--control" && i + 1 < argc) {
+            control_path = argv[++i];
+        } else if (arg.size() > 1 && arg[0] == '-') {
+            return usage();
+        } else {
+            paths.push_back(argv[i]);
+        }
+    }
+    if (paths.size() != 2) {
+        return usage();
+    }
+
+    wav_source source;
+    std::string error;
+    if (!source.open(paths[0], error)) {
+        fprintf(stderr, "avf_render: %s\n", error.c_str());
+        return 1;
+    }
+
+    std::unique_ptr<utils::wav_file_backend> file;
+    std::unique_ptr<utils::shm_ring_backend> ring;
+    utils::render_backend *backend = nullptr;
+    if (strncmp(paths[1], "shm:", 4) == 0) {
+        ring = std::make_unique<utils::shm_ring_backend>(paths[1] + 4, utils::shm_ring_backend::overflow_policy::backpressure);
+        backend = ring.get();
+    } else {
+        file = std::make_unique<utils::wav_file_backend>(paths[1]);
+        backend = file.get();
+    }
+
+    utils::render_chain chain;
+    utils::rt_thread_stats *stats = utils::rt_stats_registry::instance().acquire("avf-offline");
+    const uint64_t deadline_ns = utils::rt_constraint::for_quantum(quantum, source.sample_rate).period_ns;
+    std::vector<double> input(quantum * source.channels);
+    std::vector<float> output(chain.prepare(source.sample_rate, source.channels, quantum));
+
+    utils::snapshot_cell<render_progress> progress;
+    progress.publish({0, source.frames, source.channels, 0, 0, {}});
+    std::unique_ptr<utils::control_server> control;
+    if (control_path) {
+        control = std::make_unique<utils::control_server>(control_path);
+        control->on("stats", [&](const std::string &) { return progress_json(progress, source); });
+        chain.set_stage_timing(true);
+        if (!control->start()) {
+            fprintf(stderr, "avf_render: %s\n", control->error().c_str());
+            return 1;
+        }
+    }
+
+    // Stages with look-ahead (night mode) delay the output: the first `latency` frames out are the stages priming,
+    // and the last `latency` frames of the file are still inside them at EOF. Those are dropped at the start and
+    // flushed out with silence at the end, so the output lines up with the input and has the same length.
+    const auto start = std::chrono::steady_clock::now();
+    uint64_t delivered = 0;
+    uint64_t total = source.frames;
+    size_t skip = 0;
+    bool primed = false;
+    for (uint64_t frame = 0; frame < total;) {
+        const size_t frames = static_cast<size_t>(std::min<uint64_t>(quantum, total - frame));
+        const size_t real = frame < source.frames ? static_cast<size_t>(std::min<uint64_t>(frames, source.frames - frame)) : 0;
+        if (real > 0) {
+            source.read(frame, real, input.data());
+        }
+        std::fill(input.begin() + static_cast<std::ptrdiff_t>(real * source.channels), input.end(), 0.0);
+        unsigned out_channels;
+        {
+            utils::deadline_scope scope(stats, deadline_ns);
+            out_channels = chain.process(input.data(), output.data(), source.channels, frames, source.sample_rate, tuning);
+        }
+        if (!primed) {
+            primed = true;
+            skip = chain.latency_frames();
+            total = source.frames + skip;
+        }
+        if (!backend->setup_format(source.sample_rate, out_channels)) {
+            fprintf(stderr, "avf_render: %s\n", file ? file->error().c_str() : "cannot create shared memory");
+            return 1;
+        }
+        const size_t dropped = std::min(skip, frames);
+        skip -= dropped;
+        frame += frames;
+        if (dropped == frames) {
+            continue;
+        }
+        const float *out = output.data() + dropped * out_channels;
+        const size_t count = frames - dropped;
+
+        // A ring takes what fits and the rest waits for the reader, a file takes everything at once
+        size_t taken = 0;
+        while (taken < count) {
+            const size_t n = backend->feed(out + taken * out_channels, count - taken);
+            if (n == 0) {
+                if (!ring) {
+                    break;
+                }
+                ring->wait_for_space(100'000'000);
+            }
+            taken += n;
+        }
+        if (taken == 0) {
+            break;
+        }
+        delivered += taken;
+        if (control) {
+            const double so_far = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            render_progress p = {delivered, source.frames, out_channels, so_far, 0, {}};
+            p.stage_count = static_cast<uint32_t>(std::min(chain.stage_count(), std::size(p.stages)));
+            for (uint32_t i = 0; i < p.stage_count; i++) {
+                p.stages[i] = chain.timing(i);
+            }
+            progress.publish(p);
+        }
+    }
+    const bool ok = file ? file->finish() : true;
+    const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    if (!ok) {
+        fprintf(stderr, "avf_render: %s\n", file->error().c_str());
+        return 1;
+    }
+
+    const double content = static_cast<double>(delivered) / source.sample_rate;
+    printf("%llu frames, %u ch @ %u Hz: %.3f s of audio in %.3f s (%.1fx real time)\n",
+           (unsigned long long)delivered,
+           source.channels,
+           source.sample_rate,
+           content,
+           elapsed,
+           elapsed > 0 ? content / elapsed : 0.0);
+    for (const auto &s : utils::rt_stats_registry::instance().snapshot()) {
+        if (s.quanta != 0) {
+            printf("%s: %llu quanta, worst %.3f ms\n", s.name.c_str(), (unsigned long long)s.quanta, s.worst_ns / 1e6);
+        }
+    }
+    utils::rt_stats_registry::instance().release(stats);
+    return 0;
+}
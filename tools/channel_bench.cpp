@@ -0,0 +1,161 @@
+//
+//  channel_bench.cpp
+//  foo_out_avfoundation
+//
+//  Per-frame cost of the kernels that have mono/stereo instantiations, against the runtime-channel-count
+//  fallback they replace, for the channel counts that have one. Both run the same samples; the outputs are
+//  compared as well.
+//
+//  The fade-in only runs for the first fade_in_ms after a start or seek. Night mode's packed crossovers run on
+//  every quantum while it is on, and the "chunk" rows put them in context: the steady-state per-chunk path
+//  (conversion from double, sanitizer, crossfeed on stereo, strong night mode; the fade-in is over by then).
+//
+//  Build (Linux or macOS):
+//      c++ -std=gnu++20 -O2 -Isrc/common tools/channel_bench.cpp -o channel_bench
+//
+//  Usage:
+//      channel_bench [--frames N] [--runs N]
+//
+
+#include "crossfeed.hpp"
+#include "dsp_graph.hpp"
+#include "dsp_stages.hpp"
+#include "night_mode.hpp"
+#include "sample_ops.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace
+{
+    using clock_type = std::chrono::steady_clock;
+
+    template <typename Run>
+    double best_ns_per_frame(int runs, size_t frames, Run run) {
+        double best = 1e30;
+        for (int i = 0; i < runs; i++) {
+            const auto start = clock_type::now();
+            run();
+            best = std::min(best, std::chrono::duration<double, std::nano>(clock_type::now() - start).count());
+        }
+        return best / static_cast<double>(frames);
+    }
+
+    double max_difference(const std::vector<float> &a, const std::vector<float> &b) {
+        double diff = 0;
+        for (size_t i = 0; i < a.size(); i++) {
+            diff = std::max(diff, static_cast<double>(std::fabs(a[i] - b[i])));
+        }
+        return diff;
+    }
+
+    // Steady-state per-chunk path, like render_chain runs it for a small chunk: convert, then the graph
+    struct chunk_path {
+        utils::dsp_graph graph;
+        std::shared_ptr<utils::night_mode_stage> night_mode = std::make_shared<utils::night_mode_stage>();
+        std::vector<float> output;
+
+        chunk_path(unsigned channels, size_t frames, bool reference) {
+            graph.add(std::make_shared<utils::sanitize_stage>());
+            auto fader = std::make_shared<utils::fade_in_stage>();
+            fader->set_length_ms(5);
+            graph.add(fader);
+            auto crossfeed = std::make_shared<utils::crossfeed_stage>();
+            crossfeed->set_preset(1);
+            graph.add(crossfeed, channels == 2);
+            night_mode->set_preset(2);
+            night_mode->set_reference(reference);
+            graph.add(night_mode);
+            graph.prepare(48000, channels, frames);
+            output.resize(frames * graph.max_channels());
+        }
+
+        void process(const std::vector<double> &input, unsigned channels, size_t frames) {
+            utils::simd_convert(input.data(), output.data(), frames * channels);
+            graph.process(output.data(), frames);
+        }
+    };
+
+    void report(const char *kernel, unsigned channels, double generic, double specialized, double diff) {
+        printf("%-12s %8u %12.3f %12.3f %7.2fx %10g\n", kernel, channels, generic, specialized, generic / specialized, diff);
+    }
+
+    int usage() {
+        fprintf(stderr, "usage: channel_bench [--frames N] [--runs N]\n");
+        return 2;
+    }
+} // namespace
+
+int main(int argc, char **argv) {
+    size_t frames = 4096;
+    int runs = 200;
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            return usage();
+        }
+        if (arg == "--frames") {
+            frames = std::max(1l, atol(argv[++i]));
+        } else if (arg == "--runs") {
+            runs = std::max(1, atoi(argv[++i]));
+        } else {
+            return usage();
+        }
+    }
+
+    printf("%zu frames, best of %d; ns per frame\n", frames, runs);
+    printf("%-12s %8s %12s %12s %8s %10s\n", "kernel", "channels", "generic", "specialized", "speedup", "max diff");
+
+    for (const unsigned channels : {1u, 2u}) {
+        std::vector<float> input(frames * channels);
+        for (size_t i = 0; i < input.size(); i++) {
+            input[i] = 0.8f * std::sin(0.01f * static_cast<float>(i));
+        }
+
+        // The whole chunk inside the ramp, the case the fade-in actually costs something. Near its end, so
+        // repeated runs don't shrink the samples into denormals.
+        std::vector<float> generic = input;
+        std::vector<float> specialized = input;
+        const size_t length = frames * 1000;
+        const size_t position = length - frames;
+        const auto fade = utils::fade_in_for(channels);
+        const double fade_generic =
+            best_ns_per_frame(runs, frames, [&] { utils::fade_in<0>(generic.data(), frames, channels, position, length); });
+        const double fade_specialized =
+            best_ns_per_frame(runs, frames, [&] { fade(specialized.data(), frames, channels, position, length); });
+        report("fade-in", channels, fade_generic, fade_specialized, max_difference(generic, specialized));
+
+        // Night mode alone, the same number of buffers through each, so the state and outputs match at the end
+        utils::night_mode_stage night_generic;
+        utils::night_mode_stage night_packed;
+        for (utils::night_mode_stage *stage : {&night_generic, &night_packed}) {
+            stage->set_preset(2);
+            stage->prepare(48000, channels, frames, nullptr);
+        }
+        night_generic.set_reference(true);
+        const double night_generic_ns = best_ns_per_frame(runs, frames, [&] {
+            night_generic.process(input.data(), generic.data(), frames, channels);
+        });
+        const double night_packed_ns = best_ns_per_frame(runs, frames, [&] {
+            night_packed.process(input.data(), specialized.data(), frames, channels);
+        });
+        report("night mode", channels, night_generic_ns, night_packed_ns, max_difference(generic, specialized));
+
+        std::vector<double> source(frames * channels);
+        for (size_t i = 0; i < source.size(); i++) {
+            source[i] = 0.8 * std::sin(0.01 * static_cast<double>(i));
+        }
+        chunk_path chunk_generic(channels, frames, true);
+        chunk_path chunk_packed(channels, frames, false);
+        const double chunk_generic_ns = best_ns_per_frame(runs, frames, [&] { chunk_generic.process(source, channels, frames); });
+        const double chunk_packed_ns = best_ns_per_frame(runs, frames, [&] { chunk_packed.process(source, channels, frames); });
+        report("chunk", channels, chunk_generic_ns, chunk_packed_ns, max_difference(chunk_generic.output, chunk_packed.output));
+    }
+    return 0;
+}
@@ -0,0 +1,257 @@
+//
+//  overload_bench.cpp
+//  foo_out_avfoundation
+//
+//  Plays a synthetic multichannel stream through the render chain under a CPU hog and counts the quanta that
+//  would have glitched, with and without the overload governor. The hog busy-waits on the processing thread
+//  for a share of every period, the way preemption by other work stretches a quantum; its share ramps up over
+//  the middle of the run, holds, and ramps back down. Nothing sleeps, so a run takes roughly the hog's share
+//  of its simulated duration.
+//
+//  First the chain's cost is measured at every quality level the stream has, which gives the largest hog share
+//  the deepest level still fits in a period. Glitches in quanta whose hog stayed within that share are ones the
+//  governor should have prevented; when more than --tolerance percent of all quanta have one, the run fails
+//  (exit 1). The tolerance is for preemption by the rest of the system, which stretches quanta the same way
+//  the hog does: run it on an otherwise idle machine. Glitches under a bigger hog are reported, giving up DSP
+//  can't help those.
+//
+//  Build (Linux or macOS):
+//      c++ -std=gnu++20 -O2 -pthread -Isrc/common tools/overload_bench.cpp -o overload_bench
+//
+//  Usage:
+//      overload_bench [--channels N] [--rate HZ] [--quantum N] [--seconds S] [--hog PCT] [--night N]
+//                     [--tolerance PCT]
+//
+
+#include "overload_governor.hpp"
+#include "realtime.hpp"
+#include "render_chain.hpp"
+#include "tuning.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+namespace
+{
+    using clock_type = std::chrono::steady_clock;
+
+    struct run_result {
+        uint64_t quanta = 0;
+        uint64_t glitches = 0;            // chain plus hog overran the period
+        uint64_t absorbable_glitches = 0; // ... although the deepest quality level would have fit
+        double worst_share = 0; // of the period
+        uint64_t transitions = 0;
+    };
+
+    // Hog share of the period at simulated time `t`: none for the first fifth, ramp, hold, ramp back down, and
+    // the last quarter without, so the governor has time to step back up
+    double hog_share(double t, double seconds, double peak) {
+        const double x = t / seconds;
+        if (x < 0.2 || x >= 0.75) {
+            return 0;
+        }
+        if (x < 0.35) {
+            return peak * (x - 0.2) / 0.15;
+        }
+        if (x < 0.6) {
+            return peak;
+        }
+        return peak * (0.75 - x) / 0.15;
+    }
+
+    void spin_until(clock_type::time_point until) {
+        while (clock_type::now() < until) {
+        }
+    }
+
+    // Best time per quantum of the chain held at `level`, over `runs` quanta
+    double level_ms(unsigned level,
+                    const std::vector<double> &input,
+                    unsigned channels,
+                    uint32_t rate,
+                    size_t quantum,
+                    const utils::engine_tuning &tuning,
+                    int runs) {
+        utils::render_chain chain;
+        chain.set_quality(level);
+        std::vector<float> output(chain.prepare(rate, channels, quantum));
+        double best = 1e30;
+        for (int i = 0; i < runs; i++) {
+            const auto start = clock_type::now();
+            chain.process(input.data(), output.data(), channels, quantum, rate, tuning);
+            best = std::min(best, std::chrono::duration<double, std::milli>(clock_type::now() - start).count());
+        }
+        return best;
+    }
+
+    run_result play(bool governed,
+                    const std::vector<double> &input,
+                    unsigned channels,
+                    uint32_t rate,
+                    size_t quantum,
+                    double seconds,
+                    double hog_peak,
+                    double absorbable,
+                    const utils::engine_tuning &tuning) {
+        utils::render_chain chain;
+        utils::overload_governor governor;
+        governor.set_levels(utils::render_chain::quality_levels);
+        std::vector<float> output(chain.prepare(rate, channels, quantum));
+        const utils::rt_constraint budget = utils::rt_constraint::for_quantum(quantum, rate);
+        const size_t source_frames = input.size() / channels;
+
+        run_result r;
+        const uint64_t total = static_cast<uint64_t>(seconds * rate / quantum);
+        for (uint64_t q = 0; q < total; q++) {
+            const double t = static_cast<double>(q * quantum) / rate;
+            const size_t offset = (q * quantum) % (source_frames - quantum + 1);
+
+            const auto start = clock_type::now();
+            chain.process(input.data() + offset * channels, output.data(), channels, quantum, rate, tuning);
+            const double share = hog_share(t, seconds, hog_peak);
+            const auto stolen = std::chrono::nanoseconds(static_cast<uint64_t>(share * budget.period_ns));
+            spin_until(clock_type::now() + stolen);
+            const uint64_t elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(clock_type::now() - start).count();
+
+            r.quanta++;
+            r.glitches += elapsed > budget.period_ns;
+            r.absorbable_glitches += elapsed > budget.period_ns && share <= absorbable;
+            r.worst_share = std::max(r.worst_share, static_cast<double>(elapsed) / budget.period_ns);
+            governor.set_available(chain.available_quality());
+            chain.set_quality(governor.level());
+            if (governed && governor.record(elapsed, budget)) {
+                chain.set_quality(governor.level());
+                printf("  %7.2f s  load %4.0f%% of budget -> quality %u (%s)\n",
+                       t,
+                       governor.load() * 100,
+                       governor.level(),
+                       utils::render_chain::quality_steps[governor.level()]);
+            }
+        }
+        r.transitions = governor.transitions();
+        return r;
+    }
+
+    int usage() {
+        fprintf(stderr,
+                "usage: overload_bench [--channels N] [--rate HZ] [--quantum N] [--seconds S] [--hog PCT] [--night N] "
+                "[--tolerance PCT]\n");
+        return 2;
+    }
+} // namespace
+
+int main(int argc, char **argv) {
+    unsigned channels = 64;
+    uint32_t rate = 192000;
+    size_t quantum = 4096;
+    double seconds = 30;
+    double hog = 85;
+    double tolerance = 1;
+    utils::engine_tuning tuning;
+    tuning.night_mode = 2;
+    tuning.power = utils::engine_tuning::power_mode::energy; // one thread, so the hog really competes with the chain
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            return usage();
+        }
+        if (arg == "--channels") {
+            channels = static_cast<unsigned>(std::clamp(atoi(argv[++i]), 1, 256));
+        } else if (arg == "--rate") {
+            rate = static_cast<uint32_t>(std::max(8000, atoi(argv[++i])));
+        } else if (arg == "--quantum") {
+            quantum = static_cast<size_t>(std::max(64, atoi(argv[++i])));
+        } else if (arg == "--seconds") {
+            seconds = std::max(1.0, atof(argv[++i]));
+        } else if (arg == "--hog") {
+            hog = std::clamp(atof(argv[++i]), 0.0, 100.0);
+        } else if (arg == "--night") {
+            tuning.night_mode = std::min(static_cast<uint32_t>(std::max(0, atoi(argv[++i]))), utils::night_mode_preset_count - 1);
+        } else if (arg == "--tolerance") {
+            tolerance = std::clamp(atof(argv[++i]), 0.0, 100.0);
+        } else {
+            return usage();
+        }
+    }
+    tuning.crossfeed = channels == 2 ? 1 : 0;
+
+    // One second of decorrelated tones, looped
+    std::vector<double> input(static_cast<size_t>(rate) * channels);
+    for (size_t f = 0; f < rate; f++) {
+        for (unsigned c = 0; c < channels; c++) {
+            input[f * channels + c] = 0.5 * std::sin(2 * 3.14159265358979323846 * (110.0 + 37.0 * c) * f / rate);
+        }
+    }
+
+    printf("%u ch @ %u Hz, quantum %zu, night mode %s, %.0f s with the hog peaking at %.0f%% of each period\n",
+           channels,
+           rate,
+           quantum,
+           utils::night_mode_presets[tuning.night_mode].name,
+           seconds,
+           hog);
+
+    // Which levels give something up for this stream, as the governor sees it
+    uint32_t available = 0;
+    {
+        utils::render_chain probe;
+        std::vector<float> output(probe.prepare(rate, channels, quantum));
+        probe.process(input.data(), output.data(), channels, quantum, rate, tuning);
+        available = probe.available_quality();
+    }
+    const double period_ms = quantum * 1000.0 / rate;
+    double deepest_ms = 0;
+    printf("%-5s %-22s %12s %12s\n", "level", "", "ms/quantum", "hog fits");
+    for (unsigned level = 0; level < utils::render_chain::quality_levels; level++) {
+        if (!(available >> level & 1u)) {
+            continue;
+        }
+        deepest_ms = level_ms(level, input, channels, rate, quantum, tuning, 20);
+        printf("%-5u %-22s %12.3f %11.1f%%\n",
+               level,
+               utils::render_chain::quality_steps[level],
+               deepest_ms,
+               std::max(0.0, 1 - deepest_ms / period_ms) * 100);
+    }
+    const double absorbable = std::max(0.0, 1 - deepest_ms / period_ms);
+
+    printf("governor off\n");
+    const run_result off = play(false, input, channels, rate, quantum, seconds, hog / 100, absorbable, tuning);
+    printf("governor on\n");
+    const run_result on = play(true, input, channels, rate, quantum, seconds, hog / 100, absorbable, tuning);
+
+    printf("\n%-14s %8s %9s %11s %12s %12s\n", "", "quanta", "glitches", "absorbable", "worst load", "transitions");
+    printf("%-14s %8llu %9llu %11llu %11.1f%% %12llu\n",
+           "governor off",
+           (unsigned long long)off.quanta,
+           (unsigned long long)off.glitches,
+           (unsigned long long)off.absorbable_glitches,
+           off.worst_share * 100,
+           (unsigned long long)off.transitions);
+    printf("%-14s %8llu %9llu %11llu %11.1f%% %12llu\n",
+           "governor on",
+           (unsigned long long)on.quanta,
+           (unsigned long long)on.glitches,
+           (unsigned long long)on.absorbable_glitches,
+           on.worst_share * 100,
+           (unsigned long long)on.transitions);
+
+    const auto max_glitches = static_cast<uint64_t>(on.quanta * tolerance / 100);
+    if (on.absorbable_glitches > max_glitches) {
+        printf("FAILED: %llu glitches with the governor on while the hog stayed within the %.1f%% the deepest level "
+               "leaves, allowed %llu\n",
+               (unsigned long long)on.absorbable_glitches,
+               absorbable * 100,
+               (unsigned long long)max_glitches);
+        return 1;
+    }
+    printf("passed: no more than %llu glitches with the hog within %.1f%% of the period\n",
+           (unsigned long long)max_glitches,
+           absorbable * 100);
+    return 0;
+}
@@ -0,0 +1,128 @@
+//
+//  pool_bench.cpp
+//  foo_out_avfoundation
+//
+//  How the render chain scales with helper threads at high channel counts. Each row runs the same quanta
+//  through a chain limited to that many helpers (conversion split along frames, night mode's crossovers and mix
+//  one channel group per task) and compares time per quantum and output with the chain on the calling thread
+//  alone. The output has to match bit for bit. Run it on the target machine: speedup is bounded by the cores
+//  actually free, and the detector night mode links across channels stays serial.
+//
+//  Build (Linux or macOS):
+//      c++ -std=gnu++20 -O2 -pthread -Isrc/common tools/pool_bench.cpp -o pool_bench
+//
+//  Usage:
+//      pool_bench [--frames N] [--rate HZ] [--night N] [--workers N] [--runs N]
+//
+
+#include "render_chain.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    using clock_type = std::chrono::steady_clock;
+
+    // Best time per quantum over `runs` consecutive quanta; every quantum's output is kept for comparison
+    double best_ms(utils::render_chain &chain,
+                   const std::vector<double> &input,
+                   unsigned channels,
+                   size_t frames,
+                   uint32_t rate,
+                   int runs,
+                   const utils::engine_tuning &tuning,
+                   std::vector<std::vector<float>> &outputs) {
+        outputs.assign(runs, std::vector<float>(chain.prepare(rate, channels, frames)));
+        // One quantum first, so the helpers are started outside the timing
+        std::vector<float> warmup(outputs.front().size());
+        chain.process(input.data(), warmup.data(), channels, frames, rate, tuning);
+        chain.restart();
+
+        double best = 1e30;
+        for (int i = 0; i < runs; i++) {
+            const auto start = clock_type::now();
+            chain.process(input.data(), outputs[i].data(), channels, frames, rate, tuning);
+            best = std::min(best, std::chrono::duration<double, std::milli>(clock_type::now() - start).count());
+        }
+        return best;
+    }
+
+    int usage() {
+        fprintf(stderr, "usage: pool_bench [--frames N] [--rate HZ] [--night N] [--workers N] [--runs N]\n");
+        return 2;
+    }
+} // namespace
+
+int main(int argc, char **argv) {
+    size_t frames = 4096;
+    uint32_t rate = 48000;
+    uint32_t night_mode = 2;
+    unsigned max_workers = std::max(1u, std::thread::hardware_concurrency() - 1);
+    int runs = 20;
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            return usage();
+        }
+        if (arg == "--frames") {
+            frames = std::max(1l, atol(argv[++i]));
+        } else if (arg == "--rate") {
+            rate = static_cast<uint32_t>(std::max(8000, atoi(argv[++i])));
+        } else if (arg == "--night") {
+            night_mode = std::min(static_cast<uint32_t>(std::max(0, atoi(argv[++i]))), utils::night_mode_preset_count - 1);
+        } else if (arg == "--workers") {
+            max_workers = static_cast<unsigned>(std::clamp(atoi(argv[++i]), 1, 64));
+        } else if (arg == "--runs") {
+            runs = std::max(1, atoi(argv[++i]));
+        } else {
+            return usage();
+        }
+    }
+
+    utils::engine_tuning alone;
+    alone.power = utils::engine_tuning::power_mode::energy; // never wakes helpers
+    alone.night_mode = night_mode;
+    utils::engine_tuning split = alone;
+    split.power = utils::engine_tuning::power_mode::balanced;
+
+    printf("%zu frames at %u Hz, night mode %s, %u hardware threads, best of %d\n",
+           frames,
+           rate,
+           utils::night_mode_presets[night_mode].name,
+           std::thread::hardware_concurrency(),
+           runs);
+    printf("%8s %8s %12s %8s\n", "channels", "helpers", "ms/quantum", "speedup");
+
+    bool all_same = true;
+    for (const unsigned channels : {16u, 32u, 64u}) {
+        std::vector<double> input(frames * channels);
+        for (size_t f = 0; f < frames; f++) {
+            for (unsigned c = 0; c < channels; c++) {
+                input[f * channels + c] = 0.5 * std::sin(2 * 3.14159265358979323846 * (110.0 + 37.0 * c) * f / rate);
+            }
+        }
+
+        std::vector<std::vector<float>> reference;
+        utils::render_chain baseline;
+        const double single = best_ms(baseline, input, channels, frames, rate, runs, alone, reference);
+        printf("%8u %8s %12.3f %7.2fx\n", channels, "none", single, 1.0);
+
+        for (unsigned workers = 1; workers <= max_workers; workers++) {
+            utils::render_chain chain;
+            chain.set_helper_count(workers);
+            std::vector<std::vector<float>> outputs;
+            const double ms = best_ms(chain, input, channels, frames, rate, runs, split, outputs);
+            const bool same = outputs == reference;
+            all_same &= same;
+            printf("%8u %8u %12.3f %7.2fx %s\n", channels, workers, ms, single / ms, same ? "" : "MISMATCH");
+        }
+    }
+    return all_same ? 0 : 1;
+}
@@ -0,0 +1,170 @@
+//
+//  pose_bench.cpp
+//  foo_out_avfoundation
+//
+//  Motion-to-sound error of the head-pose predictor on synthetic trajectories: a tracker samples the true
+//  pose with noise, and at each sample the orientation the audio would be rendered with (raw last sample vs.
+//  predicted) is compared to where the head actually is once that audio is heard, one latency later.
+//
+//  Build (Linux or macOS):
+//      c++ -std=gnu++20 -O2 -Isrc/common tools/pose_bench.cpp -o pose_bench
+//
+//  Usage:
+//      pose_bench [--rate HZ] [--noise DEG] [--alpha A] [--beta B]
+//
+
+#include "pose_predictor.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace
+{
+    constexpr double pi = 3.14159265358979323846;
+
+    struct trajectory {
+        const char *name;
+        std::function<utils::head_pose(double)> pose;
+    };
+
+    // Minimum-jerk move from 0 to 1 over [0, 1]
+    double min_jerk(double x) {
+        x = std::clamp(x, 0.0, 1.0);
+        return x * x * x * (10 - 15 * x + 6 * x * x);
+    }
+
+    std::vector<trajectory> trajectories() {
+        return {
+            {"sway 0.3 Hz +-30",
+             [](double t) { return utils::head_pose{static_cast<float>(30 * std::sin(2 * pi * 0.3 * t)), 0, 0}; }},
+            {"scan 1 Hz +-45",
+             [](double t) {
+                 const double yaw = 45 * std::sin(2 * pi * t);
+                 const double pitch = 10 * std::sin(2 * pi * 0.5 * t);
+                 return utils::head_pose{static_cast<float>(yaw), static_cast<float>(pitch), 0};
+             }},
+            {"turns 90 in 0.4 s",
+             [](double t) {
+                 // Look left, hold, look back, hold, every 2 s
+                 const double phase = std::fmod(t, 4.0);
+                 const double yaw = phase < 2 ? 90 * min_jerk(phase / 0.4) : 90 - 90 * min_jerk((phase - 2) / 0.4);
+                 return utils::head_pose{static_cast<float>(yaw), 0, 0};
+             }},
+            {"full rotation 120/s",
+             [](double t) {
+                 const double yaw = std::fmod(120 * t + 180, 360.0) - 180;
+                 return utils::head_pose{static_cast<float>(yaw), 0, static_cast<float>(5 * std::sin(2 * pi * 0.2 * t))};
+             }},
+        };
+    }
+
+    // Angular distance between two poses, yaw wrapping around
+    double error_deg(const utils::head_pose &a, const utils::head_pose &b) {
+        double yaw = std::fabs(a.yaw - b.yaw);
+        yaw = std::min(yaw, 360 - yaw);
+        return std::sqrt(yaw * yaw + (a.pitch - b.pitch) * (a.pitch - b.pitch) + (a.roll - b.roll) * (a.roll - b.roll));
+    }
+
+    struct error_stats {
+        double rms = 0;
+        double p95 = 0;
+    };
+
+    error_stats summarize(std::vector<double> &errors) {
+        error_stats s;
+        for (double e : errors) {
+            s.rms += e * e;
+        }
+        s.rms = std::sqrt(s.rms / errors.size());
+        std::sort(errors.begin(), errors.end());
+        s.p95 = errors[errors.size() * 95 / 100];
+        return s;
+    }
+
+    int usage() {
+        fprintf(stderr, "usage: pose_bench [--rate HZ] [--noise DEG] [--alpha A] [--beta B]\n");
+        return 2;
+    }
+} // namespace
+
+int main(int argc, char **argv) {
+    double rate = 100;
+    double noise = 0.3;
+    utils::pose_predictor::settings settings;
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            return usage();
+        }
+        if (arg == "--rate") {
+            rate = std::max(1.0, atof(argv[++i]));
+        } else if (arg == "--noise") {
+            noise = std::max(0.0, atof(argv[++i]));
+        } else if (arg == "--alpha") {
+            settings.alpha = static_cast<float>(atof(argv[++i]));
+        } else if (arg == "--beta") {
+            settings.beta = static_cast<float>(atof(argv[++i]));
+        } else {
+            return usage();
+        }
+    }
+
+    const double latencies[] = {0.02, 0.05, 0.1, 0.2, 0.35, 0.5};
+    const double duration = 20;
+    printf("tracker %.0f Hz, noise %.2f deg, alpha %.2f, beta %.2f; error in degrees (rms / p95)\n",
+           rate,
+           noise,
+           settings.alpha,
+           settings.beta);
+    printf("%-22s %8s %18s %18s %18s\n", "trajectory", "latency", "raw", "predicted", "uncapped");
+    utils::pose_predictor::settings uncapped_settings = settings;
+    uncapped_settings.max_lead = 1e9;
+
+    for (const trajectory &path : trajectories()) {
+        for (double latency : latencies) {
+            std::mt19937 rng(1234);
+            std::normal_distribution<float> jitter(0.0f, static_cast<float>(noise));
+            utils::pose_predictor predictor(settings);
+            utils::pose_predictor uncapped(uncapped_settings);
+            std::vector<double> raw_errors;
+            std::vector<double> predicted_errors;
+            std::vector<double> uncapped_errors;
+
+            for (double t = 0; t < duration; t += 1 / rate) {
+                utils::head_pose sample = path.pose(t);
+                sample.yaw += jitter(rng);
+                sample.pitch += jitter(rng);
+                sample.roll += jitter(rng);
+                predictor.update(t, sample);
+                uncapped.update(t, sample);
+                if (t < 1) {
+                    continue; // let the filter settle
+                }
+                const utils::head_pose heard = path.pose(t + latency);
+                raw_errors.push_back(error_deg(sample, heard));
+                predicted_errors.push_back(error_deg(predictor.predict(t + latency), heard));
+                uncapped_errors.push_back(error_deg(uncapped.predict(t + latency), heard));
+            }
+
+            const error_stats raw = summarize(raw_errors);
+            const error_stats predicted = summarize(predicted_errors);
+            const error_stats beyond = summarize(uncapped_errors);
+            printf("%-22s %6.0f ms %8.2f / %7.2f %8.2f / %7.2f %8.2f / %7.2f\n",
+                   path.name,
+                   latency * 1000,
+                   raw.rms,
+                   raw.p95,
+                   predicted.rms,
+                   predicted.p95,
+                   beyond.rms,
+                   beyond.p95);
+        }
+    }
+    return 0;
+}
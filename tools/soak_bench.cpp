@@ -0,0 +1,519 @@
+//
+//  soak_bench.cpp
+//  foo_out_avfoundation
+//
+//  Accelerated soak run of the portable output core. The render chain feeds a shared-memory ring in
+//  backpressure mode, a simulated renderer drains it at --speed times real time, and simulated_device_backend
+//  stands in for CoreAudio hot-plug. Content is a seeded mix of formats, chunk sizes and DSP settings with
+//  seeks, pauses (long ones reclaim the helpers like the engine's idle reclaim) and device changes. Feeding
+//  stops at the engine's queue limits: the target buffer, or 64 buffers (isQueueFullLocked).
+//
+//  Resources are sampled at the start of every round of --round minutes of content, right after the same
+//  reference format was set up, so buffers sized for the previous format don't read as growth. The run fails
+//  (exit 1) on a growth trend in RSS, heap or queued audio, on a queue deeper than the target plus one chunk or
+//  than 48 buffers, on CPU per hour of content above --cpu-limit, or on non-finite output. CPU includes the
+//  simulated renderer.
+//
+//  Build (Linux or macOS):
+//      c++ -std=gnu++20 -O2 -pthread -Isrc/common tools/soak_bench.cpp -o soak_bench
+//
+//  Usage:
+//      soak_bench [--hours H] [--speed X] [--round MIN] [--target MS] [--cpu-limit S] [--seed N]
+//
+
+#include "device_registry.hpp"
+#include "render_chain.hpp"
+#include "resource_monitor.hpp"
+#include "shm_ring.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include <unistd.h>
+
+namespace
+{
+    using clock_type = std::chrono::steady_clock;
+
+    constexpr size_t engine_buffer_cap = 64; // isQueueFullLocked
+    constexpr double max_chunk_seconds = 0.1;
+
+    struct track {
+        uint32_t rate;
+        unsigned channels;
+        size_t chunk_frames;
+        uint32_t night_mode;
+        uint32_t crossfeed;
+        double seconds;
+    };
+
+    // Stands in for the device: pulls one IO buffer at a time from the ring, paced at `speed` times the
+    // stream's rate, and counts dry spells the way the engine counts underruns
+    class simulated_renderer {
+    public:
+        simulated_renderer(const std::string &ring, double speed) : speed_(speed) {
+            opened_ = reader_.open(ring);
+            if (opened_) {
+                thread_ = std::thread([this] { run(); });
+            }
+        }
+
+        ~simulated_renderer() {
+            stop_.store(true, std::memory_order_relaxed);
+            if (thread_.joinable()) {
+                thread_.join();
+            }
+        }
+
+        bool opened() const { return opened_; }
+        void set_paused(bool paused) { paused_.store(paused, std::memory_order_relaxed); }
+        void set_buffer_frames(uint32_t frames) { buffer_frames_.store(std::max(1u, frames), std::memory_order_relaxed); }
+        uint64_t underruns() const { return underruns_.load(std::memory_order_relaxed); }
+        uint64_t bad_samples() const { return bad_samples_.load(std::memory_order_relaxed); }
+
+    private:
+        void run() {
+            utils::shm_ring_reader::format f;
+            bool synced = false; // pacing base belongs to the current stream and isn't paused
+            bool started = false;
+            bool dry = false;
+            auto base = clock_type::now();
+            uint64_t played = 0;
+
+            while (!stop_.load(std::memory_order_relaxed)) {
+                const uint32_t buffer = buffer_frames_.load(std::memory_order_relaxed);
+                if (paused_.load(std::memory_order_relaxed)) {
+                    synced = false;
+                } else if (!synced || reader_.format_changed()) {
+                    if (reader_.current_format(f) && f.sample_rate != 0) {
+                        synced = true;
+                        started = false;
+                        base = clock_type::now();
+                        played = 0;
+                        dry = false;
+                    }
+                } else {
+                    const double elapsed = std::chrono::duration<double>(clock_type::now() - base).count();
+                    const auto due = static_cast<int64_t>(elapsed * f.sample_rate * speed_) - static_cast<int64_t>(played);
+                    if (due >= static_cast<int64_t>(buffer)) {
+                        pull(static_cast<size_t>(due), f.channels, started, dry, base, played);
+                    }
+                }
+                // One device period of wall time, but not finer than the scheduler can sleep
+                const double period = f.sample_rate ? buffer / (f.sample_rate * speed_) : 0.001;
+                std::this_thread::sleep_for(std::chrono::duration<double>(std::clamp(period, 100e-6, 1e-3)));
+            }
+        }
+
+        void pull(size_t due, unsigned channels, bool &started, bool &dry, clock_type::time_point &base, uint64_t &played) {
+            const utils::shm_ring_reader::region r = reader_.acquire();
+            const size_t n = std::min(due, r.frames());
+            if (n > 0) {
+                // Spot check, scanning every sample at 100x would cost more than the chain
+                const float *first = r.first_frames ? r.first : r.second;
+                for (unsigned c = 0; c < channels; c++) {
+                    bad_samples_.fetch_add(!std::isfinite(first[c]), std::memory_order_relaxed);
+                }
+                reader_.release(n);
+            }
+            if (!started && n == 0) {
+                // Nothing fed since the stream (re)started: the device isn't playing yet
+                base = clock_type::now();
+                played = 0;
+                return;
+            }
+            started = true;
+            if (n < due) {
+                if (!dry) {
+                    underruns_.fetch_add(1, std::memory_order_relaxed);
+                }
+                dry = true;
+            } else {
+                dry = false;
+            }
+            // Missing frames were played as silence, the device doesn't wait for them
+            played += due;
+        }
+
+        utils::shm_ring_reader reader_;
+        double speed_;
+        bool opened_ = false;
+        std::thread thread_;
+        std::atomic<bool> stop_{false};
+        std::atomic<bool> paused_{false};
+        std::atomic<uint32_t> buffer_frames_{512};
+        std::atomic<uint64_t> underruns_{0};
+        std::atomic<uint64_t> bad_samples_{0};
+    };
+
+    struct counters {
+        double content_seconds = 0; // fed to the renderer
+        uint64_t tracks = 0;
+        uint64_t format_switches = 0;
+        uint64_t seeks = 0;
+        uint64_t pauses = 0;
+        uint64_t reclaims = 0;
+        uint64_t device_changes = 0;
+        uint64_t buffer_high_water = 0;
+        double round_queued_seconds = 0; // deepest queue since the last sample
+    };
+
+    // The output's side: one chain, the ring as the renderer's queue, and the engine's queue accounting
+    class soak_player {
+    public:
+        soak_player(double speed, double target_seconds, uint64_t seed)
+            : speed_(speed), target_(target_seconds), ring_(ring_name(), utils::shm_ring_backend::overflow_policy::backpressure, 16u << 20),
+              rng_(seed) {
+            auto backend = std::make_unique<utils::simulated_device_backend>();
+            devices_ = backend.get();
+            devices_->plug({"builtin", "Built-in Output", 48000, 512, 24, 16, 2});
+            devices_->set_default("builtin");
+            registry_ = std::make_unique<utils::device_registry>(std::move(backend));
+            device_generation_ = registry_->generation();
+            device_ = *registry_->find("");
+            tuning_.split_frames = device_.buffer_frames;
+            tuning_.target_buffer_ms = static_cast<uint32_t>(target_seconds * 1000);
+            // Room for the largest chunk up front, so the buffers don't creep up as bigger chunks come along
+            const size_t largest = static_cast<size_t>(max_chunk_seconds * 192000) * 16;
+            input_.reserve(largest);
+            output_.reserve(largest);
+        }
+
+        ~soak_player() { ring_.close(); }
+
+        // Whole content hours, in rounds that each start with the reference format
+        void run(double hours, double round_minutes, utils::resource_monitor &monitor) {
+            while (c_.content_seconds < hours * 3600) {
+                const double round_end = std::min(hours * 3600, c_.content_seconds + round_minutes * 60);
+                // Each round starts like playback after a stop: reference format, no helpers
+                chain_.release_helpers();
+                play({48000, 2, 4096, 0, 0, 30}, round_end, [&] {
+                    monitor.sample(c_.buffer_high_water, c_.round_queued_seconds);
+                    c_.round_queued_seconds = 0;
+                    const auto &s = monitor.samples().back();
+                    printf("%7.2f h  cpu %8.1f s  rss %8llu KiB  heap %10llu  wakeups %9llu  buffers %3llu  queued %.3f s\n",
+                           c_.content_seconds / 3600,
+                           s.cpu_seconds,
+                           static_cast<unsigned long long>(s.rss_bytes / 1024),
+                           static_cast<unsigned long long>(s.alloc_blocks),
+                           static_cast<unsigned long long>(s.wakeups),
+                           static_cast<unsigned long long>(s.pool_high_water),
+                           s.queued_seconds);
+                    fflush(stdout);
+                });
+                while (c_.content_seconds < round_end) {
+                    play(random_track(), round_end, nullptr);
+                }
+            }
+            drain();
+        }
+
+        const counters &stats() const { return c_; }
+        uint64_t underruns() const { return renderer_ ? renderer_->underruns() : 0; }
+        uint64_t bad_samples() const { return renderer_ ? renderer_->bad_samples() : 0; }
+        bool ok() const { return renderer_ && renderer_->opened(); }
+
+    private:
+        static std::string ring_name() { return "/avf-soak-" + std::to_string(getpid()); }
+
+        track random_track() {
+            static constexpr uint32_t rates[] = {44100, 48000, 88200, 96000, 192000};
+            static constexpr unsigned layouts[] = {1, 2, 2, 2, 2, 6, 8, 16};
+            track t;
+            t.rate = rates[rng_() % std::size(rates)];
+            t.channels = layouts[rng_() % std::size(layouts)];
+            if (t.channels == 16) {
+                t.rate = 48000; // helpers engage from 16 channels; keep it cheap enough for 100x on one core
+            }
+            const double chunk = std::uniform_real_distribution<double>(0.02, max_chunk_seconds)(rng_);
+            t.chunk_frames = static_cast<size_t>(chunk * t.rate);
+            t.night_mode = static_cast<uint32_t>(rng_() % utils::night_mode_preset_count);
+            t.crossfeed = t.channels == 2 ? static_cast<uint32_t>(rng_() % utils::crossfeed_preset_count) : 0;
+            t.seconds = std::uniform_real_distribution<double>(60, 600)(rng_);
+            return t;
+        }
+
+        bool chance(double seconds, double mean_interval) {
+            return std::uniform_real_distribution<double>(0, 1)(rng_) < seconds / mean_interval;
+        }
+
+        // One track until it ends or the round does; `first_chunk` runs once the first chunk is queued
+        template <typename Hook>
+        void play(const track &t, double until, Hook first_chunk) {
+            c_.tracks++;
+            if (t.rate != rate_ || t.channels != channels_) {
+                // Gapless needs the same format; a switch lets the queue play out, then starts a new stream
+                drain();
+                c_.format_switches++;
+                rate_ = t.rate;
+                channels_ = t.channels;
+                ring_.setup_format(t.rate, t.channels);
+                restart_queue();
+                if (!renderer_) {
+                    renderer_ = std::make_unique<simulated_renderer>(ring_name(), speed_);
+                    renderer_->set_buffer_frames(device_.buffer_frames);
+                }
+            }
+            tuning_.night_mode = t.night_mode;
+            tuning_.crossfeed = t.crossfeed;
+
+            // One second of decorrelated tones, looped
+            std::vector<double> source(static_cast<size_t>(t.rate) * t.channels);
+            for (size_t f = 0; f < t.rate; f++) {
+                for (unsigned c = 0; c < t.channels; c++) {
+                    source[f * t.channels + c] = 0.25 * std::sin(2 * 3.14159265358979323846 * (60.0 + 53.0 * c) * f / t.rate);
+                }
+            }
+
+            const double chunk_seconds = static_cast<double>(t.chunk_frames) / t.rate;
+            size_t position = 0;
+            for (double played = 0; played < t.seconds && c_.content_seconds < until; played += chunk_seconds) {
+                follow_device();
+                if (chance(chunk_seconds, 180)) {
+                    c_.seeks++;
+                    position = rng_() % t.rate;
+                    flush();
+                }
+                if (chance(chunk_seconds, 600)) {
+                    pause(std::uniform_real_distribution<double>(1, 90)(rng_));
+                }
+                if (chance(chunk_seconds, 7200)) {
+                    change_device();
+                }
+
+                while (queue_full()) {
+                    std::this_thread::sleep_for(std::chrono::duration<double>(std::clamp(chunk_seconds / speed_ / 4, 100e-6, 1e-3)));
+                }
+                feed(source, position, t.chunk_frames);
+                position = (position + t.chunk_frames) % t.rate;
+                if constexpr (!std::is_same_v<Hook, std::nullptr_t>) {
+                    if (played == 0) {
+                        first_chunk();
+                    }
+                }
+            }
+        }
+
+        void feed(const std::vector<double> &source, size_t position, size_t frames) {
+            // The source loops; feed from where it wraps in one chunk so the chain sees a contiguous input
+            input_.resize(frames * channels_);
+            for (size_t f = 0; f < frames; f++) {
+                const double *frame = &source[((position + f) % rate_) * channels_];
+                std::copy(frame, frame + channels_, &input_[f * channels_]);
+            }
+            output_.resize(chain_.prepare(rate_, channels_, frames));
+            const unsigned out_channels = chain_.process(input_.data(), output_.data(), channels_, frames, rate_, tuning_);
+            chain_.release_helpers_if_requested();
+
+            size_t taken = 0;
+            while (taken < frames) {
+                const size_t n = ring_.feed(output_.data() + taken * out_channels, frames - taken);
+                if (n == 0) {
+                    ring_.wait_for_space(1'000'000);
+                }
+                taken += n;
+            }
+            fed_ += frames;
+            ends_.push_back(fed_);
+            c_.content_seconds += static_cast<double>(frames) / rate_;
+            c_.buffer_high_water = std::max<uint64_t>(c_.buffer_high_water, ends_.size());
+            c_.round_queued_seconds = std::max(c_.round_queued_seconds, ring_.latency());
+        }
+
+        // isQueueFullLocked with a target buffer: queued audio against the target (never below two device
+        // buffers), and the buffer count cap
+        bool queue_full() {
+            const uint64_t queued = static_cast<uint64_t>(std::llround(ring_.latency() * rate_));
+            const uint64_t consumed = fed_ - std::min(fed_, queued);
+            while (!ends_.empty() && ends_.front() <= consumed) {
+                ends_.pop_front();
+            }
+            const double floor = 2.0 * device_.buffer_frames / device_.nominal_rate * rate_;
+            return ends_.size() >= engine_buffer_cap || static_cast<double>(queued) >= std::max(target_ * rate_, floor);
+        }
+
+        void restart_queue() {
+            ends_.clear();
+            fed_ = 0;
+            chain_.restart();
+        }
+
+        void flush() {
+            ring_.flush();
+            restart_queue();
+        }
+
+        void drain() {
+            const auto give_up = clock_type::now() + std::chrono::duration<double>(2 * target_ / speed_ + 0.5);
+            while (ring_.latency() > 0 && clock_type::now() < give_up) {
+                std::this_thread::sleep_for(std::chrono::microseconds(200));
+            }
+        }
+
+        // Paused in wall time scaled like the content; long pauses hit the engine's idle reclaim
+        void pause(double seconds) {
+            c_.pauses++;
+            renderer_->set_paused(true);
+            std::this_thread::sleep_for(std::chrono::duration<double>(seconds / speed_));
+            if (seconds >= tuning_.idle_reclaim_s) {
+                // The engine calls this from its render queue; the chain acts on it on the feeding thread
+                chain_.request_release();
+                c_.reclaims += chain_.release_helpers_if_requested();
+            }
+            chain_.restart(); // resume fades in
+            renderer_->set_paused(false);
+        }
+
+        // A USB DAC comes and goes, or the built-in device changes its IO buffer
+        void change_device() {
+            switch (rng_() % 3) {
+            case 0:
+                devices_->plug({"usb", "USB DAC", 96000, 256, 48, 32, 2});
+                devices_->set_default("usb");
+                break;
+            case 1:
+                devices_->unplug("usb");
+                break;
+            default:
+                devices_->plug({"builtin", "Built-in Output", 48000, rng_() % 2 ? 512u : 1024u, 24, 16, 2});
+                break;
+            }
+        }
+
+        // Like the output, re-target on a registry change and drop what was queued for the old device
+        void follow_device() {
+            const uint64_t generation = registry_->generation();
+            if (generation == device_generation_) {
+                return;
+            }
+            device_generation_ = generation;
+            if (const auto device = registry_->find("")) {
+                device_ = *device;
+            }
+            tuning_.split_frames = device_.buffer_frames;
+            if (renderer_) {
+                renderer_->set_buffer_frames(device_.buffer_frames);
+                c_.device_changes++;
+                flush();
+            }
+        }
+
+        double speed_;
+        double target_;
+        utils::shm_ring_backend ring_;
+        std::mt19937_64 rng_;
+        utils::simulated_device_backend *devices_ = nullptr; // owned by registry_
+        std::unique_ptr<utils::device_registry> registry_;
+        uint64_t device_generation_ = 0;
+        utils::output_device device_;
+        std::unique_ptr<simulated_renderer> renderer_;
+
+        utils::render_chain chain_;
+        utils::engine_tuning tuning_;
+        std::vector<double> input_;
+        std::vector<float> output_;
+        uint32_t rate_ = 0;
+        unsigned channels_ = 0;
+        uint64_t fed_ = 0;          // frames fed into the current stream
+        std::deque<uint64_t> ends_; // where each queued buffer ends, like the engine's sample queue
+        counters c_;
+    };
+
+    int usage() {
+        fprintf(stderr, "usage: soak_bench [--hours H] [--speed X] [--round MIN] [--target MS] [--cpu-limit S] [--seed N]\n");
+        return 2;
+    }
+} // namespace
+
+int main(int argc, char **argv) {
+    double hours = 24;
+    double speed = 100;
+    double round_minutes = 20;
+    double target_ms = 500;
+    uint64_t seed = 1;
+    utils::resource_monitor::limits limits;
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            return usage();
+        }
+        if (arg == "--hours") {
+            hours = std::max(0.1, atof(argv[++i]));
+        } else if (arg == "--speed") {
+            speed = std::clamp(atof(argv[++i]), 1.0, 1000.0);
+        } else if (arg == "--round") {
+            round_minutes = std::max(1.0, atof(argv[++i]));
+        } else if (arg == "--target") {
+            target_ms = std::clamp(atof(argv[++i]), 50.0, 2000.0);
+        } else if (arg == "--cpu-limit") {
+            limits.cpu_seconds_per_hour = std::max(0.1, atof(argv[++i]));
+        } else if (arg == "--seed") {
+            seed = strtoull(argv[++i], nullptr, 10);
+        } else {
+            return usage();
+        }
+    }
+    limits.max_queued_seconds = target_ms / 1000 + max_chunk_seconds;
+
+    printf("%.1f h of content at %.0fx, rounds of %.0f min, target buffer %.0f ms, seed %llu\n",
+           hours,
+           speed,
+           round_minutes,
+           target_ms,
+           static_cast<unsigned long long>(seed));
+
+    const auto start = clock_type::now();
+    utils::resource_monitor monitor(speed);
+    soak_player player(speed, target_ms / 1000, seed);
+    player.run(hours, round_minutes, monitor);
+    const double wall = std::chrono::duration<double>(clock_type::now() - start).count();
+    if (!player.ok()) {
+        fprintf(stderr, "soak_bench: cannot open the shared-memory ring\n");
+        return 1;
+    }
+
+    const counters &c = player.stats();
+    printf("\n%.2f h of content in %.0f s (%.0fx): %llu tracks, %llu format switches, %llu seeks, %llu pauses "
+           "(%llu reclaims), %llu device changes\n",
+           c.content_seconds / 3600,
+           wall,
+           c.content_seconds / wall,
+           static_cast<unsigned long long>(c.tracks),
+           static_cast<unsigned long long>(c.format_switches),
+           static_cast<unsigned long long>(c.seeks),
+           static_cast<unsigned long long>(c.pauses),
+           static_cast<unsigned long long>(c.reclaims),
+           static_cast<unsigned long long>(c.device_changes));
+    printf("CPU %.1f s per hour of content (limit %.1f), %.0f wakeups/s, %llu underruns, buffer high-water %llu\n",
+           monitor.cpu_seconds_per_hour(),
+           limits.cpu_seconds_per_hour,
+           monitor.wakeups_per_second(),
+           static_cast<unsigned long long>(player.underruns()),
+           static_cast<unsigned long long>(c.buffer_high_water));
+
+    std::vector<std::string> problems = monitor.verdict(limits);
+    if (monitor.samples().size() < 8) {
+        problems.emplace_back("fewer than 8 samples, run longer or use shorter rounds");
+    }
+    if (player.bad_samples() > 0) {
+        problems.emplace_back(std::to_string(player.bad_samples()) + " non-finite samples reached the renderer");
+    }
+    for (const auto &problem : problems) {
+        printf("FAILED: %s\n", problem.c_str());
+    }
+    if (problems.empty()) {
+        printf("passed\n");
+    }
+    return problems.empty() ? 0 : 1;
+}
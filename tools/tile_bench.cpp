@@ -0,0 +1,124 @@
+//
+//  tile_bench.cpp
+//  foo_out_avfoundation
+//
+//  What strip-mining a large chunk through the render chain saves: the old path converts the whole chunk into a
+//  temporary, runs every graph pass over all of it and copies the result into the enqueued buffer; the tiled
+//  path (render_chain with helpers off) converts and processes cache-sized tiles straight into the destination.
+//  Reports time per chunk and the DRAM traffic the model says the tiled path avoids.
+//
+//  Build (Linux or macOS):
+//      c++ -std=gnu++20 -O2 -Isrc/common tools/tile_bench.cpp -o tile_bench
+//
+//  Usage:
+//      tile_bench [--frames N] [--rate HZ] [--night N] [--runs N]
+//
+
+#include "render_chain.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace
+{
+    using clock_type = std::chrono::steady_clock;
+
+    // The chain's stages with the same settings, run the way process_samples_v2 used to
+    struct whole_chunk {
+        utils::dsp_graph graph;
+        std::shared_ptr<utils::night_mode_stage> night = std::make_shared<utils::night_mode_stage>();
+
+        whole_chunk(uint32_t night_mode) {
+            graph.add(std::make_shared<utils::sanitize_stage>());
+            graph.add(std::make_shared<utils::fade_in_stage>());
+            graph.add(night, night_mode != 0);
+            night->set_preset(night_mode);
+        }
+
+        void run(const double *input, float *destination, unsigned channels, size_t frames, uint32_t rate) {
+            if (!graph.prepared_for(rate, channels, frames)) {
+                graph.prepare(rate, channels, std::bit_ceil(std::max<size_t>(frames, 4096)));
+            }
+            std::vector<float> temporary(frames * graph.max_channels());
+            utils::simd_convert(input, temporary.data(), frames * channels);
+            const unsigned out_channels = graph.process(temporary.data(), frames);
+            memcpy(destination, temporary.data(), frames * out_channels * sizeof(float));
+        }
+    };
+
+    template <typename Run>
+    double best_ms(int runs, Run run) {
+        double best = 1e30;
+        for (int i = 0; i < runs; i++) {
+            const auto start = clock_type::now();
+            run();
+            best = std::min(best, std::chrono::duration<double, std::milli>(clock_type::now() - start).count());
+        }
+        return best;
+    }
+
+    int usage() {
+        fprintf(stderr, "usage: tile_bench [--frames N] [--rate HZ] [--night N] [--runs N]\n");
+        return 2;
+    }
+} // namespace
+
+int main(int argc, char **argv) {
+    size_t frames = 65536;
+    uint32_t rate = 48000;
+    uint32_t night_mode = 0;
+    int runs = 20;
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            return usage();
+        }
+        if (arg == "--frames") {
+            frames = std::max(1l, atol(argv[++i]));
+        } else if (arg == "--rate") {
+            rate = static_cast<uint32_t>(std::max(8000, atoi(argv[++i])));
+        } else if (arg == "--night") {
+            night_mode = static_cast<uint32_t>(std::max(0, atoi(argv[++i])));
+        } else if (arg == "--runs") {
+            runs = std::max(1, atoi(argv[++i]));
+        } else {
+            return usage();
+        }
+    }
+
+    utils::engine_tuning tuning;
+    tuning.power = utils::engine_tuning::power_mode::energy; // no helpers, so every chunk is tiled
+    tuning.night_mode = night_mode;
+
+    // Passes over the whole chunk besides conversion: one per graph step (sanitize and fade-in are fused),
+    // plus the copy into the enqueued buffer. Each reads and writes 4 bytes per sample.
+    const int passes = 1 + (night_mode != 0) + 1;
+    printf("%zu frames at %u Hz, night mode %u, best of %d\n", frames, rate, night_mode, runs);
+    printf("%8s %12s %12s %8s %16s\n", "channels", "whole ms", "tiled ms", "speedup", "saved MB/chunk");
+
+    for (const unsigned channels : {2u, 8u, 16u, 32u, 64u}) {
+        std::vector<double> input(frames * channels);
+        for (size_t i = 0; i < input.size(); i++) {
+            input[i] = 0.5 * std::sin(0.001 * static_cast<double>(i));
+        }
+
+        whole_chunk baseline(night_mode);
+        utils::render_chain chain;
+        std::vector<float> destination(chain.prepare(rate, channels, frames));
+        std::vector<float> reference(destination.size());
+
+        const double whole = best_ms(runs, [&] { baseline.run(input.data(), reference.data(), channels, frames, rate); });
+        const double tiled = best_ms(runs, [&] { chain.process(input.data(), destination.data(), channels, frames, rate, tuning); });
+
+        const double saved = static_cast<double>(frames) * channels * 8 * passes / (1024.0 * 1024.0);
+        printf("%8u %12.3f %12.3f %7.2fx %16.1f\n", channels, whole, tiled, whole / tiled, saved);
+    }
+    return 0;
+}
@@ -0,0 +1,153 @@
+//
+//  transpose_bench.cpp
+//  foo_out_avfoundation
+//
+//  Interleave/deinterleave kernels (interleave.hpp) against the per-sample reference loops, for the channel
+//  counts with register transposes and two that take the gather fallback, at short and long blocks. Outputs
+//  are compared with the reference before timing. Interleaving has no fallback of its own (other counts run
+//  the reference loop), so those rows are left out. Build it on each target, the kernels are NEON on ARM and
+//  SSE on x86.
+//
+//  Build (Linux or macOS):
+//      c++ -std=gnu++20 -O2 -Isrc/common tools/transpose_bench.cpp -o transpose_bench
+//
+//  Usage:
+//      transpose_bench [--samples N]
+//
+
+#include "interleave.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+namespace
+{
+    using clock_type = std::chrono::steady_clock;
+
+    // Planes of one block, separately allocated like a planar DSP would hold them
+    struct planar {
+        std::vector<std::vector<float>> storage;
+        std::vector<float *> pointers;
+
+        planar(unsigned channels, size_t frames) : storage(channels, std::vector<float>(frames)) {
+            for (auto &plane : storage) {
+                pointers.push_back(plane.data());
+            }
+        }
+
+        bool operator==(const planar &other) const { return storage == other.storage; }
+    };
+
+    // Best time per frame over several rounds, each repeating the block until about `samples` were moved
+    template <typename Run>
+    double best_ns_per_frame(size_t frames, unsigned channels, size_t samples, Run run) {
+        const size_t repeats = std::max<size_t>(1, samples / (frames * channels));
+        double best = 1e30;
+        for (int round = 0; round < 5; round++) {
+            const auto start = clock_type::now();
+            for (size_t i = 0; i < repeats; i++) {
+                run();
+            }
+            best = std::min(best, std::chrono::duration<double, std::nano>(clock_type::now() - start).count());
+        }
+        return best / static_cast<double>(repeats * frames);
+    }
+
+    void report(const char *what, unsigned channels, size_t frames, double scalar, double kernel, bool same) {
+        printf("%-20s %8u %7zu %10.3f %10.3f %7.2fx %s\n",
+               what,
+               channels,
+               frames,
+               scalar,
+               kernel,
+               scalar / kernel,
+               same ? "" : "MISMATCH");
+    }
+
+    int usage() {
+        fprintf(stderr, "usage: transpose_bench [--samples N]\n");
+        return 2;
+    }
+} // namespace
+
+int main(int argc, char **argv) {
+    size_t samples = size_t(1) << 24;
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        if (arg == "--samples" && i + 1 < argc) {
+            samples = std::max(1l, atol(argv[++i]));
+        } else {
+            return usage();
+        }
+    }
+
+#if defined(__aarch64__) || defined(__arm64ec__)
+    const char *isa = "NEON";
+#elif defined(__SSE2__) || defined(__x86_64__)
+    const char *isa = "SSE";
+#else
+    const char *isa = "scalar";
+#endif
+    printf("%s kernels; ns per frame, reference loop vs kernel\n", isa);
+    printf("%-20s %8s %7s %10s %10s %8s\n", "", "channels", "frames", "scalar", "kernel", "speedup");
+
+    bool all_same = true;
+    for (const unsigned channels : {2u, 4u, 6u, 8u, 5u, 12u}) {
+        for (const size_t frames : {size_t(64), size_t(256), size_t(4096)}) {
+            std::vector<double> source(frames * channels);
+            std::vector<float> interleaved(frames * channels);
+            for (size_t i = 0; i < source.size(); i++) {
+                source[i] = std::sin(0.37 * static_cast<double>(i));
+                interleaved[i] = static_cast<float>(source[i]);
+            }
+            planar reference(channels, frames);
+            planar planes(channels, frames);
+
+            utils::scalar_deinterleave(source.data(), reference.pointers.data(), frames, channels);
+            utils::deinterleave(source.data(), planes.pointers.data(), frames, channels);
+            bool same = planes == reference;
+            double scalar = best_ns_per_frame(frames, channels, samples, [&] {
+                utils::scalar_deinterleave(source.data(), reference.pointers.data(), frames, channels);
+            });
+            double kernel = best_ns_per_frame(frames, channels, samples, [&] {
+                utils::deinterleave(source.data(), planes.pointers.data(), frames, channels);
+            });
+            report("double -> planar", channels, frames, scalar, kernel, same);
+            all_same &= same;
+
+            utils::deinterleave(interleaved.data(), planes.pointers.data(), frames, channels);
+            same = planes == reference;
+            scalar = best_ns_per_frame(frames, channels, samples, [&] {
+                utils::scalar_deinterleave(interleaved.data(), reference.pointers.data(), frames, channels);
+            });
+            kernel = best_ns_per_frame(frames, channels, samples, [&] {
+                utils::deinterleave(interleaved.data(), planes.pointers.data(), frames, channels);
+            });
+            report("float -> planar", channels, frames, scalar, kernel, same);
+            all_same &= same;
+
+            if (channels != 2 && channels != 4 && channels != 6 && channels != 8) {
+                continue;
+            }
+            std::vector<float> expected(frames * channels);
+            std::vector<float> output(frames * channels);
+            utils::scalar_interleave(reference.pointers.data(), expected.data(), frames, channels);
+            utils::interleave(reference.pointers.data(), output.data(), frames, channels);
+            same = output == expected && expected == interleaved;
+            scalar = best_ns_per_frame(frames, channels, samples, [&] {
+                utils::scalar_interleave(reference.pointers.data(), expected.data(), frames, channels);
+            });
+            kernel = best_ns_per_frame(frames, channels, samples, [&] {
+                utils::interleave(reference.pointers.data(), output.data(), frames, channels);
+            });
+            report("planar -> interleaved", channels, frames, scalar, kernel, same);
+            all_same &= same;
+        }
+    }
+    return all_same ? 0 : 1;
+}